@@ -0,0 +1,93 @@
+#include "BenchUtils.h"
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+
+namespace Bench {
+
+std::string getYorkiePath() {
+    return YORKIE_BENCH_YORKIE;
+}
+
+std::string getSourceDir() {
+    return YORKIE_BENCH_SOURCE_DIR;
+}
+
+std::string getWorkDir() {
+    static bool Created = false;
+    if (!Created) {
+        mkdir(YORKIE_BENCH_WORK_DIR, 0755);
+        Created = true;
+    }
+    return YORKIE_BENCH_WORK_DIR;
+}
+
+int runCommand(const std::string &Command) {
+    return system(Command.c_str());
+}
+
+bool writeFile(const std::string &Path, const std::string &Contents) {
+    std::ofstream OS(Path, std::ios::binary | std::ios::trunc);
+    OS << Contents;
+    return OS.good();
+}
+
+std::string readFile(const std::string &Path) {
+    std::ifstream IS(Path, std::ios::binary);
+    std::stringstream SS;
+    SS << IS.rdbuf();
+    return SS.str();
+}
+
+// Programs are named after the options they were generated with.
+std::string getGeneratedProgram(const Gen::GeneratorOptions &Opts) {
+    std::string Path = getWorkDir() + "/generated-" + std::to_string(Opts.NumFunctions) +
+        "-s" + std::to_string(Opts.Seed) + "-a" + std::to_string(Opts.MaxArgs) +
+        "-e" + std::to_string(Opts.MaxExprs) + "-d" + std::to_string(Opts.MaxDepth) +
+        "-l" + std::to_string(Opts.MaxLoopDepth) + "-o" + std::to_string(Opts.NumOperators) +
+        "-g" + std::to_string(Opts.Shape) + ".yk";
+
+    static std::set<std::string> Generated;
+    if (Generated.insert(Path).second) {
+        std::ofstream OS(Path, std::ios::trunc);
+        Gen::generateProgram(Opts, OS);
+    }
+    return Path;
+}
+
+std::string getGeneratedProgram(uint64_t NumFunctions) {
+    Gen::GeneratorOptions Opts;
+    Opts.NumFunctions = NumFunctions;
+    return getGeneratedProgram(Opts);
+}
+
+// yorkie loads lib/stdlib.ll relative to the working directory, so it runs
+// from the source directory. The IR it prints to stderr is thrown away.
+bool compileWithReport(const std::string &Input, const std::string &Options,
+                       const std::string &ReportPath) {
+    std::string Command = "cd '" + getSourceDir() + "' && '" + getYorkiePath() + "' " + Options +
+        " -time-report-json='" + ReportPath + "' -i '" + Input + "' 2>/dev/null";
+    return runCommand(Command) == 0;
+}
+
+// Finds Key after Start and parses the number that follows it.
+static double getNumberAfter(const std::string &Report, size_t Start, const std::string &Key) {
+    if (Start == std::string::npos)
+        return 0;
+    size_t Pos = Report.find(Key, Start);
+    if (Pos == std::string::npos)
+        return 0;
+    return strtod(Report.c_str() + Pos + Key.size(), nullptr);
+}
+
+double getPhaseMillis(const std::string &Report, const std::string &Phase) {
+    return getNumberAfter(Report, Report.find("\"name\": \"" + Phase + "\""), "\"time_ms\": ");
+}
+
+uint64_t getCounter(const std::string &Report, const std::string &Counter) {
+    return (uint64_t)getNumberAfter(Report, Report.find("\"counters\""), "\"" + Counter + "\": ");
+}
+
+} // Namespace
@@ -0,0 +1,49 @@
+#ifndef YORKIE_BENCHUTILS_H
+#define YORKIE_BENCHUTILS_H
+
+#include <cstdint>
+#include <string>
+#include "../tools/ProgramGenerator.h"
+
+//===============================================
+// BenchUtils.h
+//
+// Helpers shared by the yorkie_bench benchmarks.
+//
+// Benchmarks drive the yorkie binary the way a user does. Phase times and
+// counters come from its -time-report-json output, so compiler benchmarks time
+// just the phase they are about.
+//
+//===============================================
+
+namespace Bench {
+
+// Paths, set by CMake.
+std::string getYorkiePath();
+std::string getSourceDir();
+std::string getWorkDir();
+
+// Runs Command with sh, returns its exit status.
+int runCommand(const std::string &Command);
+
+// Writes Contents to Path, replacing it.
+bool writeFile(const std::string &Path, const std::string &Contents);
+std::string readFile(const std::string &Path);
+
+// Writes a generated program to the work directory once, returns its path.
+std::string getGeneratedProgram(const Gen::GeneratorOptions &Opts);
+std::string getGeneratedProgram(uint64_t NumFunctions);
+
+// Compiles Input and writes the -time-report-json output to ReportPath.
+// Options are passed to yorkie as is. Returns false if yorkie failed.
+bool compileWithReport(const std::string &Input, const std::string &Options,
+                       const std::string &ReportPath);
+
+// Reads a value out of a -time-report-json report. Phase names are unique in
+// the report, so the first phase with the name is used.
+double getPhaseMillis(const std::string &Report, const std::string &Phase);
+uint64_t getCounter(const std::string &Report, const std::string &Counter);
+
+}
+
+#endif /* end of include guard:  */
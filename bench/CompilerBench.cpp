@@ -0,0 +1,50 @@
+#include "BenchUtils.h"
+#include "benchmark/benchmark.h"
+
+// =============================================================================
+// Compiler microbenchmarks
+//
+// Each iteration compiles a generated program and reports the time of one
+// phase only, with items/s being tokens lexed, AST nodes parsed or functions
+// generated per second.
+// =============================================================================
+
+// Compiles a generated program with NumFunctions functions once per
+// iteration, timing Phase minus the time of ChildPhase (if any) and counting
+// Counter as the items processed.
+static void benchmarkPhase(benchmark::State &State, const char *Phase, const char *ChildPhase,
+                           const char *Counter) {
+    std::string Input = Bench::getGeneratedProgram(State.range(0));
+    std::string ReportPath = Bench::getWorkDir() + "/compiler-bench.json";
+
+    uint64_t Items = 0;
+    while (State.KeepRunning()) {
+        if (!Bench::compileWithReport(Input, "", ReportPath)) {
+            State.SkipWithError("yorkie failed");
+            return;
+        }
+        std::string Report = Bench::readFile(ReportPath);
+        double Millis = Bench::getPhaseMillis(Report, Phase);
+        if (ChildPhase)
+            Millis -= Bench::getPhaseMillis(Report, ChildPhase);
+        State.SetIterationTime(Millis / 1000);
+        Items += Bench::getCounter(Report, Counter);
+    }
+    State.SetItemsProcessed(Items);
+}
+
+static void BM_Lexer(benchmark::State &State) {
+    benchmarkPhase(State, "lex", nullptr, "tokens");
+}
+BENCHMARK(BM_Lexer)->RangeMultiplier(10)->Range(100, 10000)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+// Parse time includes lexing, which happens on demand while parsing.
+static void BM_Parser(benchmark::State &State) {
+    benchmarkPhase(State, "parse", "lex", "ast-nodes");
+}
+BENCHMARK(BM_Parser)->RangeMultiplier(10)->Range(100, 10000)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+static void BM_Codegen(benchmark::State &State) {
+    benchmarkPhase(State, "codegen", nullptr, "functions");
+}
+BENCHMARK(BM_Codegen)->RangeMultiplier(10)->Range(100, 10000)->UseManualTime()->Unit(benchmark::kMillisecond);
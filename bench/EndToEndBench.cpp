@@ -0,0 +1,81 @@
+#include "BenchUtils.h"
+#include "benchmark/benchmark.h"
+#include <dirent.h>
+
+// =============================================================================
+// End-to-end compile benchmarks
+//
+// Wall time of a whole yorkie run, from reading the source to printing the
+// IR, at -O0 and -O2, and at each debug info level.
+// =============================================================================
+
+static void benchmarkCompile(benchmark::State &State, const std::string &Input) {
+    std::string Options = "-O" + std::to_string(State.range(0));
+    std::string ReportPath = Bench::getWorkDir() + "/end-to-end-bench.json";
+
+    while (State.KeepRunning()) {
+        if (!Bench::compileWithReport(Input, Options, ReportPath)) {
+            State.SkipWithError("yorkie failed");
+            return;
+        }
+    }
+}
+
+static void BM_CompileGenerated(benchmark::State &State) {
+    std::string Input = Bench::getGeneratedProgram(State.range(1));
+    benchmarkCompile(State, Input);
+    State.SetItemsProcessed(State.iterations() * State.range(1));
+}
+BENCHMARK(BM_CompileGenerated)
+    ->ArgPair(0, 100)->ArgPair(0, 1000)->ArgPair(0, 10000)
+    ->ArgPair(2, 100)->ArgPair(2, 1000)->ArgPair(2, 10000)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// What debug info costs: generated programs at -O0 with -g0, -gline-tables-only
+// and -g, reporting the time spent generating and finalizing code and debug
+// info, and the peak memory.
+static void BM_CompileDebugInfo(benchmark::State &State) {
+    static const char *Levels[] = { "-g0", "-gline-tables-only", "-g" };
+    std::string Options = std::string("-O0 ") + Levels[State.range(0)];
+    std::string Input = Bench::getGeneratedProgram(State.range(1));
+    std::string ReportPath = Bench::getWorkDir() + "/debug-info-bench.json";
+    State.SetLabel(Levels[State.range(0)]);
+
+    while (State.KeepRunning()) {
+        if (!Bench::compileWithReport(Input, Options, ReportPath)) {
+            State.SkipWithError("yorkie failed");
+            return;
+        }
+    }
+
+    std::string Report = Bench::readFile(ReportPath);
+    State.counters["debug_info_ms"] = Bench::getPhaseMillis(Report, "debug-info");
+    State.counters["codegen_ms"] = Bench::getPhaseMillis(Report, "codegen");
+    State.counters["peak_rss_kb"] = Bench::getCounter(Report, "peak-rss-kb");
+    State.SetItemsProcessed(State.iterations() * State.range(1));
+}
+BENCHMARK(BM_CompileDebugInfo)
+    ->ArgPair(0, 1000)->ArgPair(1, 1000)->ArgPair(2, 1000)
+    ->ArgPair(0, 10000)->ArgPair(1, 10000)->ArgPair(2, 10000)
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Registers a benchmark for every program in examples/.
+static bool registerExamples() {
+    std::string Dir = Bench::getSourceDir() + "/examples";
+    DIR *D = opendir(Dir.c_str());
+    if (!D)
+        return false;
+
+    while (struct dirent *Entry = readdir(D)) {
+        std::string Name = Entry->d_name;
+        if (Name.size() < 3 || Name.compare(Name.size() - 3, 3, ".yk") != 0)
+            continue;
+        std::string Input = Dir + "/" + Name;
+        benchmark::RegisterBenchmark(("BM_CompileExample/" + Name).c_str(),
+                [Input](benchmark::State &State) { benchmarkCompile(State, Input); })
+            ->Arg(0)->Arg(2)->UseRealTime()->Unit(benchmark::kMillisecond);
+    }
+    closedir(D);
+    return true;
+}
+static bool ExamplesRegistered = registerExamples();
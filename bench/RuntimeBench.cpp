@@ -0,0 +1,50 @@
+#include "BenchUtils.h"
+#include "benchmark/benchmark.h"
+
+// =============================================================================
+// Runtime benchmarks
+//
+// Programs in bench/programs are compiled at each optimization level, then
+// each iteration runs the executable. Compile-time evaluation is disabled so
+// the work happens at run time, and clang only generates code (-O0) so the
+// differences come from yorkie's pipeline. Each program prints its result, or
+// the optimizer would delete the work: main itself always returns 0.
+// =============================================================================
+
+static const char *const Programs[] = { "fib", "loops", "operators", "builtin_operators" };
+
+// Compiles a program at OptLevel once, returns the path of the executable or
+// an empty string if it didn't build.
+static std::string buildProgram(const std::string &Program, int OptLevel) {
+    std::string Exe = Bench::getWorkDir() + "/" + Program + "-O" + std::to_string(OptLevel);
+    std::string Input = Bench::getSourceDir() + "/bench/programs/" + Program + ".yk";
+    std::string Command = "cd '" + Bench::getSourceDir() + "' && '" + Bench::getYorkiePath() +
+        "' -O" + std::to_string(OptLevel) + " -const-eval-budget=0 -i '" + Input +
+        "' 2>&1 >/dev/null | clang -x ir -O0 - -o '" + Exe + "'";
+    return Bench::runCommand(Command) == 0 ? Exe : "";
+}
+
+static void BM_Run(benchmark::State &State) {
+    std::string Program = Programs[State.range(0)];
+    State.SetLabel(Program + " -O" + std::to_string(State.range(1)));
+    std::string Exe = buildProgram(Program, State.range(1));
+    if (Exe.empty()) {
+        State.SkipWithError("could not build the program");
+        return;
+    }
+
+    std::string Command = "'" + Exe + "' 2>/dev/null";
+    while (State.KeepRunning()) {
+        if (Bench::runCommand(Command) != 0) {
+            State.SkipWithError("program failed");
+            return;
+        }
+    }
+}
+
+static void ProgramsAndOptLevels(benchmark::internal::Benchmark *B) {
+    for (int P = 0; P != sizeof(Programs) / sizeof(Programs[0]); ++P)
+        for (int O = 0; O <= 3; ++O)
+            B->ArgPair(P, O);
+}
+BENCHMARK(BM_Run)->Apply(ProgramsAndOptLevels)->UseRealTime()->Unit(benchmark::kMillisecond);
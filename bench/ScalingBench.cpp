@@ -0,0 +1,111 @@
+#include "BenchUtils.h"
+#include "benchmark/benchmark.h"
+
+// =============================================================================
+// Scaling benchmarks
+//
+// Compile time and peak memory of generated programs from 1k to 1M
+// functions, to find where the compiler stops scaling linearly. Besides the
+// wall time each run reports the peak RSS and the time of the main phases as
+// counters, scripts/plot_scaling.py plots them against program size.
+// =============================================================================
+
+static void benchmarkScaling(benchmark::State &State, const Gen::GeneratorOptions &Opts,
+                             const std::string &Options = "") {
+    std::string Input = Bench::getGeneratedProgram(Opts);
+    std::string ReportPath = Bench::getWorkDir() + "/scaling-bench.json";
+
+    std::string Report;
+    while (State.KeepRunning()) {
+        if (!Bench::compileWithReport(Input, Options, ReportPath)) {
+            State.SkipWithError("yorkie failed");
+            return;
+        }
+        Report = Bench::readFile(ReportPath);
+    }
+
+    // Counters are from the last run, they barely change between runs.
+    State.counters["functions"] = Opts.NumFunctions;
+    State.counters["peak_rss_kb"] = Bench::getCounter(Report, "peak-rss-kb");
+    State.counters["parse_ms"] = Bench::getPhaseMillis(Report, "parse");
+    State.counters["codegen_ms"] = Bench::getPhaseMillis(Report, "codegen");
+    State.counters["ast_passes_ms"] = Bench::getPhaseMillis(Report, "ast-passes");
+    State.counters["optimize_ms"] = Bench::getPhaseMillis(Report, "optimize");
+    State.SetItemsProcessed(State.iterations() * Opts.NumFunctions);
+}
+
+static void BM_CompileScaling(benchmark::State &State) {
+    Gen::GeneratorOptions Opts;
+    Opts.NumFunctions = State.range(0);
+    Opts.NumOperators = 4;
+    benchmarkScaling(State, Opts);
+}
+BENCHMARK(BM_CompileScaling)->RangeMultiplier(10)->Range(1000, 1000000)
+    ->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// The same programs with -stream-dir, where peak memory should stay flat.
+static void BM_StreamScaling(benchmark::State &State) {
+    Gen::GeneratorOptions Opts;
+    Opts.NumFunctions = State.range(0);
+    Opts.NumOperators = 4;
+    benchmarkScaling(State, Opts, "-stream-dir='" + Bench::getWorkDir() + "/stream'");
+}
+BENCHMARK(BM_StreamScaling)->RangeMultiplier(10)->Range(1000, 1000000)
+    ->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Same size, different call graphs: call lookups and the AST passes depend on
+// how functions call each other.
+static void BM_CallGraphScaling(benchmark::State &State) {
+    Gen::GeneratorOptions Opts;
+    Opts.NumFunctions = State.range(0);
+    Opts.Shape = (Gen::CallGraphShape)State.range(1);
+    benchmarkScaling(State, Opts);
+}
+BENCHMARK(BM_CallGraphScaling)
+    ->ArgPair(100000, Gen::LocalCalls)->ArgPair(100000, Gen::ChainCalls)
+    ->ArgPair(100000, Gen::RandomCalls)->ArgPair(100000, Gen::StarCalls)
+    ->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// A -repl session of NumModules definitions, each followed by an expression
+// calling it, the first definition and a libm function. Every definition
+// stays in a JIT module of its own, so resolving the calls when an expression
+// is linked (the "jit" phase) shows how symbol lookup scales with modules,
+// and the memory mapped for them how much each module costs. The arguments
+// come from cbrt so they can't be constant folded, and the run disables the
+// AST inliner, so every call really goes through the JIT's symbol lookup.
+static std::string getReplSession(unsigned NumModules) {
+    std::string Path = Bench::getWorkDir() + "/repl-" + std::to_string(NumModules) + ".yk";
+    std::string Session = "extern cbrt(x)\n";
+    for (unsigned i = 0; i != NumModules; ++i) {
+        std::string Name = "f" + std::to_string(i);
+        Session += "def " + Name + "(x) x + " + std::to_string(i) + " end\n";
+        Session += Name + "(cbrt(8)) + f0(cbrt(1));\n";
+    }
+    Bench::writeFile(Path, Session);
+    return Path;
+}
+
+static void BM_ReplSymbolScaling(benchmark::State &State) {
+    unsigned NumModules = State.range(0);
+    std::string Input = getReplSession(NumModules);
+    std::string ReportPath = Bench::getWorkDir() + "/repl-bench.json";
+
+    std::string Report;
+    while (State.KeepRunning()) {
+        if (!Bench::compileWithReport(Input, "-repl -inline-threshold=0", ReportPath)) {
+            State.SkipWithError("yorkie failed");
+            return;
+        }
+        Report = Bench::readFile(ReportPath);
+    }
+
+    double JITMillis = Bench::getPhaseMillis(Report, "jit");
+    State.counters["modules"] = NumModules;
+    State.counters["jit_ms"] = JITMillis;
+    State.counters["jit_us_per_expression"] = JITMillis * 1000 / NumModules;
+    State.counters["jit_memory_kb"] = Bench::getCounter(Report, "jit-memory-kb");
+    State.counters["peak_rss_kb"] = Bench::getCounter(Report, "peak-rss-kb");
+    State.SetItemsProcessed(State.iterations() * NumModules);
+}
+BENCHMARK(BM_ReplSymbolScaling)->RangeMultiplier(10)->Range(100, 10000)
+    ->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
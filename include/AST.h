@@ -2,10 +2,15 @@
 #ifndef YORKIE_AST_H
 #define YORKIE_AST_H
 
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <set>
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Function.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/Casting.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
 #include "Lexer.h"
@@ -14,14 +19,64 @@
 //
 //===============================================
 
+namespace Eval { class Interpreter; }
+namespace Inline { class Inliner; }
+
+// RenameMap - Maps variable names to the names clone() replaces them with.
+typedef std::map<std::string, std::string> RenameMap;
+
 // ExprAST - Base class for all expression nodes.
+// Nodes carry their kind so they can be inspected with llvm::isa/dyn_cast,
+// which doesn't need RTTI.
 class ExprAST {
+public:
+    enum ExprKind {
+        EK_Number,
+        EK_Variable,
+        EK_Var,
+        EK_Binary,
+        EK_Call,
+        EK_If,
+        EK_For,
+        EK_Unary,
+        EK_ArrayAlloc,
+        EK_Index,
+        EK_Length
+    };
+
+private:
+    const ExprKind Kind;
     Lexer::SourceLocation Loc;
 
 public:
-    ExprAST(Lexer::SourceLocation Loc) : Loc(Loc) {}
+    ExprAST(ExprKind Kind, Lexer::SourceLocation Loc) : Kind(Kind), Loc(Loc) {}
     virtual ~ExprAST() {}
+    ExprKind getKind() const { return Kind; }
     virtual llvm::Value *codegen() = 0;
+    // evaluate - Compute the value of this expression at compile time, returns
+    // None if that isn't possible.
+    virtual llvm::Optional<double> evaluate(Eval::Interpreter &I) = 0;
+    // foldConstants - Fold the children of this node, returns a replacement for
+    // this node if it folded to a constant.
+    virtual std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) { return nullptr; }
+    // clone - Deep copy of this expression, renaming the free variables in Renames.
+    virtual std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const = 0;
+    // inlineCalls - Inline calls in the children of this node, returns a
+    // replacement for this node if it was itself an inlined call.
+    virtual std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) { return nullptr; }
+    // collectCalls - Append the name of every function this expression calls,
+    // including user defined operators.
+    virtual void collectCalls(std::vector<std::string> &Callees) const {}
+    // collectAssignments - Append the name of every variable this expression
+    // assigns to, in any scope.
+    virtual void collectAssignments(std::vector<std::string> &Names) const {}
+    // isInvariant - True if this expression has no side effects and reads no
+    // array element or variable in Assigned, so it has the same value anywhere
+    // in a loop that only assigns those.
+    virtual bool isInvariant(const std::set<std::string> &Assigned) const { return false; }
+    // getSize - Number of AST nodes in this expression.
+    virtual unsigned getSize() const { return 1; }
+    Lexer::SourceLocation getLoc() const { return Loc; }
     int getLine() const { return Loc.Line; }
     int getCol() const { return Loc.Col; }
     virtual llvm::raw_ostream &dump(llvm::raw_ostream &out, int ind) {
@@ -34,8 +89,13 @@ class NumberExprAST: public ExprAST {
     double Val;
 
 public:
-    NumberExprAST(Lexer::SourceLocation Loc, double Val) : ExprAST(Loc), Val(Val) {}
+    NumberExprAST(Lexer::SourceLocation Loc, double Val) : ExprAST(EK_Number, Loc), Val(Val) {}
+    double getVal() const { return Val; }
     llvm::Value *codegen() override;
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    bool isInvariant(const std::set<std::string> &Assigned) const override { return true; }
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_Number; }
 };
 
 // VariableExprAST - Expression class for referencing a variable, like "a".
@@ -43,9 +103,13 @@ class VariableExprAST : public ExprAST {
     std::string Name;
 
 public:
-    VariableExprAST(Lexer::SourceLocation Loc, const std::string &Name) : ExprAST(Loc), Name(Name) {};
+    VariableExprAST(Lexer::SourceLocation Loc, const std::string &Name) : ExprAST(EK_Variable, Loc), Name(Name) {};
     const std::string &getName() const { return Name; }
     llvm::Value *codegen() override;
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    bool isInvariant(const std::set<std::string> &Assigned) const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_Variable; }
 };
 
 // VarExprAST - Expression class for var/in
@@ -56,23 +120,62 @@ class VarExprAST : public ExprAST {
 public:
     VarExprAST(Lexer::SourceLocation Loc, std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarNames,
             std::unique_ptr<ExprAST> Body)
-        : ExprAST(Loc), VarNames(std::move(VarNames)), Body(std::move(Body)) {}
+        : ExprAST(EK_Var, Loc), VarNames(std::move(VarNames)), Body(std::move(Body)) {}
 
     llvm::Value *codegen();
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    unsigned getSize() const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_Var; }
 };
 
 // BinaryExprAST - Expression class for a binary operator.
 class BinaryExprAST : public ExprAST {
-    char Op;
+    int Op;                                 // The operator character, or a Lexer::Token for `==` etc.
     std::unique_ptr<ExprAST> LHS, RHS;
 
 public:
     BinaryExprAST(Lexer::SourceLocation Loc,
-            char op,
+            int op,
             std::unique_ptr<ExprAST> LHS,
             std::unique_ptr<ExprAST> RHS) :
-         ExprAST(Loc), Op(op), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+         ExprAST(EK_Binary, Loc), Op(op), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+
+    int getOp() const { return Op; }
+    ExprAST *getLHS() const { return LHS.get(); }
+    ExprAST *getRHS() const { return RHS.get(); }
+
+    // isBuiltin - True if codegen lowers Op directly instead of calling "binary" + Op.
+    // Builtin operators can't be redefined.
+    static bool isBuiltin(int Op) {
+        switch (Op) {
+        case '=': case '+': case '-': case '*': case '/': case '%':
+        case '<': case '>': case Lexer::tok_le: case Lexer::tok_ge:
+        case Lexer::tok_eq: case Lexer::tok_ne: case '&': case '|':
+            return true;
+        default:
+            return false;
+        }
+    }
+    // isShortCircuit - True for '&' and '|', which only evaluate RHS when LHS
+    // doesn't decide the result.
+    static bool isShortCircuit(int Op) { return Op == '&' || Op == '|'; }
+
     llvm::Value *codegen() override;
+    llvm::Value *codegenShortCircuit();
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    bool isInvariant(const std::set<std::string> &Assigned) const override;
+    unsigned getSize() const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_Binary; }
 };
 
 // CallExprAST - Expression class for function calls.
@@ -83,28 +186,45 @@ class CallExprAST : public ExprAST {
 public:
     CallExprAST(Lexer::SourceLocation Loc, const std::string &Callee,
             std::vector<std::unique_ptr<ExprAST> > Args) :
-        ExprAST(Loc), Callee(Callee), Args(std::move(Args)) {}
+        ExprAST(EK_Call, Loc), Callee(Callee), Args(std::move(Args)) {}
     llvm::Value *codegen() override;
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    unsigned getSize() const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_Call; }
 };
 
 // PrototypeAST - This class represents the "prototype" for a function
 // which captures its name, and its argument names (this implicitly the number
 // of arguments the function takes).
 // Also supports user-defined operators.
+// Array arguments ("a[]") are passed as a data pointer and a length.
 class PrototypeAST {
     std::string Name;
     std::vector<std::string> Args;
+    std::vector<bool> ArrayArgs; // Empty if no argument is an array
     bool IsOperator;
     unsigned Precedence; // Precedence if a binary op.
     int Line;
+    bool FastMath = false; // Compiled with fast-math flags ('def fast')
 
 public:
     PrototypeAST(Lexer::SourceLocation Loc, const std::string &name,
-            std::vector<std::string> Args, bool IsOperator = false, unsigned Prec = 0)
-        : Name(name), Args(std::move(Args)), IsOperator(IsOperator),
-        Precedence(Prec), Line(Loc.Line) {};
+            std::vector<std::string> Args, bool IsOperator = false, unsigned Prec = 0,
+            std::vector<bool> ArrayArgs = std::vector<bool>())
+        : Name(name), Args(std::move(Args)), ArrayArgs(std::move(ArrayArgs)),
+        IsOperator(IsOperator), Precedence(Prec), Line(Loc.Line) {};
     llvm::Function *codegen();
     const std::string &getName() const { return Name; }
+    const std::vector<std::string> &getArgs() const { return Args; }
+    bool isArrayArg(unsigned i) const { return i < ArrayArgs.size() && ArrayArgs[i]; }
+    bool hasArrayArgs() const {
+        return std::find(ArrayArgs.begin(), ArrayArgs.end(), true) != ArrayArgs.end();
+    }
 
     bool isUnaryOp() const { return IsOperator && Args.size() == 1; }
     bool isBinaryOp() const { return IsOperator && Args.size() == 2; }
@@ -116,6 +236,8 @@ public:
 
     unsigned getBinaryPrecedence() const { return Precedence; }
     int getLine() const { return Line; }
+    bool isFastMath() const { return FastMath; }
+    void setFastMath() { FastMath = true; }
 };
 
 // FunctionAST - This class represents a function definition itself.
@@ -128,8 +250,15 @@ public:
                 std::unique_ptr<std::vector<std::unique_ptr<ExprAST>>> Body) :
     Proto(std::move(Proto)), Body(std::move(Body)) {}
     llvm::Function *codegen();
+    void foldConstants(Eval::Interpreter &I);
+    void inlineCalls(Inline::Inliner &In);
+    const PrototypeAST &getProto() const { return *Proto; }
+    const std::vector<std::unique_ptr<ExprAST>> &getBody() const { return *Body; }
 };
 
+// FunctionDefMap - Function definitions, keyed by function name.
+typedef std::map<std::string, std::unique_ptr<FunctionAST>> FunctionDefMap;
+
 // IfExprAST - Expression class for if/then/else
 class IfExprAST : public ExprAST {
     std::unique_ptr<ExprAST> Cond, Then, Else;
@@ -137,22 +266,56 @@ class IfExprAST : public ExprAST {
 public:
     IfExprAST(Lexer::SourceLocation Loc, std::unique_ptr<ExprAST> Cond, std::unique_ptr<ExprAST> Then,
             std::unique_ptr<ExprAST> Else)
-        : ExprAST(Loc), Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else)) {}
+        : ExprAST(EK_If, Loc), Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else)) {}
     llvm::Value *codegen();
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    bool isInvariant(const std::set<std::string> &Assigned) const override;
+    unsigned getSize() const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_If; }
 };
 
 // ForExprAST - Expression class for for/in.
+// A parallel loop (parfor) runs the body for VarName = Start, Start + Step, ...
+// while VarName < End, where End is the limit rather than a condition. Each
+// iteration gets its own copy of the variables in scope, and the loop's value
+// is the body's values combined with ReduceOp.
 class ForExprAST : public ExprAST {
     std::string VarName;
     std::unique_ptr<ExprAST> Start, End, Step, Body;
+    bool Parallel;
+    char ReduceOp;
+
+    llvm::Value *codegenParallel();
+    llvm::Value *codegenCounted(ExprAST &Limit);
+    ExprAST *getCountedLimit() const;
+    llvm::Optional<double> evaluateParallel(Eval::Interpreter &I);
 
 public:
     ForExprAST(Lexer::SourceLocation Loc, const std::string &VarName, std::unique_ptr<ExprAST> Start,
             std::unique_ptr<ExprAST> End, std::unique_ptr<ExprAST> Step,
-            std::unique_ptr<ExprAST> Body)
-        : ExprAST(Loc), VarName(VarName), Start(std::move(Start)), End(std::move(End)),
-        Step(std::move(Step)), Body(std::move(Body)) {}
+            std::unique_ptr<ExprAST> Body, bool Parallel = false, char ReduceOp = '+')
+        : ExprAST(EK_For, Loc), VarName(VarName), Start(std::move(Start)), End(std::move(End)),
+        Step(std::move(Step)), Body(std::move(Body)), Parallel(Parallel), ReduceOp(ReduceOp) {}
     llvm::Value *codegen();
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    unsigned getSize() const override;
+
+    // getReduceIdentity - The value of a parallel loop with no iterations: 1
+    // for '*', 0 for '+' and for user defined operators, which have no known
+    // identity.
+    static double getReduceIdentity(char ReduceOp) { return ReduceOp == '*' ? 1.0 : 0.0; }
+
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_For; }
 };
 
 // UnaryExprAST - Expression class for a unary operator.
@@ -162,8 +325,75 @@ class UnaryExprAST : public ExprAST {
 
 public:
     UnaryExprAST(Lexer::SourceLocation Loc, char Opcode, std::unique_ptr<ExprAST> Operand)
-        : ExprAST(Loc), Opcode(Opcode), Operand(std::move(Operand)) {}
+        : ExprAST(EK_Unary, Loc), Opcode(Opcode), Operand(std::move(Operand)) {}
     llvm::Value *codegen();
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    unsigned getSize() const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_Unary; }
+};
+
+// ArrayAllocExprAST - Allocation of a zeroed array, only appears as the
+// initializer of a var/in ("var a[n] in"), which frees it at the end of its
+// scope.
+class ArrayAllocExprAST : public ExprAST {
+    std::unique_ptr<ExprAST> Length;
+
+public:
+    ArrayAllocExprAST(Lexer::SourceLocation Loc, std::unique_ptr<ExprAST> Length)
+        : ExprAST(EK_ArrayAlloc, Loc), Length(std::move(Length)) {}
+    llvm::Value *codegen() override;
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    unsigned getSize() const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_ArrayAlloc; }
+};
+
+// IndexExprAST - Expression class for array elements, like "a[i]".
+class IndexExprAST : public ExprAST {
+    std::unique_ptr<ExprAST> Array, Index;
+
+public:
+    IndexExprAST(Lexer::SourceLocation Loc, std::unique_ptr<ExprAST> Array, std::unique_ptr<ExprAST> Index)
+        : ExprAST(EK_Index, Loc), Array(std::move(Array)), Index(std::move(Index)) {}
+    // codegenAddress - Emit the address of the element, for assignments.
+    llvm::Value *codegenAddress();
+    llvm::Value *codegen() override;
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    unsigned getSize() const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_Index; }
+};
+
+// LengthExprAST - Expression class for the length of an array, "len(a)".
+class LengthExprAST : public ExprAST {
+    std::unique_ptr<ExprAST> Array;
+
+public:
+    LengthExprAST(Lexer::SourceLocation Loc, std::unique_ptr<ExprAST> Array)
+        : ExprAST(EK_Length, Loc), Array(std::move(Array)) {}
+    llvm::Value *codegen() override;
+    llvm::Optional<double> evaluate(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> foldConstants(Eval::Interpreter &I) override;
+    std::unique_ptr<ExprAST> clone(const RenameMap &Renames) const override;
+    std::unique_ptr<ExprAST> inlineCalls(Inline::Inliner &In) override;
+    void collectCalls(std::vector<std::string> &Callees) const override;
+    void collectAssignments(std::vector<std::string> &Names) const override;
+    bool isInvariant(const std::set<std::string> &Assigned) const override;
+    unsigned getSize() const override;
+    static bool classof(const ExprAST *E) { return E->getKind() == EK_Length; }
 };
 
 #endif
@@ -0,0 +1,65 @@
+#ifndef YORKIE_EVALUATOR_H
+#define YORKIE_EVALUATOR_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "AST.h"
+
+//===============================================
+// Evaluator.h
+//
+// Compile-time evaluation of yorkie functions.
+//
+// The interpreter walks the AST directly and mirrors the semantics of the
+// code emitted by codegen(). It is used to fold calls to pure functions with
+// constant arguments into NumberExprAST nodes before any IR is generated.
+//
+// Purity is proven by execution: the only side effects a yorkie program can
+// have go through extern functions, and any call that reaches an extern (or
+// an unknown function) aborts the fold, as does running out of steps.
+//
+//===============================================
+
+namespace Eval {
+
+class Interpreter {
+    const FunctionDefMap &Definitions;              // Definitions the interpreter can call into
+    std::vector<std::pair<std::string, double>> NamedValues; // Variables in the current call frame
+    uint64_t Budget;                                // Steps allowed per fold attempt
+    uint64_t StepsLeft = 0;                         // Steps left in the current fold attempt
+    unsigned CallDepth = 0;                         // Current interpreter call depth
+
+    static const unsigned MaxCallDepth = 512;
+
+public:
+
+    // Constructors
+    // A budget of zero disables folding entirely.
+    Interpreter(const FunctionDefMap &Definitions, uint64_t Budget)
+        : Definitions(Definitions), Budget(Budget) {}
+
+    // Evaluation helpers used by ExprAST::evaluate()
+    bool step();            // Consume one step, returns false when the budget is exhausted.
+    llvm::Optional<double> getVariable(const std::string &Name) const;
+    void setVariable(const std::string &Name, double Val);
+    void eraseVariable(const std::string &Name);
+    std::vector<std::pair<std::string, double>> saveVariables() const { return NamedValues; }
+    void restoreVariables(const std::vector<std::pair<std::string, double>> &Saved) { NamedValues = Saved; }
+    llvm::Optional<double> call(const std::string &Name, llvm::ArrayRef<double> Args);
+
+    // Folding
+    // Replaces every foldable call in the tree rooted at E with its value.
+    void fold(std::unique_ptr<ExprAST> &E);
+    void fold(FunctionAST &F);
+    // Evaluates a closed expression, returns None if it can't be proven constant.
+    llvm::Optional<double> evaluateConstant(ExprAST &E);
+};
+
+}
+
+#endif /* end of include guard:  */
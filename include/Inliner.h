@@ -0,0 +1,52 @@
+#ifndef YORKIE_INLINER_H
+#define YORKIE_INLINER_H
+
+#include <memory>
+#include <string>
+#include "AST.h"
+
+//===============================================
+// Inliner.h
+//
+// AST level inlining of small leaf functions and user defined operators.
+//
+// Used at -O0, where no LLVM inliner runs. A call to a candidate is replaced
+// by a var/in expression that binds the arguments and evaluates a copy of the
+// callee's body, e.g. `a ^ b` with `def binary^ 10 (LHS RHS) RHS < LHS end`
+// becomes `var binary^.LHS = a, binary^.RHS = b in binary^.RHS < binary^.LHS end`.
+// The parameter names are renamed with a '.' the lexer never produces in an
+// identifier, so the bindings can't capture names used by the arguments.
+//
+//===============================================
+
+namespace Inline {
+
+class Inliner {
+    const FunctionDefMap &Definitions;  // Definitions calls are inlined from
+    unsigned Threshold;                 // Max body size (in AST nodes) of a candidate
+    bool CallerFastMath = false;        // The function being inlined into is 'def fast'
+
+public:
+
+    // Constructors
+    Inliner(const FunctionDefMap &Definitions, unsigned Threshold)
+        : Definitions(Definitions), Threshold(Threshold) {}
+
+    // isCandidate - A function can be inlined if its body is a single
+    // expression with no calls in it, no larger than the threshold.
+    bool isCandidate(const FunctionAST &F) const;
+
+    // Returns the inlined body for a call to Callee with the given arguments,
+    // or null if Callee isn't a candidate or is fast while the caller isn't (or
+    // the other way around). Args is left untouched on failure.
+    std::unique_ptr<ExprAST> inlineCall(Lexer::SourceLocation Loc, const std::string &Callee,
+            std::vector<std::unique_ptr<ExprAST>> &Args);
+
+    // Inlines every candidate call in the tree rooted at E.
+    void inlineCalls(std::unique_ptr<ExprAST> &E);
+    void inlineCalls(FunctionAST &F);
+};
+
+}
+
+#endif /* end of include guard:  */
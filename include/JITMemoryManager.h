@@ -0,0 +1,109 @@
+#ifndef YORKIE_JITMEMORYMANAGER_H
+#define YORKIE_JITMEMORYMANAGER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/Support/Memory.h"
+
+//===============================================
+// JITMemoryManager.h
+//
+// Memory for JIT compiled code, shared by all the modules of a JIT.
+//
+// SectionMemoryManager maps fresh pages for every module and changes their
+// protection a section at a time, so with many small modules (a REPL makes
+// one per expression) most of every page is wasted and each module costs
+// several mmap and mprotect calls. Instead a MemoryPool maps large slabs and
+// hands out runs of pages from them, and a PooledMemoryManager per module
+// packs the module's code and read-only data into one run, made read/exec
+// with a single mprotect when the module is finalized (W^X: pages are never
+// writable and executable at once). Read/write data of different modules
+// shares pages, which never change protection. Removing a module gives its
+// pages back to the pool for the next ones.
+//
+// Not thread safe, like the JIT.
+//
+//===============================================
+
+namespace JIT {
+
+class MemoryPool {
+    size_t PageSize;
+    size_t SlabSize;
+    std::vector<llvm::sys::MemoryBlock> Slabs;
+    std::map<uint8_t *, size_t> FreePages;  // Free runs of read/write pages by address, coalesced
+    size_t MappedBytes = 0;
+
+    void addFreeRun(uint8_t *Base, size_t Size);
+
+    // Read/write data is carved out of the current run, each run is released
+    // once all the data in it is.
+    struct DataRun {
+        llvm::sys::MemoryBlock Block;
+        unsigned Live;
+    };
+    std::map<uint8_t *, DataRun> DataRuns;  // By address
+    uint8_t *CurrentRun = nullptr;
+    uint8_t *DataFree = nullptr;            // Next free byte of the current run
+    uint8_t *DataEnd = nullptr;
+
+public:
+
+    // Constructors
+    explicit MemoryPool(size_t SlabSize = 4 << 20);
+    ~MemoryPool();
+    MemoryPool(const MemoryPool &) = delete;
+    MemoryPool &operator=(const MemoryPool &) = delete;
+
+    // Runs of read/write pages, at least Size bytes. Released runs are made
+    // read/write again.
+    llvm::sys::MemoryBlock allocatePages(size_t Size);
+    void releasePages(llvm::sys::MemoryBlock Block);
+
+    // Read/write data, possibly sharing pages with other modules.
+    uint8_t *allocateData(size_t Size, unsigned Alignment);
+    void releaseData(uint8_t *Ptr);
+
+    size_t getPageSize() const { return PageSize; }
+    size_t getMappedBytes() const { return MappedBytes; }
+};
+
+class PooledMemoryManager : public llvm::RTDyldMemoryManager {
+    MemoryPool &Pool;
+    std::vector<llvm::sys::MemoryBlock> TextBlocks;  // Code and read-only data
+    unsigned FinalizedBlocks = 0;
+    uint8_t *TextFree = nullptr;                     // Next free byte of the last text block
+    uint8_t *TextEnd = nullptr;
+    std::vector<uint8_t *> Data;                     // Read/write data from the pool
+
+    bool addTextBlock(size_t Size);
+    uint8_t *allocateText(uintptr_t Size, unsigned Alignment);
+
+public:
+
+    // Constructors
+    explicit PooledMemoryManager(MemoryPool &Pool) : Pool(Pool) {}
+    ~PooledMemoryManager() override;
+
+    // RuntimeDyld says up front how much a module needs, so its text fits in
+    // one run of pages.
+    bool needsToReserveAllocationSpace() override { return true; }
+    void reserveAllocationSpace(uintptr_t CodeSize, uint32_t CodeAlign,
+                                uintptr_t RODataSize, uint32_t RODataAlign,
+                                uintptr_t RWDataSize, uint32_t RWDataAlign) override;
+
+    uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment, unsigned SectionID,
+                                 llvm::StringRef SectionName) override;
+    uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment, unsigned SectionID,
+                                 llvm::StringRef SectionName, bool IsReadOnly) override;
+
+    // Makes the text read/exec. Returns true on error, like SectionMemoryManager.
+    bool finalizeMemory(std::string *ErrMsg = nullptr) override;
+};
+
+}
+
+#endif /* end of include guard:  */
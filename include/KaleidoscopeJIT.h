@@ -14,36 +14,77 @@
 #ifndef LLVM_EXECUTIONENGINE_ORC_KALEIDOSCOPEJIT_H
 #define LLVM_EXECUTIONENGINE_ORC_KALEIDOSCOPEJIT_H
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
 #include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
 #include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
-#include "llvm/IR/Mangler.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "JITMemoryManager.h"
 
 namespace llvm {
 namespace orc {
 
 class KaleidoscopeJIT {
+  // Tells the registered event listeners (profilers, debuggers) about each
+  // object file the linking layer loads.
+  class NotifyObjectLoaded {
+  public:
+    NotifyObjectLoaded(KaleidoscopeJIT &JIT) : JIT(JIT) {}
+
+    template <typename ObjSetT, typename LoadResult>
+    void operator()(ObjectLinkingLayerBase::ObjSetHandleT, const ObjSetT &Objs,
+                    const LoadResult &Infos) {
+      for (unsigned I = 0, E = Objs.size(); I != E; ++I)
+        for (auto *L : JIT.EventListeners)
+          L->NotifyObjectEmitted(*Objs[I]->getBinary(), *Infos[I]);
+    }
+
+  private:
+    KaleidoscopeJIT &JIT;
+  };
+
 public:
-  typedef ObjectLinkingLayer<> ObjLayerT;
+  typedef ObjectLinkingLayer<NotifyObjectLoaded> ObjLayerT;
   typedef IRCompileLayer<ObjLayerT> CompileLayerT;
   typedef CompileLayerT::ModuleSetHandleT ModuleHandleT;
 
-  KaleidoscopeJIT()
-      : TM(EngineBuilder().selectTarget()), DL(TM->createDataLayout()),
+  // Generates code for the host, as the CPU and with the features given (by
+  // default the baseline of the host's architecture).
+  explicit KaleidoscopeJIT(const TargetOptions &Options = TargetOptions(),
+                           StringRef CPU = "",
+                           const std::vector<std::string> &Features = {})
+      : TM(EngineBuilder()
+               .setTargetOptions(Options)
+               .setMCPU(CPU)
+               .setMAttrs(Features)
+               .selectTarget()),
+        DL(TM->createDataLayout()),
+        ObjectLayer(NotifyObjectLoaded(*this)),
         CompileLayer(ObjectLayer, SimpleCompiler(*TM)) {
     llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
   }
 
   TargetMachine &getTargetMachine() { return *TM; }
+  const JIT::MemoryPool &getMemoryPool() const { return Pool; }
+
+  // Listeners are not owned by the JIT and must outlive it.
+  void addEventListener(JITEventListener *L) { EventListeners.push_back(L); }
 
   ModuleHandleT addModule(std::unique_ptr<Module> M) {
+    // The names the module defines, for the symbol table. Only exported
+    // symbols are looked up.
+    std::vector<std::string> Names;
+    for (auto &GV : M->global_values())
+      if (!GV.isDeclaration() && !GV.hasLocalLinkage())
+        Names.push_back(mangle(GV.getName()));
+
     // We need a memory manager to allocate memory and resolve symbols for this
-    // new module. Create one that resolves symbols by looking back into the
-    // JIT.
+    // new module. Create one that allocates from the JIT's pool and resolves
+    // symbols by looking back into the JIT.
     auto Resolver = createLambdaResolver(
         [&](const std::string &Name) {
           if (auto Sym = findMangledSymbol(Name))
@@ -52,16 +93,26 @@ public:
         },
         [](const std::string &S) { return nullptr; });
     auto H = CompileLayer.addModuleSet(singletonSet(std::move(M)),
-                                       make_unique<SectionMemoryManager>(),
+                                       make_unique<JIT::PooledMemoryManager>(Pool),
                                        std::move(Resolver));
 
-    ModuleHandles.push_back(H);
+    for (auto &Name : Names)
+      SymbolTable[Name].push_back(H);
+    ModuleHandles.push_back(std::make_pair(H, std::move(Names)));
     return H;
   }
 
   void removeModule(ModuleHandleT H) {
-    ModuleHandles.erase(
-        std::find(ModuleHandles.begin(), ModuleHandles.end(), H));
+    // Modules are usually removed newest first, like REPL expressions.
+    auto I = std::find_if(ModuleHandles.rbegin(), ModuleHandles.rend(),
+                          [&](const ModuleEntry &E) { return E.first == H; });
+    for (auto &Name : I->second) {
+      auto &Definers = SymbolTable[Name];
+      Definers.erase(std::find(Definers.rbegin(), Definers.rend(), H).base() - 1);
+      if (Definers.empty())
+        SymbolTable.erase(Name);
+    }
+    ModuleHandles.erase(I.base() - 1);
     CompileLayer.removeModuleSet(H);
   }
 
@@ -71,13 +122,14 @@ public:
 
 private:
 
-  std::string mangle(const std::string &Name) {
-    std::string MangledName;
-    {
-      raw_string_ostream MangledNameStream(MangledName);
-      Mangler::getNameWithPrefix(MangledNameStream, Name, DL);
-    }
-    return MangledName;
+  // Mangler::getNameWithPrefix() without the stream: names starting with \1
+  // are used as is, others get the global prefix ('_' on Darwin).
+  std::string mangle(StringRef Name) {
+    if (Name.startswith("\1"))
+      return Name.substr(1).str();
+    if (char Prefix = DL.getGlobalPrefix())
+      return Prefix + Name.str();
+    return Name.str();
   }
 
   template <typename T> static std::vector<T> singletonSet(T t) {
@@ -87,25 +139,41 @@ private:
   }
 
   JITSymbol findMangledSymbol(const std::string &Name) {
-    // Search modules in reverse order: from last added to first added.
-    // This is the opposite of the usual search order for dlsym, but makes more
-    // sense in a REPL where we want to bind to the newest available definition.
-    for (auto H : make_range(ModuleHandles.rbegin(), ModuleHandles.rend()))
-      if (auto Sym = CompileLayer.findSymbolIn(H, Name, true))
-        return Sym;
+    // The symbol table lists the modules defining each name, from first added
+    // to last added. The last one wins: this is the opposite of the usual
+    // search order for dlsym, but makes more sense in a REPL where we want to
+    // bind to the newest available definition.
+    auto I = SymbolTable.find(Name);
+    if (I != SymbolTable.end())
+      for (auto H : make_range(I->second.rbegin(), I->second.rend()))
+        if (auto Sym = CompileLayer.findSymbolIn(H, Name, true))
+          return Sym;
 
     // If we can't find the symbol in the JIT, try looking in the host process.
-    if (auto SymAddr = RTDyldMemoryManager::getSymbolAddressInProcess(Name))
+    // The process doesn't change, so its symbols are cached.
+    auto P = ProcessSymbols.find(Name);
+    if (P != ProcessSymbols.end())
+      return JITSymbol(P->second, JITSymbolFlags::Exported);
+    if (auto SymAddr = RTDyldMemoryManager::getSymbolAddressInProcess(Name)) {
+      ProcessSymbols[Name] = SymAddr;
       return JITSymbol(SymAddr, JITSymbolFlags::Exported);
+    }
 
     return nullptr;
   }
 
+  // A module and the names it defines.
+  typedef std::pair<ModuleHandleT, std::vector<std::string>> ModuleEntry;
+
   std::unique_ptr<TargetMachine> TM;
   const DataLayout DL;
+  JIT::MemoryPool Pool;  // Outlives the modules' memory managers
   ObjLayerT ObjectLayer;
   CompileLayerT CompileLayer;
-  std::vector<ModuleHandleT> ModuleHandles;
+  std::vector<ModuleEntry> ModuleHandles;
+  StringMap<std::vector<ModuleHandleT>> SymbolTable;
+  StringMap<uint64_t> ProcessSymbols;
+  std::vector<JITEventListener *> EventListeners;
 };
 
 } // End namespace orc.
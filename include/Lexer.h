@@ -2,6 +2,8 @@
 #ifndef YORKIE_LEXER_H
 #define YORKIE_LEXER_H
 
+#include <cstdint>
+#include <functional>
 #include <string>
 
 //===============================================
@@ -43,6 +45,18 @@ enum Token {
 
     // end keyword
     tok_end = -14,
+
+    // parallel for loops
+    tok_parfor = -15,
+
+    // array length
+    tok_len = -16,
+
+    // two character comparison operators
+    tok_eq = -17,   // ==
+    tok_ne = -18,   // !=
+    tok_le = -19,   // <=
+    tok_ge = -20,   // >=
 };
 
 // Source Location Information
@@ -51,16 +65,25 @@ struct SourceLocation {
     int Col;
 };
 
+// Refill - Appends more source to its argument, returns false at the end of
+// the input.
+typedef std::function<bool(std::string &)> RefillFn;
+
 class Lexer {
     std::string SourceString;               // Contains the source.
-    std::string::iterator SourceIterator;   // Source iterator
+    size_t SourcePos = 0;                   // Position of the next character in SourceString
+    RefillFn Refill;                        // Reads more source once SourceString is used up, if set
     SourceLocation LexLoc = {1, 0};         // Lexer source location
+    int LastChar = ' ';                     // Last character read, not yet part of a token
     std::string IdentifierStr;              // Filled in if tok_identifier
     double NumVal;                          // Filled in if tok_number
     // CurTok/getNextToken - Provide a simple token buffer. CurTok is the current
     // token the parser is looking at. getNextToken reads another token from the lexer
     // and updates CurTok with its results.
     int CurTok;
+    uint64_t TokenCount = 0;                // Number of tokens lexed
+    uint64_t LexNanos = 0;                  // Time spent lexing, if TimeLexing is set
+    bool TimeLexing = false;
 
     // Private methods
     int advance();
@@ -69,15 +92,19 @@ public:
 
     // Constructors
     Lexer() {}
-    Lexer(std::string source) : SourceString(source) {
-        SourceIterator = SourceString.begin();
-    }
+    Lexer(std::string source) : SourceString(source) {}
+    // Streams the source, a chunk at a time. Chunks are only read when the
+    // lexer needs their first character, so a prompt can be shown before each.
+    Lexer(RefillFn Refill) : Refill(std::move(Refill)) {}
 
     // Accessors for private member declarations
     SourceLocation getLexLoc() { return LexLoc; }
     std::string getIdentifierStr() { return IdentifierStr; }
     double getNumVal() { return NumVal; }
     int getCurTok() { return CurTok; }
+    uint64_t getTokenCount() { return TokenCount; }
+    uint64_t getLexNanos() { return LexNanos; }
+    void setTimeLexing(bool T) { TimeLexing = T; }
 
     // Public methods
     int gettok();           // Return the next token from standard input.
@@ -25,7 +25,7 @@ namespace Parser {
     // https://en.wikipedia.org/wiki/Operator-precedence_parser
 
     // BinopPrecendence - This holds the precendence for each binary operator that is defined.
-    static std::map<char, int> BinopPrecedence;
+    extern std::map<int, int> BinopPrecedence;
 
     std::unique_ptr<ExprAST> ParsePrimary(Lexer::Lexer &lexer);
     std::unique_ptr<ExprAST> ParseIndentifierExpr(Lexer::Lexer &lexer);
@@ -34,9 +34,10 @@ namespace Parser {
     std::unique_ptr<ExprAST> ParseIfExpr(Lexer::Lexer &lexer);
     std::unique_ptr<ExprAST> ParseForExpr(Lexer::Lexer &lexer);
     std::unique_ptr<ExprAST> ParseVarExpr(Lexer::Lexer &lexer);
+    std::unique_ptr<ExprAST> ParseLengthExpr(Lexer::Lexer &lexer);
     std::unique_ptr<ExprAST> ParseExpression(Lexer::Lexer &lexer);
     std::unique_ptr<ExprAST> ParseUnary(Lexer::Lexer &lexer);
-    std::unique_ptr<FunctionAST> ParseTopLevelExpr(Lexer::Lexer &lexer);
+    std::unique_ptr<FunctionAST> ParseTopLevelExpr(Lexer::Lexer &lexer, const std::string &Name = "main");
     std::unique_ptr<PrototypeAST> ParseExtern(Lexer::Lexer &lexer);
     std::unique_ptr<FunctionAST> ParseDefinition(Lexer::Lexer &lexer);
     std::unique_ptr<PrototypeAST> ParsePrototype(Lexer::Lexer &lexer);
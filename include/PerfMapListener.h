@@ -0,0 +1,37 @@
+#ifndef YORKIE_PERFMAPLISTENER_H
+#define YORKIE_PERFMAPLISTENER_H
+
+#include <cstdio>
+#include "llvm/ExecutionEngine/JITEventListener.h"
+
+//===============================================
+// PerfMapListener.h
+//
+// JIT event listener that writes /tmp/perf-<pid>.map, so perf and other
+// sampling profilers can attribute samples in JIT compiled code to yorkie
+// functions.
+//
+// perf map files only hold "<start> <size> <name>" lines, so the source
+// location of each function (from the DWARF emitted through KSDbgInfo) is
+// appended to its name, e.g. "fib [fib.yk:1]".
+//
+//===============================================
+
+namespace Profiling {
+
+class PerfMapListener : public llvm::JITEventListener {
+    FILE *MapFile;
+
+public:
+
+    // Constructors
+    PerfMapListener();
+    ~PerfMapListener() override;
+
+    void NotifyObjectEmitted(const llvm::object::ObjectFile &Obj,
+                             const llvm::RuntimeDyld::LoadedObjectInfo &L) override;
+};
+
+}
+
+#endif /* end of include guard:  */
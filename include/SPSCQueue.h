@@ -0,0 +1,70 @@
+#ifndef YORKIE_SPSCQUEUE_H
+#define YORKIE_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//===============================================
+// SPSCQueue.h
+//
+// Bounded lock-free queue between one producer thread and one consumer
+// thread, used to hand parsed definitions from the parser to code generation
+// (see -pipeline).
+//
+// Head and Tail count every push and pop, so the queue is full when they are
+// Capacity apart and empty when they are equal. Each is written by one thread
+// only, and the release/acquire pair on it publishes the slot it covers.
+// A thread that has to wait yields.
+//
+//===============================================
+
+namespace Pipeline {
+
+template <typename T> class SPSCQueue {
+    std::vector<T> Slots;
+    alignas(64) std::atomic<size_t> Head;   // Next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> Tail;   // Next slot to push, written by the producer
+
+public:
+
+    // Constructors
+    explicit SPSCQueue(size_t Capacity) : Slots(Capacity), Head(0), Tail(0) {}
+    SPSCQueue(const SPSCQueue &) = delete;
+    SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+    // Producer side. tryPush() leaves V alone if the queue is full.
+    bool tryPush(T &V) {
+        size_t Pos = Tail.load(std::memory_order_relaxed);
+        if (Pos - Head.load(std::memory_order_acquire) == Slots.size())
+            return false;
+        Slots[Pos % Slots.size()] = std::move(V);
+        Tail.store(Pos + 1, std::memory_order_release);
+        return true;
+    }
+    void push(T V) {
+        while (!tryPush(V))
+            std::this_thread::yield();
+    }
+
+    // Consumer side.
+    bool tryPop(T &V) {
+        size_t Pos = Head.load(std::memory_order_relaxed);
+        if (Pos == Tail.load(std::memory_order_acquire))
+            return false;
+        V = std::move(Slots[Pos % Slots.size()]);
+        Head.store(Pos + 1, std::memory_order_release);
+        return true;
+    }
+    T pop() {
+        T V;
+        while (!tryPop(V))
+            std::this_thread::yield();
+        return V;
+    }
+};
+
+}
+
+#endif /* end of include guard:  */
@@ -0,0 +1,100 @@
+#ifndef YORKIE_TIMEREPORT_H
+#define YORKIE_TIMEREPORT_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+//===============================================
+// TimeReport.h
+//
+// Per-phase compile time and memory report (-time-report).
+//
+// Phases form a tree: a phase started while another one is running becomes
+// its child, and entering the same phase again accumulates into the same node.
+// Each phase records its total time, how often it was entered and the peak RSS
+// of the process when it last ended. Counters (tokens lexed, AST nodes, ...)
+// are kept alongside. The report prints as a table or as JSON.
+//
+//===============================================
+
+namespace Stats {
+
+// Phase - A node in the tree of compiler phases.
+struct Phase {
+    std::string Name;
+    uint64_t Nanos = 0;     // Total time spent in the phase
+    uint64_t Count = 0;     // Number of times the phase was entered
+    uint64_t PeakRSS = 0;   // Peak RSS of the process (KB) when the phase last ended
+    std::vector<std::unique_ptr<Phase>> Children;
+
+    Phase(llvm::StringRef Name) : Name(Name) {}
+    Phase *getChild(llvm::StringRef Name);
+    uint64_t getChildNanos() const;
+};
+
+class TimeReport {
+    typedef std::chrono::steady_clock Clock;
+
+    bool Enabled = false;
+    Phase Root;
+    std::vector<std::pair<Phase *, Clock::time_point>> Stack; // Running phases, innermost last
+    std::vector<std::pair<std::string, uint64_t>> Counters;   // In the order they were added
+
+    void printPhase(llvm::raw_ostream &OS, const Phase &P, uint64_t Total, unsigned Depth) const;
+    void printPhaseJSON(llvm::raw_ostream &OS, const Phase &P, unsigned Depth) const;
+
+public:
+
+    // Constructors
+    TimeReport() : Root("total") {}
+
+    // Accessors
+    void setEnabled(bool E) { Enabled = E; }
+    bool isEnabled() const { return Enabled; }
+
+    // Phases
+    void startPhase(llvm::StringRef Name);
+    void stopPhase();
+    // Adds time measured elsewhere (e.g. by the lexer) to the phase at Path.
+    void addPhaseTime(llvm::ArrayRef<llvm::StringRef> Path, uint64_t Nanos, uint64_t Count);
+
+    // Counters
+    void addCounter(llvm::StringRef Name, uint64_t Value);
+    void setCounter(llvm::StringRef Name, uint64_t Value);
+
+    // Output
+    void print(llvm::raw_ostream &OS) const;
+    void printJSON(llvm::raw_ostream &OS) const;
+
+    // Peak resident set size of the process, in KB.
+    static uint64_t getPeakRSS();
+};
+
+// TimeRegion - Times the enclosing scope as a phase of the report. Does
+// nothing if the report is disabled.
+class TimeRegion {
+    TimeReport &Report;
+    bool Active;
+
+public:
+    TimeRegion(TimeReport &Report, llvm::StringRef Name)
+        : Report(Report), Active(Report.isEnabled()) {
+        if (Active)
+            Report.startPhase(Name);
+    }
+    ~TimeRegion() {
+        if (Active)
+            Report.stopPhase();
+    }
+};
+
+}
+
+#endif /* end of include guard:  */
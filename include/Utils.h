@@ -21,4 +21,7 @@ std::unique_ptr<FunctionAST> ErrorF(const char *Str, Lexer::Lexer &lexer);
 std::unique_ptr<ExprAST> Error(const char *Str);
 llvm::Value *ErrorV(const char *Str);
 
+// Number of errors reported so far.
+unsigned getErrorCount();
+
 #endif
@@ -0,0 +1,117 @@
+#ifndef YORKIE_YORKIE_H
+#define YORKIE_YORKIE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+//===============================================
+// Yorkie.h
+//
+// The yorkie compiler as a library (libyorkie).
+//
+// A Context compiles yorkie source held in memory into one module, which can
+// then be printed as IR or JIT compiled and called in-process:
+//
+//   Yorkie::Context Ctx("<input>", Yorkie::CodeTarget::JIT);
+//   if (!Ctx.compile("def sq(x) x*x end"))
+//       return;
+//   auto *Sq = Ctx.getFunction<double(double)>("sq");
+//   double Nine = Sq(3);
+//
+// The compiler is configured with the yorkie command line options (see
+// yorkie -help), set with parseOptions() before a Context is created.
+//
+// The compiler's state is global, so only one Context can exist at a time
+// (creating a second one is a fatal error), and functions it returned can't
+// be called once it is destroyed.
+//
+//===============================================
+
+namespace Yorkie {
+
+// The category of the compiler options, tools can add their own to it.
+llvm::cl::OptionCategory &getOptionCategory();
+
+// Sets the compiler options from a command line, Argv[0] being the program
+// name. Returns false if the options can't be used together, which is
+// reported on stderr. Options LLVM's parser can't parse at all still exit the
+// process, as they do in the tool.
+bool parseOptions(int Argc, const char *const *Argv, const char *Overview = "");
+
+// What a Context's module is compiled for. This decides the CPU the code is
+// tuned for and the width of vec() vectors (see -mcpu), so it's fixed before
+// anything is compiled.
+enum class CodeTarget {
+    PrintedIR,  // The target's generic CPU, unless -mcpu or -mattr is given
+    JIT         // The host's CPU, or -mcpu
+};
+
+class Context {
+    bool Valid = true;
+    bool Finalized = false;
+    bool JITCompiled = false;
+
+public:
+
+    // Constructors
+    // Filename is the source file named in the debug info (see -g).
+    explicit Context(llvm::StringRef Filename = "<stdin>",
+                     CodeTarget Target = CodeTarget::PrintedIR);
+    ~Context();
+    Context(const Context &) = delete;
+    Context &operator=(const Context &) = delete;
+
+    // False if the options couldn't be acted on: the -profile-use file can't
+    // be read or the -stream-dir directory can't be created. The error is
+    // reported on stderr, and nothing can be compiled with the Context.
+    bool isValid() const { return Valid; }
+
+    // Compiles definitions, externs and top level expressions into the module.
+    // Later sources can use the functions of earlier ones. Returns false if
+    // there were errors, which are reported on stderr.
+    bool compile(llvm::StringRef Source);
+
+    // The same for source read a chunk at a time: Read appends the next chunk
+    // to its argument, or returns false at the end of the input. Chunks are
+    // freed once they are lexed.
+    bool compileStream(std::function<bool(std::string &)> Read);
+
+    // Runs an interactive session: Read appends the next chunk of source (a
+    // line, say) to its argument, or returns false at the end of the input.
+    // Definitions are JIT compiled when the first expression after them is
+    // entered, and every top level expression is run at once, its value passed
+    // to Print. Nothing can be compiled or printed afterwards, but the functions
+    // defined stay available through getFunctionAddress(). The session is
+    // compiled for the JIT whatever the Context's CodeTarget.
+    void runInteractive(std::function<bool(std::string &)> Read,
+                        std::function<void(double)> Print);
+
+    // Links the runtimes in, finalizes debug info and optimizes the module.
+    // Nothing can be compiled afterwards.
+    bool finalize();
+
+    // Prints the IR of the module, finalizing it first. With -stream-dir the
+    // IR was written there instead, and nothing is printed.
+    void printIR(llvm::raw_ostream &OS);
+
+    // JIT compiles the module, finalizing it first, and returns the address of
+    // the function Name or 0 if there isn't one. After this the module can't
+    // be printed anymore. A module compiled for CodeTarget::PrintedIR runs
+    // too, but isn't tuned for the host.
+    uint64_t getFunctionAddress(llvm::StringRef Name);
+    template <typename FnT> FnT *getFunction(llvm::StringRef Name) {
+        return reinterpret_cast<FnT *>(static_cast<uintptr_t>(getFunctionAddress(Name)));
+    }
+
+    // Prints the -time-report table and writes the -time-report-json file,
+    // if they were asked for.
+    void printTimeReport();
+};
+
+}
+
+#endif /* end of include guard:  */
@@ -0,0 +1,463 @@
+#include "Evaluator.h"
+#include <cmath>
+
+using llvm::Optional;
+using llvm::None;
+
+namespace Eval {
+
+// =============================================================================
+// Interpreter
+// =============================================================================
+
+bool Interpreter::step() {
+    if (StepsLeft == 0)
+        return false;
+    --StepsLeft;
+    return true;
+}
+
+// Frames only hold a handful of variables, so a linear scan beats a map here.
+Optional<double> Interpreter::getVariable(const std::string &Name) const {
+    for (auto &V : NamedValues)
+        if (V.first == Name)
+            return V.second;
+    return None;
+}
+
+void Interpreter::setVariable(const std::string &Name, double Val) {
+    for (auto &V : NamedValues) {
+        if (V.first == Name) {
+            V.second = Val;
+            return;
+        }
+    }
+    NamedValues.push_back(std::make_pair(Name, Val));
+}
+
+void Interpreter::eraseVariable(const std::string &Name) {
+    for (auto V = NamedValues.begin(), E = NamedValues.end(); V != E; ++V) {
+        if (V->first == Name) {
+            NamedValues.erase(V);
+            return;
+        }
+    }
+}
+
+// Calls get a fresh frame holding only their arguments, the same as a call
+// in the generated code. The caller's frame is restored afterwards.
+Optional<double> Interpreter::call(const std::string &Name, llvm::ArrayRef<double> Args) {
+    auto DI = Definitions.find(Name);
+    if (DI == Definitions.end())
+        return None;
+
+    // Arrays are never constant, so neither are functions taking them.
+    const FunctionAST &Def = *DI->second;
+    const std::vector<std::string> &ArgNames = Def.getProto().getArgs();
+    if (ArgNames.size() != Args.size() || Def.getProto().hasArrayArgs() || CallDepth >= MaxCallDepth)
+        return None;
+
+    std::vector<std::pair<std::string, double>> Frame;
+    Frame.reserve(ArgNames.size());
+    for (unsigned i = 0, e = Args.size(); i != e; ++i)
+        Frame.push_back(std::make_pair(ArgNames[i], Args[i]));
+
+    std::swap(NamedValues, Frame);
+    ++CallDepth;
+
+    Optional<double> RetVal;
+    for (auto &E : Def.getBody()) {
+        RetVal = E->evaluate(*this);
+        if (!RetVal)
+            break;
+    }
+
+    --CallDepth;
+    std::swap(NamedValues, Frame);
+    return RetVal;
+}
+
+// Folding happens outside of any call frame, so any reference to a variable
+// fails and only closed expressions are evaluated.
+Optional<double> Interpreter::evaluateConstant(ExprAST &E) {
+    if (Budget == 0)
+        return None;
+
+    StepsLeft = Budget;
+    CallDepth = 0;
+    NamedValues.clear();
+    Optional<double> Val = E.evaluate(*this);
+    NamedValues.clear();
+    return Val;
+}
+
+void Interpreter::fold(std::unique_ptr<ExprAST> &E) {
+    if (Budget == 0 || !E)
+        return;
+    if (auto Folded = E->foldConstants(*this))
+        E = std::move(Folded);
+}
+
+void Interpreter::fold(FunctionAST &F) {
+    if (Budget == 0)
+        return;
+    F.foldConstants(*this);
+}
+
+} // Namespace
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+// Every node costs one step, so loops and recursion are bounded by the budget.
+// The semantics here must stay in sync with the matching codegen() methods.
+
+Optional<double> NumberExprAST::evaluate(Eval::Interpreter &I) {
+    if (!I.step())
+        return None;
+    return Val;
+}
+
+Optional<double> VariableExprAST::evaluate(Eval::Interpreter &I) {
+    if (!I.step())
+        return None;
+    return I.getVariable(Name);
+}
+
+Optional<double> BinaryExprAST::evaluate(Eval::Interpreter &I) {
+    if (!I.step())
+        return None;
+
+    // Special case '=' because we don't want to evaluate the LHS as an expression
+    if (Op == '=') {
+        VariableExprAST *LHSE = llvm::dyn_cast<VariableExprAST>(LHS.get());
+        if (!LHSE)
+            return None;
+        Optional<double> Val = RHS->evaluate(I);
+        if (!Val || !I.getVariable(LHSE->getName()))
+            return None;
+        I.setVariable(LHSE->getName(), *Val);
+        return Val;
+    }
+
+    Optional<double> L = LHS->evaluate(I);
+    if (!L)
+        return None;
+
+    // '&' and '|' only evaluate RHS if LHS doesn't decide the result.
+    if (isShortCircuit(Op)) {
+        bool LTrue = *L < 0.0 || *L > 0.0;
+        if (LTrue == (Op == '|'))
+            return LTrue ? 1.0 : 0.0;
+        Optional<double> R = RHS->evaluate(I);
+        if (!R)
+            return None;
+        return *R < 0.0 || *R > 0.0 ? 1.0 : 0.0;
+    }
+
+    Optional<double> R = RHS->evaluate(I);
+    if (!R)
+        return None;
+
+    // The comparisons match codegen's fcmp: unordered (true if either operand
+    // is a NaN) except '=='.
+    switch (Op) {
+    case '+':
+        return *L + *R;
+    case '-':
+        return *L - *R;
+    case '*':
+        return *L * *R;
+    case '/':
+        return *L / *R;
+    case '%':
+        return std::fmod(*L, *R);
+    case '<':
+        return !(*L >= *R) ? 1.0 : 0.0;
+    case '>':
+        return !(*L <= *R) ? 1.0 : 0.0;
+    case Lexer::tok_le:
+        return !(*L > *R) ? 1.0 : 0.0;
+    case Lexer::tok_ge:
+        return !(*L < *R) ? 1.0 : 0.0;
+    case Lexer::tok_eq:
+        return *L == *R ? 1.0 : 0.0;
+    case Lexer::tok_ne:
+        return *L != *R ? 1.0 : 0.0;
+    default:
+        break;
+    }
+
+    // User defined binary operator.
+    double Ops[2] = { *L, *R };
+    return I.call(std::string("binary") + (char)Op, Ops);
+}
+
+Optional<double> CallExprAST::evaluate(Eval::Interpreter &I) {
+    if (!I.step())
+        return None;
+
+    std::vector<double> ArgsV;
+    for (auto &Arg : Args) {
+        Optional<double> V = Arg->evaluate(I);
+        if (!V)
+            return None;
+        ArgsV.push_back(*V);
+    }
+    return I.call(Callee, ArgsV);
+}
+
+// The condition is true if it compares ordered and not equal to 0.0 (fcmp one).
+Optional<double> IfExprAST::evaluate(Eval::Interpreter &I) {
+    if (!I.step())
+        return None;
+
+    Optional<double> CondV = Cond->evaluate(I);
+    if (!CondV)
+        return None;
+
+    if (*CondV < 0.0 || *CondV > 0.0)
+        return Then->evaluate(I);
+    return Else->evaluate(I);
+}
+
+// Matches the loop emitted by ForExprAST::codegen(): the body always runs at
+// least once, and the end condition is computed before the variable is stepped.
+Optional<double> ForExprAST::evaluate(Eval::Interpreter &I) {
+    if (!I.step())
+        return None;
+    if (Parallel)
+        return evaluateParallel(I);
+
+    Optional<double> StartVal = Start->evaluate(I);
+    if (!StartVal)
+        return None;
+
+    Optional<double> OldVal = I.getVariable(VarName);
+    I.setVariable(VarName, *StartVal);
+
+    while (1) {
+        if (!Body->evaluate(I))
+            return None;
+
+        Optional<double> StepVal = 1.0;
+        if (Step) {
+            StepVal = Step->evaluate(I);
+            if (!StepVal)
+                return None;
+        }
+
+        Optional<double> EndCond = End->evaluate(I);
+        if (!EndCond)
+            return None;
+
+        Optional<double> CurVar = I.getVariable(VarName);
+        if (!CurVar)
+            return None;
+        I.setVariable(VarName, *CurVar + *StepVal);
+
+        if (!(*EndCond < 0.0 || *EndCond > 0.0))
+            break;
+    }
+
+    // Restore the unshadowed variable
+    if (OldVal)
+        I.setVariable(VarName, *OldVal);
+    else
+        I.eraseVariable(VarName);
+
+    return 0.0;
+}
+
+// The default chunks of __yorkie_parfor in lib/parallel.cpp: iterations per
+// chunk for a loop of N iterations.
+static double getParForChunkSize(double N) {
+    const double ParForChunks = 2048;
+    return std::ceil(N / ParForChunks);
+}
+
+// Reduces two iteration or chunk values with the loop's operator.
+static Optional<double> reduce(Eval::Interpreter &I, char ReduceOp, double L, double R) {
+    if (ReduceOp == '+')
+        return L + R;
+    if (ReduceOp == '*')
+        return L * R;
+    double Ops[2] = { L, R };
+    return I.call(std::string("binary") + ReduceOp, Ops);
+}
+
+// Matches the loop emitted by ForExprAST::codegenParallel() and run by the
+// runtime: every iteration starts from the variables as they were before the
+// loop, the values of each chunk's iterations are reduced in order, then the
+// values of the chunks are, so sums round the same way as at run time.
+Optional<double> ForExprAST::evaluateParallel(Eval::Interpreter &I) {
+    Optional<double> StartVal = Start->evaluate(I);
+    if (!StartVal)
+        return None;
+    Optional<double> Limit = End->evaluate(I);
+    if (!Limit)
+        return None;
+    Optional<double> StepVal = 1.0;
+    if (Step) {
+        StepVal = Step->evaluate(I);
+        if (!StepVal)
+            return None;
+    }
+
+    double Count = std::ceil((*Limit - *StartVal) / *StepVal);
+    if (!(Count > 0))
+        return getReduceIdentity(ReduceOp);
+
+    std::vector<std::pair<std::string, double>> Saved = I.saveVariables();
+    double ChunkSize = getParForChunkSize(Count);
+    Optional<double> Result, ChunkResult;
+    for (double K = 0; K < Count; ++K) {
+        I.setVariable(VarName, *StartVal + K * *StepVal);
+        Optional<double> Val = Body->evaluate(I);
+        I.restoreVariables(Saved);
+        if (!Val)
+            return None;
+
+        ChunkResult = ChunkResult ? reduce(I, ReduceOp, *ChunkResult, *Val) : Val;
+        if (!ChunkResult)
+            return None;
+
+        // End of a chunk, or of the loop.
+        if (std::fmod(K + 1, ChunkSize) == 0 || K + 1 >= Count) {
+            Result = Result ? reduce(I, ReduceOp, *Result, *ChunkResult) : ChunkResult;
+            if (!Result)
+                return None;
+            ChunkResult = None;
+        }
+    }
+    return Result;
+}
+
+Optional<double> UnaryExprAST::evaluate(Eval::Interpreter &I) {
+    if (!I.step())
+        return None;
+
+    Optional<double> OperandV = Operand->evaluate(I);
+    if (!OperandV)
+        return None;
+
+    double Ops[1] = { *OperandV };
+    return I.call(std::string("unary") + Opcode, Ops);
+}
+
+// Arrays only exist at run time.
+Optional<double> ArrayAllocExprAST::evaluate(Eval::Interpreter &I) {
+    return None;
+}
+
+Optional<double> IndexExprAST::evaluate(Eval::Interpreter &I) {
+    return None;
+}
+
+Optional<double> LengthExprAST::evaluate(Eval::Interpreter &I) {
+    return None;
+}
+
+Optional<double> VarExprAST::evaluate(Eval::Interpreter &I) {
+    if (!I.step())
+        return None;
+
+    std::vector<Optional<double>> OldBindings;
+
+    // Emit the initializer before adding the variable to scope, same as codegen.
+    for (auto &Var : VarNames) {
+        Optional<double> InitVal = 0.0;
+        if (Var.second) {
+            InitVal = Var.second->evaluate(I);
+            if (!InitVal)
+                return None;
+        }
+
+        OldBindings.push_back(I.getVariable(Var.first));
+        I.setVariable(Var.first, *InitVal);
+    }
+
+    Optional<double> BodyVal = Body->evaluate(I);
+    if (!BodyVal)
+        return None;
+
+    // Pop all our variables from scope.
+    for (unsigned i = 0, e = VarNames.size(); i != e; ++i) {
+        if (OldBindings[i])
+            I.setVariable(VarNames[i].first, *OldBindings[i]);
+        else
+            I.eraseVariable(VarNames[i].first);
+    }
+
+    return BodyVal;
+}
+
+// =============================================================================
+// Folding
+// =============================================================================
+
+std::unique_ptr<ExprAST> BinaryExprAST::foldConstants(Eval::Interpreter &I) {
+    I.fold(LHS);
+    I.fold(RHS);
+    return nullptr;
+}
+
+// Calls are the only nodes replaced outright, everything else LLVM already
+// folds once its operands are constants.
+std::unique_ptr<ExprAST> CallExprAST::foldConstants(Eval::Interpreter &I) {
+    for (auto &Arg : Args)
+        I.fold(Arg);
+
+    if (Optional<double> Val = I.evaluateConstant(*this))
+        return llvm::make_unique<NumberExprAST>(getLoc(), *Val);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> IfExprAST::foldConstants(Eval::Interpreter &I) {
+    I.fold(Cond);
+    I.fold(Then);
+    I.fold(Else);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> ForExprAST::foldConstants(Eval::Interpreter &I) {
+    I.fold(Start);
+    I.fold(End);
+    I.fold(Step);
+    I.fold(Body);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> UnaryExprAST::foldConstants(Eval::Interpreter &I) {
+    I.fold(Operand);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> VarExprAST::foldConstants(Eval::Interpreter &I) {
+    for (auto &Var : VarNames)
+        I.fold(Var.second);
+    I.fold(Body);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> ArrayAllocExprAST::foldConstants(Eval::Interpreter &I) {
+    I.fold(Length);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> IndexExprAST::foldConstants(Eval::Interpreter &I) {
+    I.fold(Array);
+    I.fold(Index);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> LengthExprAST::foldConstants(Eval::Interpreter &I) {
+    I.fold(Array);
+    return nullptr;
+}
+
+void FunctionAST::foldConstants(Eval::Interpreter &I) {
+    for (auto &E : *Body)
+        I.fold(E);
+}
@@ -0,0 +1,390 @@
+#include "Inliner.h"
+
+namespace Inline {
+
+// =============================================================================
+// Inliner
+// =============================================================================
+
+bool Inliner::isCandidate(const FunctionAST &F) const {
+    auto &Body = F.getBody();
+    if (Body.size() != 1 || Body[0]->getSize() > Threshold)
+        return false;
+
+    std::vector<std::string> Callees;
+    Body[0]->collectCalls(Callees);
+    return Callees.empty();
+}
+
+std::unique_ptr<ExprAST> Inliner::inlineCall(Lexer::SourceLocation Loc, const std::string &Callee,
+        std::vector<std::unique_ptr<ExprAST>> &Args) {
+    auto DI = Definitions.find(Callee);
+    if (DI == Definitions.end() || !isCandidate(*DI->second))
+        return nullptr;
+
+    // The inlined body would get the caller's fast-math flags.
+    const FunctionAST &Def = *DI->second;
+    if (Def.getProto().isFastMath() != CallerFastMath)
+        return nullptr;
+
+    const std::vector<std::string> &ArgNames = Def.getProto().getArgs();
+    if (ArgNames.size() != Args.size())
+        return nullptr;
+
+    // Bind each argument to a renamed copy of its parameter.
+    RenameMap Renames;
+    std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> VarNames;
+    for (unsigned i = 0, e = Args.size(); i != e; ++i) {
+        std::string Name = Callee + "." + ArgNames[i];
+        Renames[ArgNames[i]] = Name;
+        VarNames.push_back(std::make_pair(Name, std::move(Args[i])));
+    }
+
+    return llvm::make_unique<VarExprAST>(Loc, std::move(VarNames), Def.getBody()[0]->clone(Renames));
+}
+
+void Inliner::inlineCalls(std::unique_ptr<ExprAST> &E) {
+    if (!E)
+        return;
+    if (auto Inlined = E->inlineCalls(*this))
+        E = std::move(Inlined);
+}
+
+void Inliner::inlineCalls(FunctionAST &F) {
+    CallerFastMath = F.getProto().isFastMath();
+    F.inlineCalls(*this);
+}
+
+} // Namespace
+
+// =============================================================================
+// Cloning
+// =============================================================================
+
+// Returns the name Name is renamed to, or Name itself.
+static std::string rename(const RenameMap &Renames, const std::string &Name) {
+    auto R = Renames.find(Name);
+    return R == Renames.end() ? Name : R->second;
+}
+
+// Clones E, null if E is null (e.g. a for loop without a step).
+static std::unique_ptr<ExprAST> cloneOrNull(const std::unique_ptr<ExprAST> &E, const RenameMap &Renames) {
+    return E ? E->clone(Renames) : nullptr;
+}
+
+std::unique_ptr<ExprAST> NumberExprAST::clone(const RenameMap &Renames) const {
+    return llvm::make_unique<NumberExprAST>(getLoc(), Val);
+}
+
+std::unique_ptr<ExprAST> VariableExprAST::clone(const RenameMap &Renames) const {
+    return llvm::make_unique<VariableExprAST>(getLoc(), rename(Renames, Name));
+}
+
+// Variables declared here shadow any renamed variable of the same name, both in
+// the later initializers and in the body.
+std::unique_ptr<ExprAST> VarExprAST::clone(const RenameMap &Renames) const {
+    RenameMap Scope = Renames;
+    std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> NewVarNames;
+    for (auto &Var : VarNames) {
+        NewVarNames.push_back(std::make_pair(Var.first, cloneOrNull(Var.second, Scope)));
+        Scope.erase(Var.first);
+    }
+    return llvm::make_unique<VarExprAST>(getLoc(), std::move(NewVarNames), Body->clone(Scope));
+}
+
+std::unique_ptr<ExprAST> BinaryExprAST::clone(const RenameMap &Renames) const {
+    return llvm::make_unique<BinaryExprAST>(getLoc(), Op, LHS->clone(Renames), RHS->clone(Renames));
+}
+
+std::unique_ptr<ExprAST> CallExprAST::clone(const RenameMap &Renames) const {
+    std::vector<std::unique_ptr<ExprAST>> NewArgs;
+    for (auto &Arg : Args)
+        NewArgs.push_back(Arg->clone(Renames));
+    return llvm::make_unique<CallExprAST>(getLoc(), Callee, std::move(NewArgs));
+}
+
+std::unique_ptr<ExprAST> IfExprAST::clone(const RenameMap &Renames) const {
+    return llvm::make_unique<IfExprAST>(getLoc(), Cond->clone(Renames), Then->clone(Renames),
+            Else->clone(Renames));
+}
+
+// The loop variable is in scope for everything except the start value, or
+// only in the body of a parallel loop.
+std::unique_ptr<ExprAST> ForExprAST::clone(const RenameMap &Renames) const {
+    RenameMap Scope = Renames;
+    Scope.erase(VarName);
+    const RenameMap &HeaderScope = Parallel ? Renames : Scope;
+    return llvm::make_unique<ForExprAST>(getLoc(), VarName, Start->clone(Renames),
+            End->clone(HeaderScope), cloneOrNull(Step, HeaderScope), Body->clone(Scope),
+            Parallel, ReduceOp);
+}
+
+std::unique_ptr<ExprAST> UnaryExprAST::clone(const RenameMap &Renames) const {
+    return llvm::make_unique<UnaryExprAST>(getLoc(), Opcode, Operand->clone(Renames));
+}
+
+std::unique_ptr<ExprAST> ArrayAllocExprAST::clone(const RenameMap &Renames) const {
+    return llvm::make_unique<ArrayAllocExprAST>(getLoc(), Length->clone(Renames));
+}
+
+std::unique_ptr<ExprAST> IndexExprAST::clone(const RenameMap &Renames) const {
+    return llvm::make_unique<IndexExprAST>(getLoc(), Array->clone(Renames), Index->clone(Renames));
+}
+
+std::unique_ptr<ExprAST> LengthExprAST::clone(const RenameMap &Renames) const {
+    return llvm::make_unique<LengthExprAST>(getLoc(), Array->clone(Renames));
+}
+
+// =============================================================================
+// Inlining
+// =============================================================================
+
+std::unique_ptr<ExprAST> VarExprAST::inlineCalls(Inline::Inliner &In) {
+    for (auto &Var : VarNames)
+        In.inlineCalls(Var.second);
+    In.inlineCalls(Body);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> BinaryExprAST::inlineCalls(Inline::Inliner &In) {
+    In.inlineCalls(LHS);
+    In.inlineCalls(RHS);
+    if (isBuiltin(Op))
+        return nullptr;
+
+    std::vector<std::unique_ptr<ExprAST>> Ops;
+    Ops.push_back(std::move(LHS));
+    Ops.push_back(std::move(RHS));
+    if (auto Inlined = In.inlineCall(getLoc(), std::string("binary") + (char)Op, Ops))
+        return Inlined;
+
+    LHS = std::move(Ops[0]);
+    RHS = std::move(Ops[1]);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> CallExprAST::inlineCalls(Inline::Inliner &In) {
+    for (auto &Arg : Args)
+        In.inlineCalls(Arg);
+    return In.inlineCall(getLoc(), Callee, Args);
+}
+
+std::unique_ptr<ExprAST> IfExprAST::inlineCalls(Inline::Inliner &In) {
+    In.inlineCalls(Cond);
+    In.inlineCalls(Then);
+    In.inlineCalls(Else);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> ForExprAST::inlineCalls(Inline::Inliner &In) {
+    In.inlineCalls(Start);
+    In.inlineCalls(End);
+    In.inlineCalls(Step);
+    In.inlineCalls(Body);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> UnaryExprAST::inlineCalls(Inline::Inliner &In) {
+    In.inlineCalls(Operand);
+
+    std::vector<std::unique_ptr<ExprAST>> Ops;
+    Ops.push_back(std::move(Operand));
+    if (auto Inlined = In.inlineCall(getLoc(), std::string("unary") + Opcode, Ops))
+        return Inlined;
+
+    Operand = std::move(Ops[0]);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> ArrayAllocExprAST::inlineCalls(Inline::Inliner &In) {
+    In.inlineCalls(Length);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> IndexExprAST::inlineCalls(Inline::Inliner &In) {
+    In.inlineCalls(Array);
+    In.inlineCalls(Index);
+    return nullptr;
+}
+
+std::unique_ptr<ExprAST> LengthExprAST::inlineCalls(Inline::Inliner &In) {
+    In.inlineCalls(Array);
+    return nullptr;
+}
+
+void FunctionAST::inlineCalls(Inline::Inliner &In) {
+    for (auto &E : *Body)
+        In.inlineCalls(E);
+}
+
+// =============================================================================
+// Analysis
+// =============================================================================
+
+void VarExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    for (auto &Var : VarNames)
+        if (Var.second)
+            Var.second->collectCalls(Callees);
+    Body->collectCalls(Callees);
+}
+
+void BinaryExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    LHS->collectCalls(Callees);
+    RHS->collectCalls(Callees);
+    if (!isBuiltin(Op))
+        Callees.push_back(std::string("binary") + (char)Op);
+}
+
+void CallExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    for (auto &Arg : Args)
+        Arg->collectCalls(Callees);
+    Callees.push_back(Callee);
+}
+
+void IfExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    Cond->collectCalls(Callees);
+    Then->collectCalls(Callees);
+    Else->collectCalls(Callees);
+}
+
+void ForExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    Start->collectCalls(Callees);
+    End->collectCalls(Callees);
+    if (Step)
+        Step->collectCalls(Callees);
+    Body->collectCalls(Callees);
+    if (Parallel && !BinaryExprAST::isBuiltin(ReduceOp))
+        Callees.push_back(std::string("binary") + ReduceOp);
+}
+
+void UnaryExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    Operand->collectCalls(Callees);
+    Callees.push_back(std::string("unary") + Opcode);
+}
+
+unsigned VarExprAST::getSize() const {
+    unsigned Size = 1 + Body->getSize();
+    for (auto &Var : VarNames)
+        if (Var.second)
+            Size += Var.second->getSize();
+    return Size;
+}
+
+unsigned BinaryExprAST::getSize() const {
+    return 1 + LHS->getSize() + RHS->getSize();
+}
+
+unsigned CallExprAST::getSize() const {
+    unsigned Size = 1;
+    for (auto &Arg : Args)
+        Size += Arg->getSize();
+    return Size;
+}
+
+unsigned IfExprAST::getSize() const {
+    return 1 + Cond->getSize() + Then->getSize() + Else->getSize();
+}
+
+unsigned ForExprAST::getSize() const {
+    return 1 + Start->getSize() + End->getSize() + (Step ? Step->getSize() : 0) + Body->getSize();
+}
+
+unsigned UnaryExprAST::getSize() const {
+    return 1 + Operand->getSize();
+}
+
+void ArrayAllocExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    Length->collectCalls(Callees);
+}
+
+void IndexExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    Array->collectCalls(Callees);
+    Index->collectCalls(Callees);
+}
+
+void LengthExprAST::collectCalls(std::vector<std::string> &Callees) const {
+    Array->collectCalls(Callees);
+}
+
+unsigned ArrayAllocExprAST::getSize() const {
+    return 1 + Length->getSize();
+}
+
+unsigned IndexExprAST::getSize() const {
+    return 1 + Array->getSize() + Index->getSize();
+}
+
+unsigned LengthExprAST::getSize() const {
+    return 1 + Array->getSize();
+}
+
+void VarExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    for (auto &Var : VarNames)
+        if (Var.second)
+            Var.second->collectAssignments(Names);
+    Body->collectAssignments(Names);
+}
+
+// Assigning an array element doesn't assign a variable, isInvariant() never
+// trusts elements anyway.
+void BinaryExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    if (Op == '=')
+        if (auto *LHSE = llvm::dyn_cast<VariableExprAST>(LHS.get()))
+            Names.push_back(LHSE->getName());
+    LHS->collectAssignments(Names);
+    RHS->collectAssignments(Names);
+}
+
+void CallExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    for (auto &Arg : Args)
+        Arg->collectAssignments(Names);
+}
+
+void IfExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    Cond->collectAssignments(Names);
+    Then->collectAssignments(Names);
+    Else->collectAssignments(Names);
+}
+
+void ForExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    Start->collectAssignments(Names);
+    End->collectAssignments(Names);
+    if (Step)
+        Step->collectAssignments(Names);
+    Body->collectAssignments(Names);
+}
+
+void UnaryExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    Operand->collectAssignments(Names);
+}
+
+void ArrayAllocExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    Length->collectAssignments(Names);
+}
+
+void IndexExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    Array->collectAssignments(Names);
+    Index->collectAssignments(Names);
+}
+
+void LengthExprAST::collectAssignments(std::vector<std::string> &Names) const {
+    Array->collectAssignments(Names);
+}
+
+bool VariableExprAST::isInvariant(const std::set<std::string> &Assigned) const {
+    return !Assigned.count(Name);
+}
+
+// User defined operators are calls, which may have side effects.
+bool BinaryExprAST::isInvariant(const std::set<std::string> &Assigned) const {
+    return Op != '=' && isBuiltin(Op) && LHS->isInvariant(Assigned) && RHS->isInvariant(Assigned);
+}
+
+bool IfExprAST::isInvariant(const std::set<std::string> &Assigned) const {
+    return Cond->isInvariant(Assigned) && Then->isInvariant(Assigned) && Else->isInvariant(Assigned);
+}
+
+// An array's length never changes.
+bool LengthExprAST::isInvariant(const std::set<std::string> &Assigned) const {
+    return Array->isInvariant(Assigned);
+}
@@ -0,0 +1,192 @@
+#include "JITMemoryManager.h"
+#include "llvm/Support/Process.h"
+#include <algorithm>
+#include <iterator>
+
+using namespace llvm;
+
+namespace JIT {
+
+static uint8_t *alignPtr(uint8_t *P, unsigned Alignment) {
+    return (uint8_t *)(((uintptr_t)P + Alignment - 1) & ~(uintptr_t)(Alignment - 1));
+}
+
+// =============================================================================
+// MemoryPool
+// =============================================================================
+
+MemoryPool::MemoryPool(size_t SlabSize)
+    : PageSize(sys::Process::getPageSize()), SlabSize(SlabSize) {}
+
+MemoryPool::~MemoryPool() {
+    for (auto &Slab : Slabs)
+        sys::Memory::releaseMappedMemory(Slab);
+}
+
+// Adds a run to the free list, merging it with the runs on either side.
+void MemoryPool::addFreeRun(uint8_t *Base, size_t Size) {
+    auto Next = FreePages.lower_bound(Base);
+    if (Next != FreePages.end() && Base + Size == Next->first) {
+        Size += Next->second;
+        Next = FreePages.erase(Next);
+    }
+    if (Next != FreePages.begin()) {
+        auto Prev = std::prev(Next);
+        if (Prev->first + Prev->second == Base) {
+            Prev->second += Size;
+            return;
+        }
+    }
+    FreePages[Base] = Size;
+}
+
+// First fit from the free runs, or a new slab. Returns an empty block if the
+// memory can't be mapped.
+sys::MemoryBlock MemoryPool::allocatePages(size_t Size) {
+    Size = (std::max<size_t>(Size, 1) + PageSize - 1) / PageSize * PageSize;
+    for (auto I = FreePages.begin(), E = FreePages.end(); I != E; ++I) {
+        if (I->second < Size)
+            continue;
+        uint8_t *Base = I->first;
+        size_t Rest = I->second - Size;
+        FreePages.erase(I);
+        if (Rest)
+            FreePages[Base + Size] = Rest;
+        return sys::MemoryBlock(Base, Size);
+    }
+
+    // Map it near the last slab, like SectionMemoryManager: code and data of
+    // different slabs must stay within the +-2GB reach of PC relative
+    // relocations (x86-64 small code model).
+    std::error_code EC;
+    sys::MemoryBlock Slab = sys::Memory::allocateMappedMemory(
+            std::max(Size, SlabSize), Slabs.empty() ? nullptr : &Slabs.back(),
+            sys::Memory::MF_READ | sys::Memory::MF_WRITE, EC);
+    if (EC)
+        return sys::MemoryBlock();
+    Slabs.push_back(Slab);
+    MappedBytes += Slab.size();
+
+    uint8_t *Base = (uint8_t *)Slab.base();
+    if (Slab.size() > Size)
+        addFreeRun(Base + Size, Slab.size() - Size);
+    return sys::MemoryBlock(Base, Size);
+}
+
+void MemoryPool::releasePages(sys::MemoryBlock Block) {
+    sys::Memory::protectMappedMemory(Block, sys::Memory::MF_READ | sys::Memory::MF_WRITE);
+    addFreeRun((uint8_t *)Block.base(), Block.size());
+}
+
+uint8_t *MemoryPool::allocateData(size_t Size, unsigned Alignment) {
+    uint8_t *P = alignPtr(DataFree, Alignment);
+    if (!DataFree || P + Size > DataEnd) {
+        // Start a new run. The current one goes once nothing in it is used.
+        sys::MemoryBlock Block = allocatePages(Size + Alignment);
+        if (!Block.base())
+            return nullptr;
+        auto Current = DataRuns.find(CurrentRun);
+        if (Current != DataRuns.end() && Current->second.Live == 0) {
+            releasePages(Current->second.Block);
+            DataRuns.erase(Current);
+        }
+        CurrentRun = (uint8_t *)Block.base();
+        DataRuns[CurrentRun] = DataRun{ Block, 0 };
+        DataFree = CurrentRun;
+        DataEnd = CurrentRun + Block.size();
+        P = alignPtr(DataFree, Alignment);
+    }
+    DataFree = P + Size;
+    ++DataRuns[CurrentRun].Live;
+    return P;
+}
+
+void MemoryPool::releaseData(uint8_t *Ptr) {
+    auto I = std::prev(DataRuns.upper_bound(Ptr));
+    if (--I->second.Live == 0 && I->first != CurrentRun) {
+        releasePages(I->second.Block);
+        DataRuns.erase(I);
+    }
+}
+
+// =============================================================================
+// PooledMemoryManager
+// =============================================================================
+
+PooledMemoryManager::~PooledMemoryManager() {
+    for (auto &Block : TextBlocks)
+        Pool.releasePages(Block);
+    for (uint8_t *P : Data)
+        Pool.releaseData(P);
+}
+
+bool PooledMemoryManager::addTextBlock(size_t Size) {
+    sys::MemoryBlock Block = Pool.allocatePages(Size);
+    if (!Block.base())
+        return false;
+    TextBlocks.push_back(Block);
+    TextFree = (uint8_t *)Block.base();
+    TextEnd = TextFree + Block.size();
+    return true;
+}
+
+// Code comes first, then read-only data, each section aligned. Read/write
+// data comes from the pool's shared runs, nothing to reserve for it.
+void PooledMemoryManager::reserveAllocationSpace(uintptr_t CodeSize, uint32_t CodeAlign,
+                                                 uintptr_t RODataSize, uint32_t RODataAlign,
+                                                 uintptr_t /*RWDataSize*/, uint32_t /*RWDataAlign*/) {
+    if (CodeSize + RODataSize)
+        addTextBlock(CodeSize + CodeAlign + RODataSize + RODataAlign);
+}
+
+// Sections that weren't reserved (RuntimeDyld's stubs and GOT can be) get a
+// block of their own.
+uint8_t *PooledMemoryManager::allocateText(uintptr_t Size, unsigned Alignment) {
+    if (!Alignment)
+        Alignment = 16;
+    uint8_t *P = alignPtr(TextFree, Alignment);
+    if (!TextFree || P + Size > TextEnd) {
+        if (!addTextBlock(Size + Alignment))
+            return nullptr;
+        P = alignPtr(TextFree, Alignment);
+    }
+    TextFree = P + Size;
+    return P;
+}
+
+uint8_t *PooledMemoryManager::allocateCodeSection(uintptr_t Size, unsigned Alignment,
+                                                  unsigned SectionID, StringRef SectionName) {
+    return allocateText(Size, Alignment);
+}
+
+uint8_t *PooledMemoryManager::allocateDataSection(uintptr_t Size, unsigned Alignment,
+                                                  unsigned SectionID, StringRef SectionName,
+                                                  bool IsReadOnly) {
+    if (IsReadOnly)
+        return allocateText(Size, Alignment);
+
+    uint8_t *P = Pool.allocateData(Size, Alignment ? Alignment : 16);
+    if (P)
+        Data.push_back(P);
+    return P;
+}
+
+// Read-only data is executable too, it shares the pages of the code.
+bool PooledMemoryManager::finalizeMemory(std::string *ErrMsg) {
+    for (; FinalizedBlocks != TextBlocks.size(); ++FinalizedBlocks) {
+        sys::MemoryBlock &Block = TextBlocks[FinalizedBlocks];
+        if (std::error_code EC = sys::Memory::protectMappedMemory(
+                    Block, sys::Memory::MF_READ | sys::Memory::MF_EXEC)) {
+            if (ErrMsg)
+                *ErrMsg = EC.message();
+            return true;
+        }
+        sys::Memory::InvalidateInstructionCache(Block.base(), Block.size());
+    }
+
+    // The rest of the last block isn't writable anymore.
+    TextFree = TextEnd = nullptr;
+    return false;
+}
+
+}
@@ -1,13 +1,17 @@
 
 #include "Lexer.h"
+#include <chrono>
 #include <cstdlib>
 
 int Lexer::Lexer::advance() {
-    if (SourceIterator == SourceString.end()) {
-        return EOF;
+    // Everything read so far was used, so only the new chunk is kept.
+    while (SourcePos == SourceString.size()) {
+        SourceString.clear();
+        SourcePos = 0;
+        if (!Refill || !Refill(SourceString))
+            return EOF;
     }
-    int LastChar = *SourceIterator;
-    ++SourceIterator;
+    int LastChar = SourceString[SourcePos++];
 
     if (LastChar == '\n' || LastChar == '\r') {
         LexLoc.Line++;
@@ -20,8 +24,6 @@ int Lexer::Lexer::advance() {
 
 /// gettok - Return the next token from standard input.
 int Lexer::Lexer::gettok() {
-    static int LastChar = ' ';
-
     // Skip any whitespace
     while (isspace(LastChar)) {
         LastChar = advance();
@@ -46,6 +48,10 @@ int Lexer::Lexer::gettok() {
             return tok_else;
         if (IdentifierStr == "for")
             return tok_for;
+        if (IdentifierStr == "parfor")
+            return tok_parfor;
+        if (IdentifierStr == "len")
+            return tok_len;
         if (IdentifierStr == "in")
             return tok_in;
         if (IdentifierStr == "binary")
@@ -94,13 +100,31 @@ int Lexer::Lexer::gettok() {
         return tok_eof;
     }
 
-    // Otherwise, just return the character as its ascii value.
+    // Otherwise, just return the character as its ascii value, unless it starts
+    // a two character comparison.
     int ThisChar = LastChar;
     LastChar = advance();
+    if (LastChar == '=') {
+        int Tok = ThisChar == '=' ? tok_eq : ThisChar == '!' ? tok_ne :
+                  ThisChar == '<' ? tok_le : ThisChar == '>' ? tok_ge : 0;
+        if (Tok) {
+            LastChar = advance();
+            return Tok;
+        }
+    }
     return ThisChar;
 }
 
 // Allows us to look one token ahead at what the lexer is returning.
+// Lexing is only timed for -time-report, it costs two clock reads per token.
 int Lexer::Lexer::getNextToken() {
-    return CurTok = gettok();
+    ++TokenCount;
+    if (!TimeLexing)
+        return CurTok = gettok();
+
+    auto Start = std::chrono::steady_clock::now();
+    CurTok = gettok();
+    LexNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - Start).count();
+    return CurTok;
 }
@@ -6,19 +6,19 @@
 
 namespace Parser {
 
+std::map<int, int> BinopPrecedence;
+
 // =============================================================================
 // Private Functions
 // =============================================================================
 
 // GetTokPrecedence - Get the precedence of the pending binary operator token.
 int GetTokPrecedence(Lexer::Lexer &lexer) {
-    if (!isascii(lexer.getCurTok()))
-        return -1;
-
-    // Make sure it's a declared binop.
-    int TokPrec = BinopPrecedence[lexer.getCurTok()];
-    if (TokPrec <= 0) return -1;
-    return TokPrec;
+    // Make sure it's a declared binop, the comparisons `==` etc. are tokens of
+    // their own.
+    auto I = BinopPrecedence.find(lexer.getCurTok());
+    if (I == BinopPrecedence.end() || I->second <= 0) return -1;
+    return I->second;
 }
 
 // =============================================================================
@@ -67,7 +67,7 @@ std::unique_ptr<ExprAST> ParseBinOpRHS(int ExprPrec, std::unique_ptr<ExprAST> LH
 // Handle function prototypes, used for 'extern' function declarations as well as function
 // body definitions, and operators (binary, unary).
 // prototype
-//  ::= id '(' id* ')'
+//  ::= id '(' (id '[]'?)* ')'
 //  ::= binary LETTER number? (id, id)
 std::unique_ptr<PrototypeAST> ParsePrototype(Lexer::Lexer &lexer) {
     std::string FnName;
@@ -84,6 +84,15 @@ std::unique_ptr<PrototypeAST> ParsePrototype(Lexer::Lexer &lexer) {
         FnName = lexer.getIdentifierStr();
         Kind = 0;
         lexer.getNextToken(); // eat identifier
+
+        // 'fast' before the name compiles the function with fast-math flags,
+        // a function can still be called fast.
+        if (FnName == "fast" && lexer.getCurTok() != '(') {
+            auto Proto = ParsePrototype(lexer);
+            if (Proto)
+                Proto->setFastMath();
+            return Proto;
+        }
         break;
     case Lexer::tok_unary:
         lexer.getNextToken(); // eat 'unary'
@@ -98,6 +107,8 @@ std::unique_ptr<PrototypeAST> ParsePrototype(Lexer::Lexer &lexer) {
         lexer.getNextToken(); // eat 'binary'
         if (!isascii(lexer.getCurTok()))
             return ErrorP("Expected ascii binary operator", lexer);
+        if (BinaryExprAST::isBuiltin(lexer.getCurTok()))
+            return ErrorP("Builtin binary operators can't be redefined", lexer);
         FnName = "binary";
         FnName += (char)lexer.getCurTok();
         Kind = 2;
@@ -116,10 +127,23 @@ std::unique_ptr<PrototypeAST> ParsePrototype(Lexer::Lexer &lexer) {
     if (lexer.getCurTok() != '(')
         return ErrorP("Expected '(' in prototype", lexer);
 
-    // Read list of argument names
+    // Read list of argument names, array arguments are followed by []
     std::vector<std::string> ArgNames;
-    while (lexer.getNextToken() == Lexer::tok_identifier) {
+    std::vector<bool> ArrayArgs;
+    lexer.getNextToken(); // eat '('
+    while (lexer.getCurTok() == Lexer::tok_identifier) {
         ArgNames.push_back(lexer.getIdentifierStr());
+        ArrayArgs.push_back(false);
+        lexer.getNextToken(); // eat identifier
+
+        if (lexer.getCurTok() == '[') {
+            if (Kind != 0)
+                return ErrorP("Operators can't take arrays", lexer);
+            if (lexer.getNextToken() != ']')
+                return ErrorP("Expected ']' after '[' in prototype", lexer);
+            lexer.getNextToken(); // eat ']'
+            ArrayArgs.back() = true;
+        }
     }
     if (lexer.getCurTok() != ')')
         return ErrorP("Expected ')' in prototype", lexer);
@@ -132,7 +156,7 @@ std::unique_ptr<PrototypeAST> ParsePrototype(Lexer::Lexer &lexer) {
         return ErrorP("Invalid number of operands for operator", lexer);
 
     return llvm::make_unique<PrototypeAST>(FnLoc, FnName, ArgNames, Kind != 0,
-            BinaryPrecedence);
+            BinaryPrecedence, ArrayArgs);
 }
 
 // Function definition, just a prototype plus expressions (separated by ';') to implement the body
@@ -180,17 +204,20 @@ std::unique_ptr<FunctionAST> ParseDefinition(Lexer::Lexer &lexer) {
 // external ::= 'extern' prototype
 std::unique_ptr<PrototypeAST> ParseExtern(Lexer::Lexer &lexer) {
     lexer.getNextToken(); // eat extern.
-    return ParsePrototype(lexer);
+    auto Proto = ParsePrototype(lexer);
+    if (Proto && Proto->isFastMath())
+        return ErrorP("Only definitions can be fast", lexer);
+    return Proto;
 }
 
 // Arbitrary top level expressions and evaluate on the fly.
 // Will handle this by defining anonymous nullary (zero argument) functions for them
 // toplevelexpr ::= expression
-std::unique_ptr<FunctionAST> ParseTopLevelExpr(Lexer::Lexer &lexer) {
+std::unique_ptr<FunctionAST> ParseTopLevelExpr(Lexer::Lexer &lexer, const std::string &Name) {
     Lexer::SourceLocation FnLoc = lexer.getLexLoc();
     if (auto E = ParseExpression(lexer)) {
         // Make anonymous proto
-        auto Proto = llvm::make_unique<PrototypeAST>(FnLoc, "main", std::vector<std::string>());
+        auto Proto = llvm::make_unique<PrototypeAST>(FnLoc, Name, std::vector<std::string>());
 
         typedef std::vector<std::unique_ptr<ExprAST>> FunctionBodyType;
         auto Body = llvm::make_unique<FunctionBodyType>(FunctionBodyType());
@@ -233,8 +260,11 @@ std::unique_ptr<ExprAST> ParseExpression(Lexer::Lexer &lexer) {
     return ParseBinOpRHS(0, std::move(LHS), lexer);
 }
 
-// varexpr ::= 'var' identifier ('=' expression)?
-//                  (',' identifier ('=' expression)?* 'in' expression 'end'
+// An array declaration allocates an array of the given length, zeroed, which
+// lives until the end of the var.
+// varexpr ::= 'var' vardecl (',' vardecl)* 'in' expression 'end'
+// vardecl ::= identifier ('=' expression)?
+//         ::= identifier '[' expression ']'
 std::unique_ptr<ExprAST> ParseVarExpr(Lexer::Lexer &lexer) {
     lexer.getNextToken(); // eat the 'var'.
 
@@ -257,6 +287,18 @@ std::unique_ptr<ExprAST> ParseVarExpr(Lexer::Lexer &lexer) {
             Init = ParseExpression(lexer);
             if (!Init)
                 return nullptr;
+        } else if (lexer.getCurTok() == '[') {
+            Lexer::SourceLocation ArrayLoc = lexer.getLexLoc();
+            lexer.getNextToken(); // eat the '['
+
+            auto Length = ParseExpression(lexer);
+            if (!Length)
+                return nullptr;
+            if (lexer.getCurTok() != ']')
+                return Error("expected ']' after array length", lexer);
+            lexer.getNextToken(); // eat the ']'
+
+            Init = llvm::make_unique<ArrayAllocExprAST>(ArrayLoc, std::move(Length));
         }
 
         VarNames.push_back(std::make_pair(Name, std::move(Init)));
@@ -288,9 +330,14 @@ std::unique_ptr<ExprAST> ParseVarExpr(Lexer::Lexer &lexer) {
 }
 
 // For expression parsing
-// The step value is optional
+// The step value is optional. A parallel loop's end condition must compare the
+// loop variable against a limit, and it may name the operator combining the
+// values of its iterations (+ by default).
 // forexpr ::= 'for' identifier '=' expr ',' expr (',' expr)? 'in' expression
+//         ::= 'parfor' identifier '=' expr ',' identifier '<' expr (',' expr)?
+//                 ('reduce' op)? 'in' expression
 std::unique_ptr<ExprAST> ParseForExpr(Lexer::Lexer &lexer) {
+    bool Parallel = lexer.getCurTok() == Lexer::tok_parfor;
     lexer.getNextToken(); // eat the for.
 
     if (lexer.getCurTok() != Lexer::tok_identifier)
@@ -310,6 +357,16 @@ std::unique_ptr<ExprAST> ParseForExpr(Lexer::Lexer &lexer) {
         return Error("expected ',' after for start value", lexer);
     lexer.getNextToken(); // eat ','
 
+    // For parfor, parse just the limit.
+    if (Parallel) {
+        if (lexer.getCurTok() != Lexer::tok_identifier || lexer.getIdentifierStr() != IdName)
+            return Error("expected the loop variable in the parfor end condition", lexer);
+        lexer.getNextToken(); // eat identifier
+        if (lexer.getCurTok() != '<')
+            return Error("expected '<' in the parfor end condition", lexer);
+        lexer.getNextToken(); // eat '<'
+    }
+
     auto End = ParseExpression(lexer);
     if (!End)
         return nullptr;
@@ -323,6 +380,16 @@ std::unique_ptr<ExprAST> ParseForExpr(Lexer::Lexer &lexer) {
             return nullptr;
     }
 
+    // The reduction operator is optional
+    char ReduceOp = '+';
+    if (Parallel && lexer.getCurTok() == Lexer::tok_identifier && lexer.getIdentifierStr() == "reduce") {
+        lexer.getNextToken(); // eat 'reduce'
+        if (!isascii(lexer.getCurTok()) || lexer.getCurTok() == '(' || lexer.getCurTok() == ',')
+            return Error("expected an operator after 'reduce'", lexer);
+        ReduceOp = lexer.getCurTok();
+        lexer.getNextToken(); // eat the operator
+    }
+
     if (lexer.getCurTok() != Lexer::tok_in)
         return Error("expected 'in' after for", lexer);
     lexer.getNextToken(); // eat 'in'.
@@ -336,7 +403,7 @@ std::unique_ptr<ExprAST> ParseForExpr(Lexer::Lexer &lexer) {
     lexer.getNextToken(); // eat 'end'
 
     return llvm::make_unique<ForExprAST>(lexer.getLexLoc(), IdName, std::move(Start),
-            std::move(End), std::move(Step), std::move(Body));
+            std::move(End), std::move(Step), std::move(Body), Parallel, ReduceOp);
 }
 
 // If expression parsing
@@ -407,12 +474,26 @@ std::unique_ptr<ExprAST> ParseNumberExpr(Lexer::Lexer &lexer) {
 // or if it is a function call expression.
 // identifierexpr
 //  ::= identifier
+//  ::= identifier '[' expression ']'
 //  ::= identifier '(' expression* ')'
 std::unique_ptr<ExprAST> ParseIndentifierExpr(Lexer::Lexer &lexer) {
     std::string IdName = lexer.getIdentifierStr();
 
     lexer.getNextToken(); // eat identifier
 
+    // Array element
+    if (lexer.getCurTok() == '[') {
+        auto Array = llvm::make_unique<VariableExprAST>(lexer.getLexLoc(), IdName);
+        lexer.getNextToken(); // eat '['
+        auto Index = ParseExpression(lexer);
+        if (!Index)
+            return nullptr;
+        if (lexer.getCurTok() != ']')
+            return Error("expected ']' after array index", lexer);
+        lexer.getNextToken(); // eat ']'
+        return llvm::make_unique<IndexExprAST>(lexer.getLexLoc(), std::move(Array), std::move(Index));
+    }
+
     if (lexer.getCurTok() != '(') // Simple variable ref
         return llvm::make_unique<VariableExprAST>(lexer.getLexLoc(), IdName);
 
@@ -442,6 +523,27 @@ std::unique_ptr<ExprAST> ParseIndentifierExpr(Lexer::Lexer &lexer) {
     return llvm::make_unique<CallExprAST>(lexer.getLexLoc(), IdName, std::move(Args));
 }
 
+// Array length
+// lengthexpr ::= 'len' '(' expression ')'
+std::unique_ptr<ExprAST> ParseLengthExpr(Lexer::Lexer &lexer) {
+    Lexer::SourceLocation LenLoc = lexer.getLexLoc();
+    lexer.getNextToken(); // eat 'len'
+
+    if (lexer.getCurTok() != '(')
+        return Error("expected '(' after len", lexer);
+    lexer.getNextToken(); // eat '('
+
+    auto Array = ParseExpression(lexer);
+    if (!Array)
+        return nullptr;
+
+    if (lexer.getCurTok() != ')')
+        return Error("expected ')' after len argument", lexer);
+    lexer.getNextToken(); // eat ')'
+
+    return llvm::make_unique<LengthExprAST>(LenLoc, std::move(Array));
+}
+
 // primary
 //  ::= identifierexpr
 //  ::= numberexpr
@@ -449,6 +551,7 @@ std::unique_ptr<ExprAST> ParseIndentifierExpr(Lexer::Lexer &lexer) {
 //  ::= ifexpr
 //  ::= forexpr
 //  ::= varexpr
+//  ::= lengthexpr
 std::unique_ptr<ExprAST> ParsePrimary(Lexer::Lexer &lexer) {
     switch (lexer.getCurTok()) {
         default:
@@ -462,9 +565,12 @@ std::unique_ptr<ExprAST> ParsePrimary(Lexer::Lexer &lexer) {
         case Lexer::tok_if:
             return ParseIfExpr(lexer);
         case Lexer::tok_for:
+        case Lexer::tok_parfor:
             return ParseForExpr(lexer);
         case Lexer::tok_var:
             return ParseVarExpr(lexer);
+        case Lexer::tok_len:
+            return ParseLengthExpr(lexer);
     }
 }
 
@@ -0,0 +1,66 @@
+#include "PerfMapListener.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/Path.h"
+#include <string>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace llvm::object;
+
+namespace Profiling {
+
+// perf looks the map file up by pid, appending keeps entries from earlier
+// listeners in the same process.
+PerfMapListener::PerfMapListener() {
+    std::string Path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    MapFile = fopen(Path.c_str(), "a");
+    if (!MapFile)
+        fprintf(stderr, "Error: could not open %s\n", Path.c_str());
+}
+
+PerfMapListener::~PerfMapListener() {
+    if (MapFile)
+        fclose(MapFile);
+}
+
+void PerfMapListener::NotifyObjectEmitted(const ObjectFile &Obj,
+                                          const RuntimeDyld::LoadedObjectInfo &L) {
+    if (!MapFile)
+        return;
+
+    // The debug object has its sections at the addresses they were loaded at.
+    OwningBinary<ObjectFile> DebugObjOwner = L.getObjectForDebug(Obj);
+    const ObjectFile &DebugObj = *DebugObjOwner.getBinary();
+    DWARFContextInMemory Context(DebugObj);
+
+    for (const std::pair<SymbolRef, uint64_t> &P : computeSymbolSizes(DebugObj)) {
+        SymbolRef Sym = P.first;
+        if (Sym.getType() != SymbolRef::ST_Function)
+            continue;
+        ErrorOr<StringRef> Name = Sym.getName();
+        if (!Name)
+            continue;
+        ErrorOr<uint64_t> Addr = Sym.getAddress();
+        if (!Addr)
+            continue;
+        uint64_t Size = P.second;
+
+        std::string Entry = Name->str();
+        DILineInfoTable Lines = Context.getLineInfoForAddressRange(*Addr, Size);
+        if (!Lines.empty()) {
+            const DILineInfo &Info = Lines.front().second;
+            Entry += " [" + sys::path::filename(Info.FileName).str() + ":" +
+                std::to_string(Info.Line) + "]";
+        }
+
+        fprintf(MapFile, "%llx %llx %s\n", (unsigned long long)*Addr,
+                (unsigned long long)Size, Entry.c_str());
+    }
+
+    // perf reads the map after the process exits, flush in case it crashes.
+    fflush(MapFile);
+}
+
+} // Namespace
@@ -0,0 +1,150 @@
+#include "TimeReport.h"
+#include "llvm/Support/Format.h"
+#include <sys/resource.h>
+
+namespace Stats {
+
+// =============================================================================
+// Phase
+// =============================================================================
+
+Phase *Phase::getChild(llvm::StringRef ChildName) {
+    for (auto &C : Children)
+        if (C->Name == ChildName)
+            return C.get();
+    Children.push_back(std::unique_ptr<Phase>(new Phase(ChildName)));
+    return Children.back().get();
+}
+
+uint64_t Phase::getChildNanos() const {
+    uint64_t Nanos = 0;
+    for (auto &C : Children)
+        Nanos += C->Nanos;
+    return Nanos;
+}
+
+// =============================================================================
+// TimeReport
+// =============================================================================
+
+void TimeReport::startPhase(llvm::StringRef Name) {
+    Phase *Parent = Stack.empty() ? &Root : Stack.back().first;
+    Stack.push_back(std::make_pair(Parent->getChild(Name), Clock::now()));
+}
+
+void TimeReport::stopPhase() {
+    assert(!Stack.empty() && "stopPhase without a running phase");
+    Phase *P = Stack.back().first;
+    P->Nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - Stack.back().second).count();
+    P->Count++;
+    P->PeakRSS = getPeakRSS();
+    Stack.pop_back();
+}
+
+void TimeReport::addPhaseTime(llvm::ArrayRef<llvm::StringRef> Path, uint64_t Nanos, uint64_t Count) {
+    Phase *P = &Root;
+    for (llvm::StringRef Name : Path)
+        P = P->getChild(Name);
+    P->Nanos += Nanos;
+    P->Count += Count;
+}
+
+void TimeReport::addCounter(llvm::StringRef Name, uint64_t Value) {
+    for (auto &C : Counters) {
+        if (C.first == Name) {
+            C.second += Value;
+            return;
+        }
+    }
+    Counters.push_back(std::make_pair(Name.str(), Value));
+}
+
+void TimeReport::setCounter(llvm::StringRef Name, uint64_t Value) {
+    for (auto &C : Counters) {
+        if (C.first == Name) {
+            C.second = Value;
+            return;
+        }
+    }
+    Counters.push_back(std::make_pair(Name.str(), Value));
+}
+
+uint64_t TimeReport::getPeakRSS() {
+    struct rusage Usage;
+    if (getrusage(RUSAGE_SELF, &Usage))
+        return 0;
+#ifdef __APPLE__
+    return Usage.ru_maxrss / 1024; // Darwin reports bytes
+#else
+    return Usage.ru_maxrss;
+#endif
+}
+
+// =============================================================================
+// Output
+// =============================================================================
+
+void TimeReport::printPhase(llvm::raw_ostream &OS, const Phase &P, uint64_t Total, unsigned Depth) const {
+    // Time measured outside a phase (lexing) can exceed its parent's wall time
+    // by the timer overhead, don't let self time go negative.
+    uint64_t Children = P.getChildNanos();
+    uint64_t Self = P.Nanos > Children ? P.Nanos - Children : 0;
+    OS << llvm::format("%10.3f %10.3f %6.1f%% %10llu %10llu  ",
+            P.Nanos / 1e6, Self / 1e6, Total ? P.Nanos * 100.0 / Total : 0.0,
+            (unsigned long long)P.Count, (unsigned long long)P.PeakRSS);
+    OS.indent(Depth * 2) << P.Name << '\n';
+    for (auto &C : P.Children)
+        printPhase(OS, *C, Total, Depth + 1);
+}
+
+void TimeReport::print(llvm::raw_ostream &OS) const {
+    uint64_t Total = Root.getChildNanos();
+    uint64_t PeakRSS = getPeakRSS();
+
+    OS << "===" << std::string(73, '-') << "===\n";
+    OS << "                         Yorkie Compile Time Report\n";
+    OS << "===" << std::string(73, '-') << "===\n";
+    OS << " Total(ms)   Self(ms)  Total%      Count    RSS(KB)  Phase\n";
+    for (auto &C : Root.Children)
+        printPhase(OS, *C, Total, 0);
+    OS << llvm::format("%10.3f %10s %6.1f%% %10s %10llu  ", Total / 1e6, (const char *)"", 100.0,
+            (const char *)"", (unsigned long long)PeakRSS) << Root.Name << "\n";
+
+    OS << "\n  Counters\n";
+    for (auto &C : Counters)
+        OS << llvm::format("%12llu  ", (unsigned long long)C.second) << C.first << '\n';
+    OS << llvm::format("%12llu  ", (unsigned long long)PeakRSS) << "peak-rss-kb\n";
+}
+
+// Phase and counter names are plain identifiers, so nothing needs escaping.
+void TimeReport::printPhaseJSON(llvm::raw_ostream &OS, const Phase &P, unsigned Depth) const {
+    OS.indent(Depth * 2) << "{\"name\": \"" << P.Name << "\", "
+        << "\"time_ms\": " << llvm::format("%.3f", P.Nanos / 1e6) << ", "
+        << "\"count\": " << P.Count << ", "
+        << "\"peak_rss_kb\": " << P.PeakRSS << ", "
+        << "\"children\": [";
+    for (unsigned i = 0, e = P.Children.size(); i != e; ++i) {
+        OS << (i ? ",\n" : "\n");
+        printPhaseJSON(OS, *P.Children[i], Depth + 1);
+    }
+    if (!P.Children.empty()) {
+        OS << '\n';
+        OS.indent(Depth * 2);
+    }
+    OS << "]}";
+}
+
+void TimeReport::printJSON(llvm::raw_ostream &OS) const {
+    OS << "{\n  \"phases\": [";
+    for (unsigned i = 0, e = Root.Children.size(); i != e; ++i) {
+        OS << (i ? ",\n" : "\n");
+        printPhaseJSON(OS, *Root.Children[i], 2);
+    }
+    OS << "\n  ],\n  \"counters\": {";
+    for (auto &C : Counters)
+        OS << "\n    \"" << C.first << "\": " << C.second << ',';
+    OS << "\n    \"peak-rss-kb\": " << getPeakRSS() << "\n  }\n}\n";
+}
+
+} // Namespace
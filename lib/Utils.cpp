@@ -1,10 +1,19 @@
 #include "Utils.h"
+#include <atomic>
 
 // =============================================================================
 // Error* - These are little helper functions for error handling.
 // =============================================================================
 
+// The parser can run on a thread of its own (-pipeline).
+static std::atomic<unsigned> ErrorCount(0);
+
+unsigned getErrorCount() {
+    return ErrorCount;
+}
+
 std::unique_ptr<ExprAST> Error(const char *Str, Lexer::Lexer &lexer) {
+    ++ErrorCount;
     fprintf(stderr, "Error: %s Location: %d:%d\n", Str, lexer.getLexLoc().Line, lexer.getLexLoc().Col);
     return nullptr;
 }
@@ -20,6 +29,7 @@ std::unique_ptr<FunctionAST> ErrorF(const char *Str, Lexer::Lexer &lexer) {
 // Simple errors (no line numbers)
 
 std::unique_ptr<ExprAST> Error(const char *Str) {
+    ++ErrorCount;
     fprintf(stderr, "Error: %s\n", Str);
     return nullptr;
 }
@@ -0,0 +1,237 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// This file is the runtime for parfor loops. yorkie links it into programs
+// that use them, they need -lpthread.
+//
+// A loop of N iterations is split into chunks of consecutive iterations, and
+// the chunks are spread evenly over a pool of worker threads (the calling
+// thread is worker 0). A worker runs its own chunks in order and, once it runs
+// out, steals the upper half of the chunks another worker has left. Each chunk
+// reduces its iterations to one value, and the chunk values are combined in
+// chunk order once all of them are done. The chunks only depend on N, and
+// loops run serially (nested ones, or with one worker) reduce over the same
+// chunks, so the result doesn't depend on the schedule or the number of
+// workers, even for sums of doubles.
+//
+// YORKIE_NUM_THREADS sets the number of workers (default: one per CPU), and
+// YORKIE_PARFOR_CHUNK the iterations per chunk (default: enough for at most
+// ParForChunks chunks). ForExprAST::evaluateParallel() in lib/Evaluator.cpp
+// uses the default chunks too, so constant loops fold to the same value.
+
+typedef double (*ParForChunkFn)(const double *Env, int64_t Begin, int64_t End);
+typedef double (*ParForCombineFn)(double LHS, double RHS);
+
+namespace {
+
+// Worker - The chunks a worker has left, packed into one word so the owner
+// and thieves can both update it with a compare and swap: the next chunk in
+// the low 32 bits, one past the last in the high 32 bits.
+struct Worker {
+    uint64_t Range;
+    char Padding[56]; // Keep workers on separate cache lines
+};
+
+struct ParForJob {
+    ParForChunkFn Chunk;
+    const double *Env;
+    int64_t N;
+    int64_t ChunkSize;
+    double *Results;        // Value of each chunk
+    uint32_t Remaining;     // Chunks not finished yet
+    uint32_t Active;        // Pool threads working on the job
+};
+
+const unsigned MaxWorkers = 256;
+const int64_t ParForChunks = 2048;
+
+unsigned NumWorkers = 0;
+Worker Workers[MaxWorkers];
+pthread_once_t PoolOnce = PTHREAD_ONCE_INIT;
+pthread_mutex_t PoolLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t JobPosted = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t ParForLock = PTHREAD_MUTEX_INITIALIZER;
+ParForJob *CurrentJob = nullptr;
+uint64_t JobGeneration = 0;
+__thread bool InParFor = false;
+
+inline uint64_t packRange(uint32_t Lo, uint32_t Hi) {
+    return (uint64_t)Hi << 32 | Lo;
+}
+
+// Takes the next chunk of worker W, returns false if it has none left.
+bool popChunk(Worker &W, uint32_t &Chunk) {
+    uint64_t Range = __atomic_load_n(&W.Range, __ATOMIC_ACQUIRE);
+    while (1) {
+        uint32_t Lo = (uint32_t)Range, Hi = (uint32_t)(Range >> 32);
+        if (Lo >= Hi)
+            return false;
+        if (__atomic_compare_exchange_n(&W.Range, &Range, packRange(Lo + 1, Hi), false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            Chunk = Lo;
+            return true;
+        }
+    }
+}
+
+// Moves the upper half of Victim's chunks to Thief, whose range is empty.
+bool stealChunks(Worker &Victim, Worker &Thief) {
+    uint64_t Range = __atomic_load_n(&Victim.Range, __ATOMIC_ACQUIRE);
+    while (1) {
+        uint32_t Lo = (uint32_t)Range, Hi = (uint32_t)(Range >> 32);
+        if (Lo >= Hi)
+            return false;
+        uint32_t Mid = Lo + (Hi - Lo) / 2;
+        if (__atomic_compare_exchange_n(&Victim.Range, &Range, packRange(Lo, Mid), false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&Thief.Range, packRange(Mid, Hi), __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+}
+
+void runChunk(ParForJob *Job, uint32_t Chunk) {
+    int64_t Begin = Chunk * Job->ChunkSize;
+    int64_t End = Begin + Job->ChunkSize < Job->N ? Begin + Job->ChunkSize : Job->N;
+    Job->Results[Chunk] = Job->Chunk(Job->Env, Begin, End);
+    __atomic_fetch_sub(&Job->Remaining, 1, __ATOMIC_RELEASE);
+}
+
+// Runs chunks as worker Id until there are none left to run or steal.
+void work(ParForJob *Job, unsigned Id) {
+    Worker &Self = Workers[Id];
+    while (1) {
+        uint32_t Chunk;
+        while (popChunk(Self, Chunk))
+            runChunk(Job, Chunk);
+
+        bool Stole = false;
+        for (unsigned i = 1; i != NumWorkers && !Stole; ++i)
+            Stole = stealChunks(Workers[(Id + i) % NumWorkers], Self);
+        if (!Stole)
+            return;
+    }
+}
+
+void *poolThread(void *Arg) {
+    unsigned Id = (unsigned)(uintptr_t)Arg;
+    uint64_t Seen = 0;
+    InParFor = true;
+
+    while (1) {
+        pthread_mutex_lock(&PoolLock);
+        while (JobGeneration == Seen)
+            pthread_cond_wait(&JobPosted, &PoolLock);
+        Seen = JobGeneration;
+        ParForJob *Job = CurrentJob;
+        if (Job)
+            __atomic_fetch_add(&Job->Active, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&PoolLock);
+
+        if (Job) {
+            work(Job, Id);
+            __atomic_fetch_sub(&Job->Active, 1, __ATOMIC_RELEASE);
+        }
+    }
+    return nullptr;
+}
+
+void startPool() {
+    long CPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (const char *Env = getenv("YORKIE_NUM_THREADS"))
+        CPUs = atol(Env);
+    NumWorkers = CPUs < 1 ? 1 : CPUs > (long)MaxWorkers ? MaxWorkers : (unsigned)CPUs;
+
+    for (unsigned Id = 1; Id < NumWorkers; ++Id) {
+        pthread_t Thread;
+        if (pthread_create(&Thread, nullptr, poolThread, (void *)(uintptr_t)Id) != 0) {
+            NumWorkers = Id;
+            break;
+        }
+        pthread_detach(Thread);
+    }
+}
+
+int64_t getChunkSize(int64_t N) {
+    int64_t Size = 0;
+    if (const char *Env = getenv("YORKIE_PARFOR_CHUNK"))
+        Size = atoll(Env);
+    if (Size < 1)
+        Size = (N + ParForChunks - 1) / ParForChunks;
+    // Chunk indices are 32 bit.
+    if ((N + Size - 1) / Size > INT32_MAX)
+        Size = (N + INT32_MAX - 1) / INT32_MAX;
+    return Size < 1 ? 1 : Size;
+}
+
+// Runs the chunks one after the other on the calling thread.
+double runSerially(ParForChunkFn Chunk, ParForCombineFn Combine, const double *Env,
+                   int64_t N, int64_t ChunkSize) {
+    double Result = Chunk(Env, 0, ChunkSize < N ? ChunkSize : N);
+    for (int64_t Begin = ChunkSize; Begin < N; Begin += ChunkSize)
+        Result = Combine(Result, Chunk(Env, Begin, Begin + ChunkSize < N ? Begin + ChunkSize : N));
+    return Result;
+}
+
+}
+
+// Identity is the value of a loop with no iterations.
+extern "C" double __yorkie_parfor(ParForChunkFn Chunk, ParForCombineFn Combine,
+                                  const double *Env, int64_t N, double Identity) {
+    if (N <= 0)
+        return Identity;
+
+    // Nested loops run on the thread that reaches them.
+    pthread_once(&PoolOnce, startPool);
+    int64_t ChunkSize = getChunkSize(N);
+    uint32_t NumChunks = (uint32_t)((N + ChunkSize - 1) / ChunkSize);
+    if (InParFor || NumWorkers == 1 || NumChunks == 1)
+        return runSerially(Chunk, Combine, Env, N, ChunkSize);
+
+    pthread_mutex_lock(&ParForLock);
+    InParFor = true;
+
+    ParForJob Job;
+    Job.Chunk = Chunk;
+    Job.Env = Env;
+    Job.N = N;
+    Job.ChunkSize = ChunkSize;
+    Job.Results = (double *)malloc(NumChunks * sizeof(double));
+    Job.Remaining = NumChunks;
+    Job.Active = 0;
+    for (unsigned Id = 0; Id != NumWorkers; ++Id) {
+        uint32_t Lo = (uint64_t)NumChunks * Id / NumWorkers;
+        uint32_t Hi = (uint64_t)NumChunks * (Id + 1) / NumWorkers;
+        __atomic_store_n(&Workers[Id].Range, packRange(Lo, Hi), __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&PoolLock);
+    CurrentJob = &Job;
+    JobGeneration++;
+    pthread_cond_broadcast(&JobPosted);
+    pthread_mutex_unlock(&PoolLock);
+
+    work(&Job, 0);
+    while (__atomic_load_n(&Job.Remaining, __ATOMIC_ACQUIRE) != 0)
+        sched_yield();
+
+    // Workers that haven't picked the job up yet won't, wait for the rest to
+    // leave it before it goes out of scope.
+    pthread_mutex_lock(&PoolLock);
+    CurrentJob = nullptr;
+    pthread_mutex_unlock(&PoolLock);
+    while (__atomic_load_n(&Job.Active, __ATOMIC_ACQUIRE) != 0)
+        sched_yield();
+
+    double Result = Job.Results[0];
+    for (uint32_t i = 1; i != NumChunks; ++i)
+        Result = Combine(Result, Job.Results[i]);
+    free(Job.Results);
+
+    InParFor = false;
+    pthread_mutex_unlock(&ParForLock);
+    return Result;
+}
@@ -1,5 +1,18 @@
-
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#if defined(__APPLE__)
+#include <sys/ucontext.h>
+#else
+#include <ucontext.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 // This file allows functions to be written in C and used from yorkie.
 
@@ -7,3 +20,533 @@ extern "C" double putchard(double x) {
     fputc((char)x, stderr);
     return 0;
 }
+
+extern "C" double printd(double x) {
+    fprintf(stderr, "%f\n", x);
+    return 0;
+}
+
+// =============================================================================
+// Array runtime
+//
+// Arrays declared with "var a[n]" are allocated here and freed at the end of
+// the var. The buffers are zeroed and aligned for vector loads, codegen tells
+// LLVM about the alignment.
+// =============================================================================
+
+static const size_t ArrayAlign = 64;
+
+extern "C" double *__yorkie_array_alloc(int64_t Length) {
+    size_t Size = (Length > 0 ? (size_t)Length : 1) * sizeof(double);
+    void *Data = nullptr;
+    if (posix_memalign(&Data, ArrayAlign, Size) != 0) {
+        fprintf(stderr, "Error: could not allocate an array of %lld elements\n", (long long)Length);
+        exit(1);
+    }
+    memset(Data, 0, Size);
+    return (double *)Data;
+}
+
+extern "C" void __yorkie_array_free(double *Data) {
+    free(Data);
+}
+
+// =============================================================================
+// Profile runtime (-profile-generate)
+//
+// Instrumented modules register their counters from a global constructor, and
+// every registered counter is written to the profile as "<key> <count>" lines
+// when the program exits.
+// =============================================================================
+
+struct ProfileData {
+    const char *Path;
+    const char **Names;
+    uint64_t **Counters;
+    uint64_t Size;
+    ProfileData *Next;
+};
+
+static ProfileData *RegisteredProfiles = nullptr;
+
+static void writeProfiles() {
+    if (!RegisteredProfiles)
+        return;
+
+    FILE *F = fopen(RegisteredProfiles->Path, "w");
+    if (!F) {
+        fprintf(stderr, "Error: could not write profile %s\n", RegisteredProfiles->Path);
+        return;
+    }
+    for (ProfileData *P = RegisteredProfiles; P; P = P->Next)
+        for (uint64_t i = 0; i != P->Size; ++i)
+            fprintf(F, "%s %llu\n", P->Names[i], (unsigned long long)*P->Counters[i]);
+    fclose(F);
+}
+
+extern "C" void __yorkie_profile_register(const char *Path, const char **Names,
+        uint64_t **Counters, uint64_t Size) {
+    if (!RegisteredProfiles)
+        atexit(writeProfiles);
+
+    ProfileData *P = (ProfileData *)malloc(sizeof(ProfileData));
+    *P = ProfileData{Path, Names, Counters, Size, RegisteredProfiles};
+    RegisteredProfiles = P;
+}
+// =============================================================================
+// Profiler runtime (-profile)
+//
+// Every profiled function has a site: a { name, stats } pair.
+//
+// -profile=count calls an enter hook with the site on entry and an exit hook
+// before the function returns. The sites are globals emitted by codegen, the
+// runtime fills in their stats the first time a function runs. The hooks keep
+// a shadow call stack and read the time stamp counter, so calls and times are
+// exact but every call pays for two calls and two counter reads.
+// -profile=sample doesn't change the code of a function beyond keeping its
+// frame pointer. Each module registers the start address of its functions
+// and the end of its code, and a SIGPROF timer walks the frame pointers of
+// the interrupted program and attributes the sample to the functions the
+// return addresses are in.
+//
+// The report is printed to stderr at exit. The runtime assumes the program is
+// single threaded.
+// =============================================================================
+
+struct ProfileSite;
+
+// ProfileEdge - Calls from one function to another.
+struct ProfileEdge {
+    ProfileSite *Callee;
+    uint64_t Calls;
+    uint64_t Total;     // Time (ticks or samples) spent in the callee
+    uint64_t Mark;      // Last sample counted in Total
+    ProfileEdge *Next;
+};
+
+// ProfileStats - What is known about one function.
+struct ProfileStats {
+    uint64_t Calls;
+    uint64_t Self;      // Time (ticks or samples) spent in the function itself
+    uint64_t Total;     // Time spent in the function and its callees
+    uint64_t Mark;      // Last sample counted in Total
+    uint64_t Active;    // Activations on the stack, Total counts the outermost only
+    ProfileEdge *Callees;
+    ProfileSite *Next;
+};
+
+// ProfileSite - Matches the { i8*, i8* } globals emitted by codegen.
+struct ProfileSite {
+    const char *Name;
+    ProfileStats *Stats;
+};
+
+struct ProfileFrame {
+    ProfileSite *Site;
+    ProfileEdge *Edge;  // Edge from the caller, null for the outermost frame
+    uint64_t Start;
+    uint64_t Children;  // Time spent in callees
+};
+
+// SampledCode - Where the code of a function starts, sorted by address. A
+// null site marks the end of a module's code.
+struct SampledCode {
+    uintptr_t Start;
+    ProfileSite *Site;
+};
+
+static const uint32_t ProfileMaxDepth = 4096;
+static const long ProfileIntervalUS = 1000;
+
+static ProfileFrame ProfileStack[ProfileMaxDepth];
+static uint32_t ProfileDepth = 0;
+static ProfileSite *ProfileSites = nullptr;
+static ProfileSite **ProfileSitesTail = &ProfileSites;
+static bool ProfileSampling = false;
+static volatile uint64_t ProfileSamples = 0;
+static uint64_t ProfileOtherSamples = 0;
+static uint64_t ProfileStartTicks, ProfileStartNanos;
+static clock_t ProfileStartClock;
+
+static SampledCode *SampledCodeTable = nullptr;
+static size_t SampledCodeSize = 0;
+static size_t SampledCodeCapacity = 0;
+// The highest frame seen so far, the stack between the stack pointer and it
+// is known to be mapped.
+static uintptr_t ProfileStackTop = 0;
+
+static uint64_t readNanos() {
+    struct timespec TS;
+    clock_gettime(CLOCK_MONOTONIC, &TS);
+    return (uint64_t)TS.tv_sec * 1000000000ull + TS.tv_nsec;
+}
+
+static inline uint64_t readTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return readNanos();
+#endif
+}
+
+static void printProfile();
+
+// Edges seen by samples come from a fixed pool, the signal handler can't
+// allocate.
+static const uint32_t ProfileMaxSampledEdges = 4096;
+static ProfileEdge ProfileSampledEdges[ProfileMaxSampledEdges];
+static uint32_t ProfileNumSampledEdges = 0;
+
+static ProfileEdge *getSampledEdge(ProfileStats *Caller, ProfileSite *Callee) {
+    for (ProfileEdge *E = Caller->Callees; E; E = E->Next)
+        if (E->Callee == Callee)
+            return E;
+    if (ProfileNumSampledEdges == ProfileMaxSampledEdges)
+        return nullptr;
+
+    ProfileEdge *E = &ProfileSampledEdges[ProfileNumSampledEdges++];
+    E->Callee = Callee;
+    E->Next = Caller->Callees;
+    Caller->Callees = E;
+    return E;
+}
+
+// The function the code at PC belongs to, null if yorkie didn't compile it.
+static ProfileSite *findSampledSite(uintptr_t PC) {
+    size_t Lo = 0, Hi = SampledCodeSize;
+    while (Lo < Hi) {
+        size_t Mid = Lo + (Hi - Lo) / 2;
+        if (SampledCodeTable[Mid].Start <= PC)
+            Lo = Mid + 1;
+        else
+            Hi = Mid;
+    }
+    return Lo ? SampledCodeTable[Lo - 1].Site : nullptr;
+}
+
+// Reads the program counter, frame pointer and stack pointer of the
+// interrupted code. Frame records are { previous frame pointer, return
+// address } on every supported target.
+static bool getSampledRegisters(void *Context, uintptr_t &PC, uintptr_t &FP, uintptr_t &SP) {
+    ucontext_t *UC = (ucontext_t *)Context;
+#if defined(__linux__) && defined(__x86_64__)
+    PC = UC->uc_mcontext.gregs[REG_RIP];
+    FP = UC->uc_mcontext.gregs[REG_RBP];
+    SP = UC->uc_mcontext.gregs[REG_RSP];
+#elif defined(__linux__) && defined(__aarch64__)
+    PC = UC->uc_mcontext.pc;
+    FP = UC->uc_mcontext.regs[29];
+    SP = UC->uc_mcontext.sp;
+#elif defined(__APPLE__) && defined(__x86_64__)
+    PC = UC->uc_mcontext->__ss.__rip;
+    FP = UC->uc_mcontext->__ss.__rbp;
+    SP = UC->uc_mcontext->__ss.__rsp;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    PC = UC->uc_mcontext->__ss.__pc;
+    FP = UC->uc_mcontext->__ss.__fp;
+    SP = UC->uc_mcontext->__ss.__sp;
+#else
+    (void)UC;
+    return false;
+#endif
+    return true;
+}
+
+static void countSampledTotal(ProfileStats *S, uint64_t Sample) {
+    if (S->Mark != Sample) {
+        S->Mark = Sample;
+        S->Total++;
+    }
+}
+
+// Code yorkie didn't compile (libm, libc) may not keep a frame pointer, so
+// the yorkie function that called it is found by its return address: the
+// first word on the stack that points into yorkie code. Only the part of the
+// stack known to hold frames is read. Returns the slot, or 0.
+static const uint32_t ProfileMaxScan = 1024;
+
+static uintptr_t findReturnSlot(uintptr_t SP) {
+    for (uint32_t i = 0; i != ProfileMaxScan; ++i) {
+        uintptr_t Slot = SP + i * sizeof(uintptr_t);
+        if (Slot > ProfileStackTop)
+            break;
+        if (findSampledSite(*(const uintptr_t *)Slot - 1))
+            return Slot;
+    }
+    return 0;
+}
+
+// Called for every sample. The interrupted function gets the sample as self
+// time, it and every caller up the frame pointer chain as total time. The
+// walk stops at the first return address outside yorkie code: only frames of
+// yorkie code are known to have a frame pointer.
+static void sampleProfile(int, siginfo_t *, void *Context) {
+    uint64_t Sample = ++ProfileSamples;
+    uintptr_t PC, FP, SP;
+    if (!getSampledRegisters(Context, PC, FP, SP)) {
+        ProfileOtherSamples++;
+        return;
+    }
+
+    ProfileSite *Callee = findSampledSite(PC);
+    if (Callee) {
+        Callee->Stats->Self++;
+        countSampledTotal(Callee->Stats, Sample);
+    } else {
+        ProfileOtherSamples++;
+        uintptr_t Slot = findReturnSlot(SP);
+        if (!Slot)
+            return;
+        Callee = findSampledSite(*(const uintptr_t *)Slot - 1);
+        countSampledTotal(Callee->Stats, Sample);
+
+        // The frame pointer is the caller's, unless the other code pushed a
+        // frame record right below the return address.
+        if (FP == Slot - sizeof(uintptr_t))
+            FP = *(const uintptr_t *)FP;
+        SP = Slot + sizeof(uintptr_t);
+        if (FP > ProfileStackTop)
+            return;
+    }
+
+    for (uint32_t Depth = 0; Depth != ProfileMaxDepth; ++Depth) {
+        if (FP < SP || FP % sizeof(uintptr_t))
+            break;
+        const uintptr_t *Frame = (const uintptr_t *)FP;
+        ProfileSite *Caller = findSampledSite(Frame[1] - 1);
+        if (!Caller)
+            break;
+
+        countSampledTotal(Caller->Stats, Sample);
+        ProfileEdge *E = getSampledEdge(Caller->Stats, Callee);
+        if (E && E->Mark != Sample) {
+            E->Mark = Sample;
+            E->Total++;
+        }
+        if (FP > ProfileStackTop)
+            ProfileStackTop = FP;
+
+        // Frames only go up the stack.
+        Callee = Caller;
+        SP = FP + 2 * sizeof(uintptr_t);
+        FP = Frame[0];
+    }
+}
+
+static void startProfile(bool Sampling) {
+    ProfileSampling = Sampling;
+    ProfileStartNanos = readNanos();
+    ProfileStartTicks = readTicks();
+    ProfileStartClock = clock();
+    atexit(printProfile);
+    if (!Sampling)
+        return;
+
+    struct sigaction SA;
+    memset(&SA, 0, sizeof(SA));
+    SA.sa_sigaction = sampleProfile;
+    SA.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigaction(SIGPROF, &SA, nullptr);
+
+    struct itimerval Timer;
+    Timer.it_interval.tv_sec = 0;
+    Timer.it_interval.tv_usec = ProfileIntervalUS;
+    Timer.it_value = Timer.it_interval;
+    setitimer(ITIMER_PROF, &Timer, nullptr);
+}
+
+static ProfileStats *getProfileStats(ProfileSite *Site, bool Sampling) {
+    if (Site->Stats)
+        return Site->Stats;
+    if (!ProfileSites)
+        startProfile(Sampling);
+
+    Site->Stats = (ProfileStats *)calloc(1, sizeof(ProfileStats));
+    *ProfileSitesTail = Site;
+    ProfileSitesTail = &Site->Stats->Next;
+    return Site->Stats;
+}
+
+static ProfileEdge *getProfileEdge(ProfileStats *Caller, ProfileSite *Callee) {
+    for (ProfileEdge *E = Caller->Callees; E; E = E->Next)
+        if (E->Callee == Callee)
+            return E;
+
+    ProfileEdge *E = (ProfileEdge *)calloc(1, sizeof(ProfileEdge));
+    E->Callee = Callee;
+    E->Next = Caller->Callees;
+    Caller->Callees = E;
+    return E;
+}
+
+extern "C" void __yorkie_prof_enter(ProfileSite *Site) {
+    ProfileStats *S = getProfileStats(Site, false);
+    S->Calls++;
+
+    uint32_t Depth = ProfileDepth++;
+    if (Depth >= ProfileMaxDepth)
+        return;
+    ProfileFrame *F = &ProfileStack[Depth];
+    F->Site = Site;
+    F->Edge = Depth ? getProfileEdge(ProfileStack[Depth - 1].Site->Stats, Site) : nullptr;
+    if (F->Edge)
+        F->Edge->Calls++;
+    F->Children = 0;
+    S->Active++;
+    F->Start = readTicks();
+}
+
+extern "C" void __yorkie_prof_exit() {
+    uint64_t Now = readTicks();
+    uint32_t Depth = --ProfileDepth;
+    if (Depth >= ProfileMaxDepth)
+        return;
+
+    ProfileFrame *F = &ProfileStack[Depth];
+    ProfileStats *S = F->Site->Stats;
+    S->Active--;
+    uint64_t Elapsed = Now - F->Start;
+    S->Self += Elapsed > F->Children ? Elapsed - F->Children : 0;
+    if (S->Active == 0) {
+        S->Total += Elapsed;
+        if (F->Edge)
+            F->Edge->Total += Elapsed;
+    }
+    if (F != ProfileStack)
+        F[-1].Children += Elapsed;
+}
+
+// Functions of the same name share a site, so a function redefined in a
+// later module (or a REPL expression) has one line in the report.
+static ProfileSite *getSampledSite(const char *Name) {
+    for (ProfileSite *S = ProfileSites; S; S = S->Stats->Next)
+        if (strcmp(S->Name, Name) == 0)
+            return S;
+
+    // The module holding the name may be removed from the JIT, keep a copy.
+    ProfileSite *Site = (ProfileSite *)malloc(sizeof(ProfileSite));
+    Site->Name = strdup(Name);
+    Site->Stats = nullptr;
+    getProfileStats(Site, true);
+    return Site;
+}
+
+static int compareSampledCode(const void *A, const void *B) {
+    uintptr_t SA = ((const SampledCode *)A)->Start;
+    uintptr_t SB = ((const SampledCode *)B)->Start;
+    return SA < SB ? -1 : SA > SB ? 1 : 0;
+}
+
+// Called once per module with the addresses of its Size functions, and the
+// end of its code in Functions[Size]. A global constructor calls it for
+// compiled programs, the JIT calls it after adding the module.
+extern "C" void __yorkie_prof_sample_register(const char **Names, void **Functions,
+        uint64_t Size) {
+    // The signal handler reads the table.
+    sigset_t Block, Old;
+    sigemptyset(&Block);
+    sigaddset(&Block, SIGPROF);
+    sigprocmask(SIG_BLOCK, &Block, &Old);
+
+    uintptr_t End = (uintptr_t)Functions[Size];
+    uintptr_t Begin = End;
+    for (uint64_t i = 0; i != Size; ++i)
+        if ((uintptr_t)Functions[i] < Begin)
+            Begin = (uintptr_t)Functions[i];
+
+    // The JIT reuses the memory of removed modules, forget what was there.
+    size_t Kept = 0;
+    for (size_t i = 0; i != SampledCodeSize; ++i)
+        if (SampledCodeTable[i].Start < Begin || SampledCodeTable[i].Start > End)
+            SampledCodeTable[Kept++] = SampledCodeTable[i];
+    SampledCodeSize = Kept;
+
+    if (SampledCodeSize + Size + 1 > SampledCodeCapacity) {
+        SampledCodeCapacity = (SampledCodeSize + Size + 1) * 2;
+        SampledCodeTable = (SampledCode *)realloc(SampledCodeTable,
+                SampledCodeCapacity * sizeof(SampledCode));
+    }
+    for (uint64_t i = 0; i != Size; ++i)
+        SampledCodeTable[SampledCodeSize++] = SampledCode{(uintptr_t)Functions[i],
+                                                          getSampledSite(Names[i])};
+    SampledCodeTable[SampledCodeSize++] = SampledCode{End, nullptr};
+    qsort(SampledCodeTable, SampledCodeSize, sizeof(SampledCode), compareSampledCode);
+
+    sigprocmask(SIG_SETMASK, &Old, nullptr);
+}
+
+static int compareProfileSelf(const void *A, const void *B) {
+    uint64_t SA = (*(ProfileSite *const *)A)->Stats->Self;
+    uint64_t SB = (*(ProfileSite *const *)B)->Stats->Self;
+    return SA < SB ? 1 : SA > SB ? -1 : 0;
+}
+
+static void printProfile() {
+    // Convert ticks or samples to milliseconds.
+    double MSPerUnit;
+    if (ProfileSampling) {
+        struct itimerval Off;
+        memset(&Off, 0, sizeof(Off));
+        setitimer(ITIMER_PROF, &Off, nullptr);
+        // The timer fires at the kernel's tick rate if that is coarser than
+        // the interval asked for, spread the CPU time used over the samples.
+        double CPUMillis = (double)(clock() - ProfileStartClock) * 1000.0 / CLOCKS_PER_SEC;
+        MSPerUnit = ProfileSamples ? CPUMillis / ProfileSamples : 0;
+    } else {
+        uint64_t Ticks = readTicks() - ProfileStartTicks;
+        uint64_t Nanos = readNanos() - ProfileStartNanos;
+        MSPerUnit = Ticks ? Nanos / 1e6 / Ticks : 0;
+    }
+
+    // Sampling registers every function of the program, only the ones that
+    // were seen are reported.
+    uint64_t N = 0, TotalSelf = 0;
+    for (ProfileSite *S = ProfileSites; S; S = S->Stats->Next) {
+        ++N;
+        TotalSelf += S->Stats->Self;
+    }
+    ProfileSite **Sorted = (ProfileSite **)malloc(N * sizeof(ProfileSite *));
+    N = 0;
+    for (ProfileSite *S = ProfileSites; S; S = S->Stats->Next)
+        if (!ProfileSampling || S->Stats->Total)
+            Sorted[N++] = S;
+    qsort(Sorted, N, sizeof(ProfileSite *), compareProfileSelf);
+
+    if (ProfileSampling)
+        fprintf(stderr, "\nFlat profile (%llu samples, %llu outside yorkie code)\n",
+                (unsigned long long)ProfileSamples, (unsigned long long)ProfileOtherSamples);
+    else
+        fprintf(stderr, "\nFlat profile (entry/exit hooks)\n");
+    fprintf(stderr, "  Self%%   Self(ms)  Total(ms)        Calls  Function\n");
+    for (uint64_t i = 0; i != N; ++i) {
+        ProfileStats *S = Sorted[i]->Stats;
+        double SelfPercent = TotalSelf ? S->Self * 100.0 / TotalSelf : 0.0;
+        // Sampling doesn't count calls.
+        if (ProfileSampling)
+            fprintf(stderr, "%6.1f%% %10.3f %10.3f %12s  %s\n", SelfPercent,
+                    S->Self * MSPerUnit, S->Total * MSPerUnit, "-", Sorted[i]->Name);
+        else
+            fprintf(stderr, "%6.1f%% %10.3f %10.3f %12llu  %s\n", SelfPercent,
+                    S->Self * MSPerUnit, S->Total * MSPerUnit,
+                    (unsigned long long)S->Calls, Sorted[i]->Name);
+    }
+
+    fprintf(stderr, "\nCall graph (callees of each function, with their time when called from it)\n");
+    fprintf(stderr, "  Total(ms)        Calls  Function\n");
+    for (uint64_t i = 0; i != N; ++i) {
+        ProfileStats *S = Sorted[i]->Stats;
+        if (ProfileSampling)
+            fprintf(stderr, "%11.3f %12s  %s\n", S->Total * MSPerUnit, "-", Sorted[i]->Name);
+        else
+            fprintf(stderr, "%11.3f %12llu  %s\n", S->Total * MSPerUnit,
+                    (unsigned long long)S->Calls, Sorted[i]->Name);
+        for (ProfileEdge *E = S->Callees; E; E = E->Next) {
+            if (ProfileSampling)
+                fprintf(stderr, "%11.3f %12s      %s\n", E->Total * MSPerUnit, "-", E->Callee->Name);
+            else
+                fprintf(stderr, "%11.3f %12llu      %s\n", E->Total * MSPerUnit,
+                        (unsigned long long)E->Calls, E->Callee->Name);
+        }
+    }
+    free(Sorted);
+}
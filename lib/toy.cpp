@@ -1,25 +1,46 @@
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/Analysis/BasicAliasAnalysis.h"
 #include "llvm/Analysis/Passes.h"
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Linker/Linker.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <map>
+#include <set>
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
+#include <thread>
 #include <vector>
 #include <iostream>
 #include <memory>
@@ -28,18 +49,134 @@
 #include "AST.h"
 #include "Parser.h"
 #include "Utils.h"
+#include "Evaluator.h"
+#include "Inliner.h"
+#include "TimeReport.h"
+#include "PerfMapListener.h"
+#include "SPSCQueue.h"
+#include "Yorkie.h"
 
 using namespace llvm;
 using namespace llvm::orc;
 
+// Command line options
+enum ProfilerKind { NoProfiler, CountingProfiler, SamplingProfiler };
+enum VectorLibraryKind { NoVectorLibrary, LibmvecLibrary, SleefLibrary };
+enum FPModelKind { StrictFPModel, PreciseFPModel, FastFPModel };
+enum DebugInfoKind { NoDebugInfo, LineTablesOnly, FullDebugInfo };
+
+// The category is created on first use, so tools can add options to it from
+// their own static initializers.
+cl::OptionCategory &Yorkie::getOptionCategory() {
+    static cl::OptionCategory Category("Compiler Options",
+            "Options for controlling the compilation process.");
+    return Category;
+}
+static cl::OptionCategory &CompilerCategory = Yorkie::getOptionCategory();
+
+static cl::opt<std::string>
+RuntimeDir("runtime-dir", cl::desc("Directory holding stdlib.ll and parallel.ll (default: lib)"),
+           cl::init("lib"), cl::value_desc("directory"), cl::cat(CompilerCategory));
+static cl::opt<unsigned>
+ConstEvalBudget("const-eval-budget",
+                cl::desc("Steps allowed when evaluating a constant call at compile time (0 disables)"),
+                cl::init(1000000), cl::value_desc("steps"), cl::cat(CompilerCategory));
+static cl::opt<unsigned>
+OptLevel("O", cl::desc("Optimization level (0-3)"), cl::Prefix, cl::ZeroOrMore,
+         cl::init(0), cl::value_desc("level"), cl::cat(CompilerCategory));
+static cl::opt<unsigned>
+InlineThreshold("inline-threshold",
+                cl::desc("Max size (in AST nodes) of a leaf function marked for inlining"),
+                cl::init(32), cl::value_desc("nodes"), cl::cat(CompilerCategory));
+static cl::opt<std::string>
+ProfileGenerate("profile-generate",
+                cl::desc("Instrument the program to write an execution profile to <file> at exit"),
+                cl::value_desc("file"), cl::cat(CompilerCategory));
+static cl::opt<std::string>
+ProfileUse("profile-use", cl::desc("Optimize using an execution profile written by -profile-generate"),
+           cl::value_desc("file"), cl::cat(CompilerCategory));
+static cl::opt<bool>
+TimeReportOpt("time-report", cl::desc("Print the time and memory used by each compiler phase"),
+              cl::init(false), cl::cat(CompilerCategory));
+static cl::opt<std::string>
+TimeReportJSON("time-report-json", cl::desc("Write the -time-report data as JSON to <file>"),
+               cl::value_desc("file"), cl::cat(CompilerCategory));
+static cl::opt<bool>
+WholeProgram("whole-program",
+             cl::desc("Treat the input as the whole program: only main and externs stay external, "
+                      "functions not reachable from main are dropped"),
+             cl::init(false), cl::cat(CompilerCategory));
+static cl::opt<ProfilerKind>
+ProfilerMode("profile", cl::desc("Profile the program, printing a report at exit:"),
+             cl::init(NoProfiler), cl::cat(CompilerCategory),
+             cl::values(clEnumValN(CountingProfiler, "count",
+                                   "Time every call with entry/exit hooks"),
+                        clEnumValN(SamplingProfiler, "sample",
+                                   "Sample the call stack for time, without instrumenting calls"),
+                        clEnumValEnd));
+static cl::opt<bool>
+PerfMap("perf-map", cl::desc("Write /tmp/perf-<pid>.map entries for JIT compiled functions (-repl or the library)"),
+        cl::init(false), cl::cat(CompilerCategory));
+static cl::opt<unsigned>
+VectorWidth("vector-width",
+            cl::desc("Lanes of vec() vectors, a power of two (default: fill a vector register of the target)"),
+            cl::init(0), cl::value_desc("lanes"), cl::cat(CompilerCategory));
+static cl::list<std::string>
+BatchFunctions("batch", cl::desc("Generate <name>_batch, evaluating <name> over columns of arguments"),
+               cl::CommaSeparated, cl::value_desc("function,..."), cl::cat(CompilerCategory));
+static cl::opt<VectorLibraryKind>
+VectorLibrary("vector-library", cl::desc("Vector math library the loop vectorizer may call:"),
+              cl::init(NoVectorLibrary), cl::cat(CompilerCategory),
+              cl::values(clEnumValN(NoVectorLibrary, "none", "No vector math library"),
+                         clEnumValN(LibmvecLibrary, "libmvec", "glibc's libmvec (x86-64)"),
+                         clEnumValN(SleefLibrary, "sleef", "SLEEF, link with -lsleef"),
+                         clEnumValEnd));
+static cl::opt<bool>
+Pipelined("pipeline", cl::desc("Parse on a separate thread, overlapping with code generation"),
+          cl::init(false), cl::cat(CompilerCategory));
+static cl::opt<std::string>
+StreamDir("stream-dir",
+          cl::desc("Stream the output: write the optimized code to <dir> as a module per -stream-batch definitions, "
+                   "freeing it as it goes"),
+          cl::value_desc("dir"), cl::cat(CompilerCategory));
+static cl::opt<unsigned>
+StreamBatch("stream-batch", cl::desc("Definitions per module with -stream-dir (default: 1000)"),
+            cl::init(1000), cl::value_desc("n"), cl::cat(CompilerCategory));
+static cl::opt<std::string>
+TargetCPU("mcpu", cl::desc("CPU to generate code for, 'native' for the host's "
+                           "(default: native for JIT compiled code, generic for printed IR)"),
+          cl::init("native"), cl::value_desc("cpu-name"), cl::cat(CompilerCategory));
+static cl::list<std::string>
+TargetAttrs("mattr", cl::desc("Target features to enable (+feature) or disable (-feature)"),
+            cl::CommaSeparated, cl::value_desc("+a1,-a2,..."), cl::cat(CompilerCategory));
+static cl::opt<FPModelKind>
+FPModel("ffp-model", cl::desc("Floating point model:"), cl::init(PreciseFPModel), cl::cat(CompilerCategory),
+        cl::values(clEnumValN(StrictFPModel, "strict", "IEEE arithmetic, multiplies and adds are never fused"),
+                   clEnumValN(PreciseFPModel, "precise",
+                              "IEEE arithmetic, multiplies and adds may be fused into FMAs (default)"),
+                   clEnumValN(FastFPModel, "fast",
+                              "Reassociate, use reciprocals, assume no NaNs or infinities"),
+                   clEnumValEnd));
+static cl::opt<DebugInfoKind>
+DebugInfoLevel(cl::desc("Debug information:"), cl::init(NoDebugInfo), cl::cat(CompilerCategory),
+               cl::values(clEnumValN(NoDebugInfo, "g0", "None (default)"),
+                          clEnumValN(LineTablesOnly, "gline-tables-only", "Line tables only"),
+                          clEnumValN(FullDebugInfo, "g", "Line tables, functions and their arguments"),
+                          clEnumValEnd));
+
 // Lexer
 static Lexer::Lexer lexer;
 
+// Compile time report
+static Stats::TimeReport Report;
+
 // IR Builder.
 static IRBuilder<> Builder(getGlobalContext());
 
+// Without debug info TheCU is null, and the scopes on LexicalBlocks are too.
 struct DebugInfo {
     DICompileUnit *TheCU;
+    DIFile *TheFile;
     DIType *DblTy;
     std::vector<DIScope *> LexicalBlocks;
 
@@ -68,6 +205,8 @@ DIType *DebugInfo::getDoubleTy() {
 // Tells main IRBuilder where we are, but also what scope we are in.
 // Scope is a stack, can either be in the main file scope, or in the function scope etc.
 void DebugInfo::emitLocation(ExprAST *AST) {
+    if (!TheCU)
+        return;
     if (!AST)
         return Builder.SetCurrentDebugLocation(DebugLoc());
     DIScope *Scope;
@@ -79,8 +218,11 @@ void DebugInfo::emitLocation(ExprAST *AST) {
             DebugLoc::get(AST->getLine(), AST->getCol(), Scope));
 }
 
-static DISubroutineType *CreateFunctionType(unsigned NumArgs, DIFile *Unit) {
+// Line tables don't need types, the functions get an empty one.
+static DISubroutineType *CreateFunctionType(unsigned NumArgs) {
     SmallVector<Metadata *, 8> EltTys;
+    if (DebugInfoLevel == LineTablesOnly)
+        return DBuilder->createSubroutineType(DBuilder->getOrCreateTypeArray(EltTys));
     DIType *DblTy = KSDbgInfo.getDoubleTy();
 
     // Add the result type.
@@ -102,18 +244,83 @@ static DISubroutineType *CreateFunctionType(unsigned NumArgs, DIFile *Unit) {
 // Builder is a helper object that makes it easy to generate LLVM instructions.
 // NamedValues keeps track of which values are defined in the current scope,
 // and what their LLVM representation is.
-// NamedValues holds the memory location of each mutable variable.
+// NamedValues holds the memory location of each mutable variable, and the
+// value itself of the others (see BindVariable()).
+// FunctionDefs holds the AST of every function that was generated successfully,
+// for the passes that work on the AST (inlining, compile-time evaluation).
+// DefinedNames holds the name of every function ever defined with 'def'. Unlike
+// FunctionDefs it survives module switches in the REPL and -stream-dir, where
+// earlier definitions are only declarations in the current module.
+// StreamedNames holds the functions defined in modules already written to
+// -stream-dir, so they can't be defined again in a later one.
 static std::unique_ptr<Module> TheModule;
-static std::map<std::string, AllocaInst*> NamedValues;
+static std::map<std::string, Value*> NamedValues;
+static std::set<std::string> AssignedNames;
 static std::unique_ptr<llvm::legacy::FunctionPassManager> TheFPM;
 static std::unique_ptr<KaleidoscopeJIT> TheJIT;
+static std::unique_ptr<Profiling::PerfMapListener> PerfMapWriter;
 static std::map<std::string, std::unique_ptr<PrototypeAST>> FunctionProtos;
+static FunctionDefMap FunctionDefs;
+static std::set<std::string> DefinedNames;
+static std::set<std::string> StreamedNames;
+static std::unique_ptr<Eval::Interpreter> ConstEval;
+static std::unique_ptr<Inline::Inliner> TheInliner;
+
+// The JIT's target machine is for -mcpu, the host's CPU by default. Code that
+// is printed instead is for the target's generic CPU unless -mcpu is given, so
+// it runs on any machine, with the features of -mattr. CompilingForJIT is set
+// when the Context is created for the JIT (Yorkie::CodeTarget), or by
+// runInteractive(), before anything is compiled.
+static bool CompilingForJIT = false;
+static std::unique_ptr<TargetMachine> GenericTM;
+
+// getCodeTarget - The target machine the IR is generated and optimized for.
+static TargetMachine &getCodeTarget() {
+    TargetMachine &JITTM = TheJIT->getTargetMachine();
+    if (CompilingForJIT || TargetCPU.getNumOccurrences())
+        return JITTM;
+    if (!GenericTM)
+        GenericTM.reset(JITTM.getTarget().createTargetMachine(
+                JITTM.getTargetTriple().str(), "generic",
+                join(TargetAttrs.begin(), TargetAttrs.end(), ","), JITTM.Options));
+    return *GenericTM;
+}
 
 // CreateEntryBlockAlloca - Create an alloca instruction in the entry block of the function.
 // This is used for mutable variables etc.
-static AllocaInst *CreateEntryBlockAlloca(Function *TheFunction, const std::string &VarName) {
+static AllocaInst *CreateEntryBlockAlloca(Function *TheFunction, const std::string &VarName,
+        Type *Ty = Type::getDoubleTy(getGlobalContext())) {
     IRBuilder<> TmpB(&TheFunction->getEntryBlock(), TheFunction->getEntryBlock().begin());
-    return TmpB.CreateAlloca(Type::getDoubleTy(getGlobalContext()), 0, VarName.c_str());
+    return TmpB.CreateAlloca(Ty, 0, VarName.c_str());
+}
+
+// BindVariable - The binding of a new variable holding Val. Only variables
+// whose name is assigned with '=' somewhere in the function get a stack slot,
+// the others are bound to their SSA value, so there's nothing for mem2reg to
+// clean up and -O0 code doesn't go through memory.
+static Value *BindVariable(Function *TheFunction, const std::string &VarName, Value *Val) {
+    if (!AssignedNames.count(VarName)) {
+        if (isa<Instruction>(Val) && !Val->hasName())
+            Val->setName(VarName);
+        return Val;
+    }
+    AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, VarName, Val->getType());
+    Builder.CreateStore(Val, Alloca);
+    return Alloca;
+}
+
+// The value of a variable bound by BindVariable(). Variables are never
+// pointers, so a binding that is an alloca is always a stack slot.
+static Value *LoadVariable(Value *Binding, const std::string &VarName) {
+    if (isa<AllocaInst>(Binding))
+        return Builder.CreateLoad(Binding, VarName.c_str());
+    return Binding;
+}
+
+static Type *getVariableType(const Value *Binding) {
+    if (auto *Alloca = dyn_cast<AllocaInst>(Binding))
+        return Alloca->getAllocatedType();
+    return Binding->getType();
 }
 
 Function *getFunction(std::string Name) {
@@ -130,6 +337,689 @@ Function *getFunction(std::string Name) {
     return nullptr;
 }
 
+// EmitCall - Emit a call to F, using the calling convention of F.
+static CallInst *EmitCall(Function *F, ArrayRef<Value *> Args, const Twine &Name) {
+    CallInst *Call = Builder.CreateCall(F, Args, Name);
+    Call->setCallingConv(F->getCallingConv());
+    return Call;
+}
+
+// ================================================================
+// Arrays
+// ================================================================
+
+// Arrays are { double *data, i64 length } values. Functions take them as a
+// noalias, aligned data pointer and a length, which is all the vectorizer
+// needs to know about them. The data comes from __yorkie_array_alloc in
+// lib/stdlib.cpp, aligned to ArrayAlign.
+static const unsigned ArrayAlign = 64;
+
+static StructType *getArrayTy() {
+    LLVMContext &C = getGlobalContext();
+    return StructType::get(Type::getDoublePtrTy(C), Type::getInt64Ty(C), nullptr);
+}
+
+static bool isArray(Value *V) {
+    return V->getType() == getArrayTy();
+}
+
+// ExpectNumber - Returns V, or reports an error if it is an array or a vector.
+static Value *ExpectNumber(Value *V) {
+    if (V && isArray(V))
+        return ErrorV("expected a number, found an array");
+    if (V && V->getType()->isVectorTy())
+        return ErrorV("expected a number, found a vector");
+    return V;
+}
+
+// ExpectNumberOrVector - Returns V, or reports an error if it is an array.
+static Value *ExpectNumberOrVector(Value *V) {
+    if (V && isArray(V))
+        return ErrorV("expected a number, found an array");
+    return V;
+}
+
+static Value *MakeArray(Value *Data, Value *Length) {
+    Value *Array = Builder.CreateInsertValue(UndefValue::get(getArrayTy()), Data, 0);
+    return Builder.CreateInsertValue(Array, Length, 1, "array");
+}
+
+// Array variables bound to another one's array ("var b = a", or a copy made
+// for a parfor body), mapped to the binding of the variable the array came
+// from: a "var a[n]" or an argument. Calls use it to tell whether two
+// arguments are the same array.
+static std::map<const Value *, const Value *> ArrayOrigins;
+
+static const Value *getArrayOrigin(const Value *Binding) {
+    auto I = ArrayOrigins.find(Binding);
+    return I == ArrayOrigins.end() ? Binding : I->second;
+}
+
+// The variables of counted loops (see ForExprAST::codegenCounted), with their
+// value as an integer. Indexing with one keeps the address an affine function
+// of the loop counter, which the vectorizer needs.
+static std::map<const Value *, Value *> LoopIndices;
+
+// EmitIndex - Generate an array index as an i64. The integer counter of a
+// counted loop is used directly.
+static Value *EmitIndex(ExprAST &Index) {
+    if (VariableExprAST *Var = dyn_cast<VariableExprAST>(&Index)) {
+        auto NV = NamedValues.find(Var->getName());
+        if (NV != NamedValues.end()) {
+            auto LI = LoopIndices.find(NV->second);
+            if (LI != LoopIndices.end())
+                return LI->second;
+        }
+    }
+
+    Value *IndexV = ExpectNumber(Index.codegen());
+    if (!IndexV)
+        return nullptr;
+    return Builder.CreateFPToSI(IndexV, Type::getInt64Ty(getGlobalContext()), "idx");
+}
+
+// EmitElementAddress - Generate the address of element Index of ArrayV.
+// Elements aren't bounds checked.
+static Value *EmitElementAddress(Value *ArrayV, ExprAST &Index) {
+    if (!isArray(ArrayV))
+        return ErrorV("expected an array");
+    Value *IndexV = EmitIndex(Index);
+    if (!IndexV)
+        return nullptr;
+    Value *Data = Builder.CreateExtractValue(ArrayV, 0, "data");
+    return Builder.CreateInBoundsGEP(Data, IndexV, "elt");
+}
+
+// ================================================================
+// Vectors
+// ================================================================
+
+// Vectors are <N x double> values, built with vec(x) for the host width or
+// vec2/vec4/vec8(...) for a fixed one. The builtin operators work on them lane
+// by lane, a number used with a vector is used for every lane. Vectors can be
+// held in variables and passed to the vector builtins, but functions only take
+// and return numbers.
+//
+// The builtins are only used when no function of the same name exists:
+//   vec(x), vec2(a, b), vec4(a, b, c, d), vec8(...)  build a vector
+//   lane(v, i), setlane(v, i, x)                     read and replace a lane
+//   shuffle(v, i...), shuffle(v, w, i...)            pick lanes by constant index
+//   hadd(v), hmul(v), hmin(v), hmax(v)               reduce the lanes to a number
+//   vload(a, i), vstore(a, i, v)                     host width access to a[i...]
+
+static bool isVector(Value *V) {
+    return V->getType()->isVectorTy();
+}
+
+// getTargetVectorLanes - The doubles that fit in a vector register of the
+// code's target when compiling F, at least 2.
+static unsigned getTargetVectorLanes(const Function &F) {
+    TargetTransformInfo TTI = getCodeTarget().getTargetIRAnalysis().run(F);
+    return std::max(TTI.getRegisterBitWidth(true) / 64, 2u);
+}
+
+// The lanes of a vector register of the target, once asked for. Reset by the
+// Context, the next one can be for another CPU.
+static unsigned TargetWidth = 0;
+
+// getVectorWidth - The lanes of vec(x), by default enough doubles to fill a
+// vector register of the target.
+static unsigned getVectorWidth() {
+    if (VectorWidth)
+        return VectorWidth;
+    if (!TargetWidth)
+        TargetWidth = getTargetVectorLanes(*Builder.GetInsertBlock()->getParent());
+    return TargetWidth;
+}
+
+// ExpectVector - Returns V, or reports an error if it isn't a vector.
+static Value *ExpectVector(Value *V) {
+    if (V && !isVector(V))
+        return ErrorV("expected a vector");
+    return V;
+}
+
+// MatchLanes - Splats a number used with a vector. Returns false if L and R
+// are vectors of different widths.
+static bool MatchLanes(Value *&L, Value *&R) {
+    Type *LTy = L->getType(), *RTy = R->getType();
+    if (LTy == RTy)
+        return true;
+    if (!isVector(L) && isVector(R))
+        L = Builder.CreateVectorSplat(RTy->getVectorNumElements(), L);
+    else if (isVector(L) && !isVector(R))
+        R = Builder.CreateVectorSplat(LTy->getVectorNumElements(), R);
+    else
+        return false;
+    return true;
+}
+
+static bool isVectorBuiltin(StringRef Name) {
+    return StringSwitch<bool>(Name)
+        .Cases("vec", "vec2", "vec4", "vec8", true)
+        .Cases("lane", "setlane", "shuffle", true)
+        .Cases("hadd", "hmul", "hmin", "hmax", true)
+        .Cases("vload", "vstore", true)
+        .Default(false);
+}
+
+// EmitLaneIndex - Lane indices are i32, lanes out of range give undefined values.
+static Value *EmitLaneIndex(Value *Index) {
+    if (!ExpectNumber(Index))
+        return nullptr;
+    return Builder.CreateFPToSI(Index, Type::getInt32Ty(getGlobalContext()), "lane");
+}
+
+// EmitHorizontal - Reduce the lanes of V by combining its upper half with its
+// lower half until one lane is left. Widths are powers of two.
+static Value *EmitHorizontal(StringRef Name, Value *V) {
+    Type *Int32Ty = Type::getInt32Ty(getGlobalContext());
+    unsigned Width = V->getType()->getVectorNumElements();
+    for (unsigned Half = Width / 2; Half; Half /= 2) {
+        SmallVector<Constant *, 8> Mask;
+        for (unsigned i = 0; i != Width; ++i)
+            Mask.push_back(i < Half ? ConstantInt::get(Int32Ty, i + Half) : UndefValue::get(Int32Ty));
+        Value *Upper = Builder.CreateShuffleVector(V, UndefValue::get(V->getType()),
+                ConstantVector::get(Mask), "upper");
+        if (Name == "hadd")
+            V = Builder.CreateFAdd(V, Upper, "hadd");
+        else if (Name == "hmul")
+            V = Builder.CreateFMul(V, Upper, "hmul");
+        else if (Name == "hmin")
+            V = Builder.CreateSelect(Builder.CreateFCmpOLT(V, Upper), V, Upper, "hmin");
+        else
+            V = Builder.CreateSelect(Builder.CreateFCmpOGT(V, Upper), V, Upper, "hmax");
+    }
+    return Builder.CreateExtractElement(V, ConstantInt::get(Int32Ty, 0), Name);
+}
+
+// EmitVectorBuiltin - Generate a call to one of the vector builtins.
+static Value *EmitVectorBuiltin(StringRef Name, ArrayRef<std::unique_ptr<ExprAST>> Args) {
+    LLVMContext &C = getGlobalContext();
+    Type *Int32Ty = Type::getInt32Ty(C);
+
+    // vload and vstore index arrays like a[i] does.
+    if (Name == "vload" || Name == "vstore") {
+        if (Args.size() != (Name == "vload" ? 2u : 3u))
+            return ErrorV("Incorrect # arguments passed");
+        Value *ArrayV = Args[0]->codegen();
+        if (!ArrayV)
+            return nullptr;
+        Value *Element = EmitElementAddress(ArrayV, *Args[1]);
+        if (!Element)
+            return nullptr;
+
+        // Array elements are only aligned to a double.
+        if (Name == "vload") {
+            Type *VecTy = VectorType::get(Type::getDoubleTy(C), getVectorWidth());
+            Value *Ptr = Builder.CreateBitCast(Element, VecTy->getPointerTo());
+            return Builder.CreateAlignedLoad(Ptr, 8, "vload");
+        }
+        Value *V = ExpectVector(Args[2]->codegen());
+        if (!V)
+            return nullptr;
+        Value *Ptr = Builder.CreateBitCast(Element, V->getType()->getPointerTo());
+        Builder.CreateAlignedStore(V, Ptr, 8);
+        return V;
+    }
+
+    std::vector<Value *> ArgsV;
+    for (auto &Arg : Args) {
+        Value *V = ExpectNumberOrVector(Arg->codegen());
+        if (!V)
+            return nullptr;
+        ArgsV.push_back(V);
+    }
+
+    if (Name.startswith("vec")) {
+        unsigned Width = StringSwitch<unsigned>(Name)
+            .Case("vec2", 2).Case("vec4", 4).Case("vec8", 8)
+            .Default(getVectorWidth());
+        if (ArgsV.size() != 1 && ArgsV.size() != Width)
+            return ErrorV("Incorrect # arguments passed");
+        for (Value *V : ArgsV)
+            if (!ExpectNumber(V))
+                return nullptr;
+        if (ArgsV.size() == 1)
+            return Builder.CreateVectorSplat(Width, ArgsV[0], "vec");
+
+        Value *V = UndefValue::get(VectorType::get(Type::getDoubleTy(C), Width));
+        for (unsigned i = 0; i != Width; ++i)
+            V = Builder.CreateInsertElement(V, ArgsV[i], ConstantInt::get(Int32Ty, i), "vec");
+        return V;
+    }
+
+    if (Name == "lane" || Name == "setlane") {
+        if (ArgsV.size() != (Name == "lane" ? 2u : 3u))
+            return ErrorV("Incorrect # arguments passed");
+        if (!ExpectVector(ArgsV[0]))
+            return nullptr;
+        Value *Lane = EmitLaneIndex(ArgsV[1]);
+        if (!Lane)
+            return nullptr;
+        if (Name == "lane")
+            return Builder.CreateExtractElement(ArgsV[0], Lane, "lane");
+        if (!ExpectNumber(ArgsV[2]))
+            return nullptr;
+        return Builder.CreateInsertElement(ArgsV[0], ArgsV[2], Lane, "setlane");
+    }
+
+    if (Name == "shuffle") {
+        // The lanes of the second vector, if there is one, follow the lanes of the first.
+        if (ArgsV.empty() || !ExpectVector(ArgsV[0]))
+            return nullptr;
+        Value *V1 = ArgsV[0];
+        Value *V2 = UndefValue::get(V1->getType());
+        unsigned First = 1;
+        if (ArgsV.size() > 1 && isVector(ArgsV[1])) {
+            if (ArgsV[1]->getType() != V1->getType())
+                return ErrorV("vectors of different widths");
+            V2 = ArgsV[1];
+            First = 2;
+        }
+
+        unsigned Lanes = V1->getType()->getVectorNumElements() * (First == 2 ? 2 : 1);
+        unsigned Width = ArgsV.size() - First;
+        if (Width < 2 || (Width & (Width - 1)))
+            return ErrorV("shuffle must pick a power of two lanes");
+        SmallVector<Constant *, 8> Mask;
+        for (unsigned i = First, e = ArgsV.size(); i != e; ++i) {
+            auto *Index = dyn_cast<ConstantFP>(ArgsV[i]);
+            if (!Index)
+                return ErrorV("shuffle lanes must be constants");
+            double Lane = Index->getValueAPF().convertToDouble();
+            if (Lane != std::floor(Lane) || Lane < 0 || Lane >= Lanes)
+                return ErrorV("shuffle lane out of range");
+            Mask.push_back(ConstantInt::get(Int32Ty, (unsigned)Lane));
+        }
+        return Builder.CreateShuffleVector(V1, V2, ConstantVector::get(Mask), "shuffle");
+    }
+
+    // hadd, hmul, hmin and hmax
+    if (ArgsV.size() != 1)
+        return ErrorV("Incorrect # arguments passed");
+    if (!ExpectVector(ArgsV[0]))
+        return nullptr;
+    return EmitHorizontal(Name, ArgsV[0]);
+}
+
+// ================================================================
+// Math Library
+// ================================================================
+
+// Calls to well known libm externs are emitted as the matching intrinsic,
+// which LLVM can constant fold, vectorize and lower to single instructions.
+// A function defined in yorkie is always called as is, even from a later
+// module where it is only declared.
+struct MathIntrinsic {
+    const char *Name;
+    Intrinsic::ID ID;
+    unsigned NumArgs;
+};
+
+static const MathIntrinsic MathIntrinsics[] = {
+    { "sin", Intrinsic::sin, 1 },          { "cos", Intrinsic::cos, 1 },
+    { "exp", Intrinsic::exp, 1 },          { "exp2", Intrinsic::exp2, 1 },
+    { "log", Intrinsic::log, 1 },          { "log2", Intrinsic::log2, 1 },
+    { "log10", Intrinsic::log10, 1 },      { "sqrt", Intrinsic::sqrt, 1 },
+    { "fabs", Intrinsic::fabs, 1 },        { "floor", Intrinsic::floor, 1 },
+    { "ceil", Intrinsic::ceil, 1 },        { "trunc", Intrinsic::trunc, 1 },
+    { "round", Intrinsic::round, 1 },      { "rint", Intrinsic::rint, 1 },
+    { "nearbyint", Intrinsic::nearbyint, 1 },
+    { "pow", Intrinsic::pow, 2 },          { "copysign", Intrinsic::copysign, 2 },
+    { "fmin", Intrinsic::minnum, 2 },      { "fmax", Intrinsic::maxnum, 2 },
+    { "fma", Intrinsic::fma, 3 },
+};
+
+// EmitMathIntrinsic - Emit the intrinsic for a call to the extern Name, or
+// return null if it isn't a math function taking these arguments.
+static Value *EmitMathIntrinsic(StringRef Name, ArrayRef<Value *> Args) {
+    Type *DoubleTy = Type::getDoubleTy(getGlobalContext());
+    for (auto &M : MathIntrinsics) {
+        if (Name != M.Name)
+            continue;
+        if (Args.size() != M.NumArgs)
+            return nullptr;
+        for (Value *Arg : Args)
+            if (Arg->getType() != DoubleTy)
+                return nullptr;
+
+        Function *F = Intrinsic::getDeclaration(TheModule.get(), M.ID, DoubleTy);
+        Value *V = Builder.CreateCall(F, Args, Name);
+
+        // llvm.sqrt is undefined below -0.0, where libm returns a NaN.
+        if (M.ID == Intrinsic::sqrt) {
+            Value *Negative = Builder.CreateFCmpOLT(Args[0], ConstantFP::get(DoubleTy, 0.0));
+            V = Builder.CreateSelect(Negative, ConstantFP::getNaN(DoubleTy), V, Name);
+        }
+        return V;
+    }
+    return nullptr;
+}
+
+// With -vector-library the loop vectorizer may replace intrinsic calls with
+// calls to a vector math library. The variants are for 2, 4 and 8 lanes, and
+// only those that fit in a vector register of the target are used.
+//   libmvec: glibc's vector math functions (x86-64, linked in by -lm)
+//   sleef:   the SLEEF library (-lsleef)
+struct VectorMathFunction {
+    const char *Intrinsic;
+    const char *Libmvec[3];
+    const char *Sleef[3];
+};
+
+static const VectorMathFunction VectorMathFunctions[] = {
+    { "llvm.sin.f64", { "_ZGVbN2v_sin", "_ZGVcN4v_sin", "_ZGVeN8v_sin" },
+      { "Sleef_sind2_u10", "Sleef_sind4_u10", "Sleef_sind8_u10" } },
+    { "llvm.cos.f64", { "_ZGVbN2v_cos", "_ZGVcN4v_cos", "_ZGVeN8v_cos" },
+      { "Sleef_cosd2_u10", "Sleef_cosd4_u10", "Sleef_cosd8_u10" } },
+    { "llvm.exp.f64", { "_ZGVbN2v_exp", "_ZGVcN4v_exp", "_ZGVeN8v_exp" },
+      { "Sleef_expd2_u10", "Sleef_expd4_u10", "Sleef_expd8_u10" } },
+    { "llvm.log.f64", { "_ZGVbN2v_log", "_ZGVcN4v_log", "_ZGVeN8v_log" },
+      { "Sleef_logd2_u10", "Sleef_logd4_u10", "Sleef_logd8_u10" } },
+    { "llvm.pow.f64", { "_ZGVbN2vv_pow", "_ZGVcN4vv_pow", "_ZGVeN8vv_pow" },
+      { "Sleef_powd2_u10", "Sleef_powd4_u10", "Sleef_powd8_u10" } },
+    { "llvm.exp2.f64", { nullptr, nullptr, nullptr },
+      { "Sleef_exp2d2_u10", "Sleef_exp2d4_u10", "Sleef_exp2d8_u10" } },
+    { "llvm.log2.f64", { nullptr, nullptr, nullptr },
+      { "Sleef_log2d2_u10", "Sleef_log2d4_u10", "Sleef_log2d8_u10" } },
+    { "llvm.log10.f64", { nullptr, nullptr, nullptr },
+      { "Sleef_log10d2_u10", "Sleef_log10d4_u10", "Sleef_log10d8_u10" } },
+};
+
+// CreateLibraryInfo - The target's library functions, plus the vector math
+// functions of -vector-library.
+static TargetLibraryInfoImpl *CreateLibraryInfo(const Module &M) {
+    auto *TLII = new TargetLibraryInfoImpl(getCodeTarget().getTargetTriple());
+    if (VectorLibrary == NoVectorLibrary)
+        return TLII;
+
+    // Any function will do to ask the target for its register width.
+    auto F = std::find_if(M.begin(), M.end(), [](const Function &F) { return !F.isDeclaration(); });
+    if (F == M.end())
+        return TLII;
+    unsigned MaxLanes = getTargetVectorLanes(*F);
+
+    std::vector<VecDesc> Functions;
+    for (auto &VF : VectorMathFunctions) {
+        for (unsigned i = 0, Lanes = 2; i != 3 && Lanes <= MaxLanes; ++i, Lanes *= 2) {
+            const char *Name = VectorLibrary == LibmvecLibrary ? VF.Libmvec[i] : VF.Sleef[i];
+            if (Name)
+                Functions.push_back({ VF.Intrinsic, Name, Lanes });
+        }
+    }
+    TLII->addVectorizableFunctions(Functions);
+    return TLII;
+}
+
+// ================================================================
+// Profile Guided Optimization Support
+// ================================================================
+
+// Every instrumentation point (function entry, each side of an if, loop body
+// and loop exit) reserves a counter key "<function>.<n>", in codegen order.
+// The same source compiled with the same options gets the same keys, which
+// is what ties a profile written by -profile-generate to -profile-use.
+// With -profile-generate each key gets an i64 counter that is incremented
+// where it is reserved, and the counters are handed to the runtime in
+// lib/stdlib.cpp which writes them out as "<key> <count>" lines at exit.
+// With -profile-use the counts are read back and turned into branch weights,
+// function entry counts and inlining hints.
+struct ProfileInfo {
+    bool Generate = false;
+    bool Use = false;
+    std::string FunctionName;
+    unsigned NextCounter = 0;
+    std::vector<std::pair<std::string, GlobalVariable *>> Counters;
+    std::map<std::string, uint64_t> Counts;
+    uint64_t MaxEntryCount = 0;
+
+    bool readProfile(const std::string &Path);
+    void beginFunction(const std::string &Name);
+    std::string emitCounter();
+    uint64_t getCount(const std::string &Key) const;
+    void setBranchWeights(BranchInst *Br, uint64_t TrueCount, uint64_t FalseCount);
+    void annotateFunction(Function *F, const std::string &EntryKey);
+    void finalize(const std::string &Path);
+} KSProfile;
+
+bool ProfileInfo::readProfile(const std::string &Path) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> FileOrErr = MemoryBuffer::getFile(Path);
+    if (!FileOrErr)
+        return false;
+
+    SmallVector<StringRef, 64> Lines;
+    FileOrErr.get()->getBuffer().split(Lines, "\n", -1, false);
+    for (StringRef Line : Lines) {
+        std::pair<StringRef, StringRef> KeyCount = Line.rsplit(' ');
+        uint64_t Count;
+        if (KeyCount.second.getAsInteger(10, Count))
+            continue;
+        Counts[KeyCount.first.str()] = Count;
+        // Counter 0 of each function counts its entries ("fib.0", not "fib.10").
+        if (KeyCount.first.rsplit('.').second == "0")
+            MaxEntryCount = std::max(MaxEntryCount, Count);
+    }
+    Use = true;
+    return true;
+}
+
+void ProfileInfo::beginFunction(const std::string &Name) {
+    FunctionName = Name;
+    NextCounter = 0;
+}
+
+// Reserves the next counter key, and in -profile-generate mode increments the
+// counter at the current insertion point.
+std::string ProfileInfo::emitCounter() {
+    std::string Key = FunctionName + "." + std::to_string(NextCounter++);
+    if (!Generate)
+        return Key;
+
+    Type *I64 = Type::getInt64Ty(getGlobalContext());
+    auto *Counter = new GlobalVariable(*TheModule, I64, false, GlobalValue::PrivateLinkage,
+            ConstantInt::get(I64, 0), "__prof." + Key);
+    Counters.push_back(std::make_pair(Key, Counter));
+
+    Value *Count = Builder.CreateLoad(Counter, "profcount");
+    Builder.CreateStore(Builder.CreateAdd(Count, ConstantInt::get(I64, 1)), Counter);
+    return Key;
+}
+
+uint64_t ProfileInfo::getCount(const std::string &Key) const {
+    auto C = Counts.find(Key);
+    return C == Counts.end() ? 0 : C->second;
+}
+
+void ProfileInfo::setBranchWeights(BranchInst *Br, uint64_t TrueCount, uint64_t FalseCount) {
+    if (!Use || (TrueCount == 0 && FalseCount == 0))
+        return;
+
+    // Weights are 32 bit, scale large counts down keeping their ratio.
+    uint64_t Scale = std::max(TrueCount, FalseCount) / UINT32_MAX + 1;
+    MDBuilder MDB(getGlobalContext());
+    Br->setMetadata(LLVMContext::MD_prof,
+            MDB.createBranchWeights(TrueCount / Scale + 1, FalseCount / Scale + 1));
+}
+
+// Hot functions are hinted for inlining, functions that never ran are cold
+// so they are optimized for size and laid out away from the hot code.
+void ProfileInfo::annotateFunction(Function *F, const std::string &EntryKey) {
+    if (!Use)
+        return;
+
+    uint64_t EntryCount = getCount(EntryKey);
+    F->setEntryCount(EntryCount);
+    if (EntryCount == 0) {
+        if (!F->hasFnAttribute(Attribute::AlwaysInline))
+            F->addFnAttr(Attribute::Cold);
+    } else if (EntryCount * 100 >= MaxEntryCount) {
+        F->addFnAttr(Attribute::InlineHint);
+    }
+}
+
+// Emits a global constructor that registers the counters with the runtime.
+void ProfileInfo::finalize(const std::string &Path) {
+    if (!Generate || Counters.empty())
+        return;
+
+    LLVMContext &Ctx = getGlobalContext();
+    Type *I64 = Type::getInt64Ty(Ctx);
+    PointerType *I8Ptr = Type::getInt8PtrTy(Ctx);
+    PointerType *I64Ptr = Type::getInt64PtrTy(Ctx);
+
+    Function *Ctor = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+            Function::InternalLinkage, "__yorkie_profile_init", TheModule.get());
+    IRBuilder<> B(BasicBlock::Create(Ctx, "entry", Ctor));
+
+    std::vector<Constant *> Names, Ptrs;
+    for (auto &C : Counters) {
+        Names.push_back(cast<Constant>(B.CreateGlobalStringPtr(C.first)));
+        Ptrs.push_back(C.second);
+    }
+    ArrayType *NamesTy = ArrayType::get(I8Ptr, Names.size());
+    ArrayType *PtrsTy = ArrayType::get(I64Ptr, Ptrs.size());
+    auto *NamesGV = new GlobalVariable(*TheModule, NamesTy, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(NamesTy, Names), "__prof.names");
+    auto *PtrsGV = new GlobalVariable(*TheModule, PtrsTy, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(PtrsTy, Ptrs), "__prof.counters");
+
+    // void __yorkie_profile_register(const char *Path, const char **Names,
+    //                                uint64_t **Counters, uint64_t Size)
+    Type *Params[] = { I8Ptr, I8Ptr->getPointerTo(), I64Ptr->getPointerTo(), I64 };
+    Constant *Register = TheModule->getOrInsertFunction("__yorkie_profile_register",
+            FunctionType::get(Type::getVoidTy(Ctx), Params, false));
+    Value *Args[] = {
+        B.CreateGlobalStringPtr(Path),
+        B.CreatePointerCast(NamesGV, I8Ptr->getPointerTo()),
+        B.CreatePointerCast(PtrsGV, I64Ptr->getPointerTo()),
+        ConstantInt::get(I64, Counters.size())
+    };
+    B.CreateCall(Register, Args);
+    B.CreateRetVoid();
+
+    appendToGlobalCtors(*TheModule, Ctor, 0);
+}
+
+// ================================================================
+// Profiler Support (-profile)
+// ================================================================
+
+// -profile=count gives every function a private { name, stats } site for the
+// runtime in lib/stdlib.cpp, and calls the runtime with it on entry and
+// before the function returns. The calls stay in place when the function is
+// inlined, so the report is per yorkie function at any optimization level.
+// -profile=sample adds no code to functions: once a module is optimized it
+// gets a table of the start address of each function, which is registered
+// with the runtime, and every function keeps its frame pointer so the SIGPROF
+// handler can walk the stack.
+struct ProfilerHooks {
+    bool Active = false;
+
+    void emitEnter(Function *F);
+    void emitExit();
+    void emitFunctionTable(Module &M, bool Streamed);
+    void registerJITModule();
+} KSProfiler;
+
+static Constant *getProfilerHook(StringRef Name, FunctionType *Ty) {
+    return TheModule->getOrInsertFunction(Name, Ty);
+}
+
+void ProfilerHooks::emitEnter(Function *F) {
+    Active = ProfilerMode == CountingProfiler;
+    if (!Active)
+        return;
+
+    LLVMContext &C = getGlobalContext();
+    PointerType *I8Ptr = Type::getInt8PtrTy(C);
+    StructType *SiteTy = StructType::get(I8Ptr, I8Ptr, nullptr);
+    Constant *Fields[] = {
+        cast<Constant>(Builder.CreateGlobalStringPtr(F->getName(), "__yprof.name")),
+        ConstantPointerNull::get(I8Ptr)
+    };
+    auto *SiteGV = new GlobalVariable(*TheModule, SiteTy, false, GlobalValue::PrivateLinkage,
+            ConstantStruct::get(SiteTy, Fields), "__yprof." + F->getName());
+
+    Constant *Enter = getProfilerHook("__yorkie_prof_enter",
+            FunctionType::get(Type::getVoidTy(C), I8Ptr, false));
+    Builder.CreateCall(Enter, Builder.CreatePointerCast(SiteGV, I8Ptr));
+}
+
+void ProfilerHooks::emitExit() {
+    if (!Active)
+        return;
+
+    Builder.CreateCall(getProfilerHook("__yorkie_prof_exit",
+            FunctionType::get(Type::getVoidTy(getGlobalContext()), false)));
+}
+
+// Lists the functions left in the optimized module for the sampling runtime.
+// Functions are emitted in module order, so an empty function added last
+// marks the end of the module's code. Compiled programs register the table
+// from a global constructor. The JIT doesn't run those, registerJITModule()
+// looks the function up instead, so it's exported unless the module is
+// streamed: those are linked together.
+void ProfilerHooks::emitFunctionTable(Module &M, bool Streamed) {
+    if (ProfilerMode != SamplingProfiler)
+        return;
+
+    LLVMContext &C = getGlobalContext();
+    Type *I64 = Type::getInt64Ty(C);
+    PointerType *I8Ptr = Type::getInt8PtrTy(C);
+    FunctionType *VoidFnTy = FunctionType::get(Type::getVoidTy(C), false);
+
+    Function *Init = Function::Create(VoidFnTy,
+            Streamed ? Function::InternalLinkage : Function::ExternalLinkage,
+            "__yorkie_prof_sample_init", &M);
+    IRBuilder<> B(BasicBlock::Create(C, "entry", Init));
+    Function *End = Function::Create(VoidFnTy, Function::InternalLinkage,
+            "__yorkie_prof_code_end", &M);
+    ReturnInst::Create(C, BasicBlock::Create(C, "entry", End));
+
+    std::vector<Constant *> Names, Functions;
+    for (Function &F : M) {
+        if (F.isDeclaration() || &F == End)
+            continue;
+        F.addFnAttr("no-frame-pointer-elim", "true");
+        Names.push_back(cast<Constant>(B.CreateGlobalStringPtr(F.getName())));
+        Functions.push_back(ConstantExpr::getBitCast(&F, I8Ptr));
+    }
+    Functions.push_back(ConstantExpr::getBitCast(End, I8Ptr));
+
+    ArrayType *NamesTy = ArrayType::get(I8Ptr, Names.size());
+    ArrayType *FunctionsTy = ArrayType::get(I8Ptr, Functions.size());
+    auto *NamesGV = new GlobalVariable(M, NamesTy, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(NamesTy, Names), "__yprof.names");
+    auto *FunctionsGV = new GlobalVariable(M, FunctionsTy, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(FunctionsTy, Functions), "__yprof.functions");
+
+    // void __yorkie_prof_sample_register(const char **Names, void **Functions,
+    //                                    uint64_t Size)
+    Type *Params[] = { I8Ptr->getPointerTo(), I8Ptr->getPointerTo(), I64 };
+    Constant *Register = M.getOrInsertFunction("__yorkie_prof_sample_register",
+            FunctionType::get(Type::getVoidTy(C), Params, false));
+    Value *Args[] = {
+        B.CreatePointerCast(NamesGV, I8Ptr->getPointerTo()),
+        B.CreatePointerCast(FunctionsGV, I8Ptr->getPointerTo()),
+        ConstantInt::get(I64, Names.size())
+    };
+    B.CreateCall(Register, Args);
+    B.CreateRetVoid();
+
+    appendToGlobalCtors(M, Init, 0);
+}
+
+// Registers the function table of the module the JIT added last. The JIT
+// finds the newest definition of a name, which is that module's.
+void ProfilerHooks::registerJITModule() {
+    if (ProfilerMode != SamplingProfiler)
+        return;
+
+    if (auto Sym = TheJIT->findSymbol("__yorkie_prof_sample_init"))
+        ((void (*)())(intptr_t)Sym.getAddress())();
+}
+
 // Generate code for numeric literals
 // `APFloat` has the capability of holder fp constants of arbitrary precision.
 Value *NumberExprAST::codegen() {
@@ -142,13 +1032,13 @@ Value *VariableExprAST::codegen() {
     // Look this variable up in the function
     Value *V = NamedValues[Name];
     if (!V)
-        ErrorV("Unknown variable name");
+        return ErrorV("Unknown variable name");
 
     // Emit debug location
     KSDbgInfo.emitLocation(this);
 
     // Load the value
-    return Builder.CreateLoad(V, Name.c_str());
+    return LoadVariable(V, Name);
 }
 
 // Generate code for binary expressions
@@ -162,35 +1052,56 @@ Value *BinaryExprAST::codegen() {
 
     // Special case '=' because we don't want to emit the LHS as an expression
     if (Op == '=') {
-        // Assignment requires the LHS to be an identifier.
-        // TODO:
-        // This assumes that we're building without RTTI because LLVM builds that way by
-        // default. If you build LLVM with RTTI this can be changed to a dynamic_cast
-        // for automatic error checking.
-        VariableExprAST *LHSE = static_cast<VariableExprAST*>(LHS.get());
+        // Assignment requires the LHS to be a variable or an array element.
+        if (IndexExprAST *LHSI = dyn_cast<IndexExprAST>(LHS.get())) {
+            Value *Val = ExpectNumber(RHS->codegen());
+            if (!Val)
+                return nullptr;
+            Value *Element = LHSI->codegenAddress();
+            if (!Element)
+                return nullptr;
+            Builder.CreateStore(Val, Element);
+            return Val;
+        }
+
+        VariableExprAST *LHSE = dyn_cast<VariableExprAST>(LHS.get());
         if (!LHSE)
             return ErrorV("destination of '=' must be a variable");
 
         // Codegen the RHS
-        Value *Val = RHS->codegen();
+        Value *Val = ExpectNumberOrVector(RHS->codegen());
         if (!Val)
             return nullptr;
 
-        // Look up the name.
-        Value *Variable = NamedValues[LHSE->getName()];
+        // Look up the name, it has a stack slot since it's assigned.
+        AllocaInst *Variable = dyn_cast_or_null<AllocaInst>(NamedValues[LHSE->getName()]);
         if (!Variable)
             return ErrorV("Unknown variable name");
+        if (Variable->getAllocatedType() == getArrayTy())
+            return ErrorV("arrays can't be assigned, only their elements");
+        if (Variable->getAllocatedType() != Val->getType())
+            return ErrorV("assigned value doesn't match the variable's type");
 
         Builder.CreateStore(Val, Variable);
         return Val;
     }
 
-    Value *L = LHS->codegen();
-    Value *R = RHS->codegen();
+    if (isShortCircuit(Op))
+        return codegenShortCircuit();
+
+    Value *L = ExpectNumberOrVector(LHS->codegen());
+    Value *R = ExpectNumberOrVector(RHS->codegen());
 
     if (!L || !R)
         return nullptr;
 
+    // The builtin operators work lane by lane on vectors.
+    if (isBuiltin(Op) && !MatchLanes(L, R))
+        return ErrorV("vectors of different widths");
+
+    // Comparisons are unordered, true if either operand is a NaN, except '=='
+    // so that it's the opposite of '!='.
+    Value *Cmp = nullptr;
     switch (Op) {
     case '+':
         return Builder.CreateFAdd(L, R, "addtmp");
@@ -198,23 +1109,86 @@ Value *BinaryExprAST::codegen() {
         return Builder.CreateFSub(L, R, "subtmp");
     case '*':
         return Builder.CreateFMul(L, R, "multmp");
+    case '/':
+        return Builder.CreateFDiv(L, R, "divtmp");
+    case '%':
+        return Builder.CreateFRem(L, R, "remtmp");
     case '<':
-        L = Builder.CreateFCmpULT(L, R, "cmptmp");
-        // Convert bool 0/1 to double 0.0 of 1.0
-        return Builder.CreateUIToFP(L, Type::getDoubleTy(getGlobalContext()), "booltmp");
+        Cmp = Builder.CreateFCmpULT(L, R, "cmptmp");
+        break;
+    case '>':
+        Cmp = Builder.CreateFCmpUGT(L, R, "cmptmp");
+        break;
+    case Lexer::tok_le:
+        Cmp = Builder.CreateFCmpULE(L, R, "cmptmp");
+        break;
+    case Lexer::tok_ge:
+        Cmp = Builder.CreateFCmpUGE(L, R, "cmptmp");
+        break;
+    case Lexer::tok_eq:
+        Cmp = Builder.CreateFCmpOEQ(L, R, "cmptmp");
+        break;
+    case Lexer::tok_ne:
+        Cmp = Builder.CreateFCmpUNE(L, R, "cmptmp");
+        break;
     default:
         break;
     }
+    // Convert bool 0/1 to double 0.0 of 1.0
+    if (Cmp)
+        return Builder.CreateUIToFP(Cmp, L->getType(), "booltmp");
+
+    if (!ExpectNumber(L) || !ExpectNumber(R))
+        return nullptr;
 
     // If it wasn't a builtin binary operator, it must be a user defined one.
     // Loop up the operator in the symbol table.
     // Emit a call to it.
-    Function *F = getFunction(std::string("binary") + Op);
+    Function *F = getFunction(std::string("binary") + (char)Op);
     assert(F && "binary operator not found!");
 
     // Binary operators are just function calls, so we just emit a function call.
     Value *Ops[2] = { L,R };
-    return Builder.CreateCall(F, Ops, "binop");
+    return EmitCall(F, Ops, "binop");
+}
+
+// '&' and '|' branch around the RHS when the LHS decides the result, like the
+// condition of an if they compare ordered and not equal to 0.0. The result is
+// 0.0 or 1.0.
+Value *BinaryExprAST::codegenShortCircuit() {
+    Value *L = ExpectNumber(LHS->codegen());
+    if (!L)
+        return nullptr;
+
+    Value *Zero = ConstantFP::get(getGlobalContext(), APFloat(0.0));
+    L = Builder.CreateFCmpONE(L, Zero, "lhscond");
+
+    Function *TheFunction = Builder.GetInsertBlock()->getParent();
+    BasicBlock *LHSBB = Builder.GetInsertBlock();
+    BasicBlock *RHSBB = BasicBlock::Create(getGlobalContext(), "logic.rhs", TheFunction);
+    BasicBlock *MergeBB = BasicBlock::Create(getGlobalContext(), "logic.end");
+
+    // A false LHS decides '&', a true one '|'.
+    if (Op == '&')
+        Builder.CreateCondBr(L, RHSBB, MergeBB);
+    else
+        Builder.CreateCondBr(L, MergeBB, RHSBB);
+
+    Builder.SetInsertPoint(RHSBB);
+    Value *R = ExpectNumber(RHS->codegen());
+    if (!R)
+        return nullptr;
+    R = Builder.CreateFCmpONE(R, Zero, "rhscond");
+    Builder.CreateBr(MergeBB);
+    // The RHS can change the current block, like the arms of an if.
+    RHSBB = Builder.GetInsertBlock();
+
+    TheFunction->getBasicBlockList().push_back(MergeBB);
+    Builder.SetInsertPoint(MergeBB);
+    PHINode *PN = Builder.CreatePHI(Builder.getInt1Ty(), 2, "logictmp");
+    PN->addIncoming(Builder.getInt1(Op == '|'), LHSBB);
+    PN->addIncoming(R, RHSBB);
+    return Builder.CreateUIToFP(PN, Type::getDoubleTy(getGlobalContext()), "booltmp");
 }
 
 // Generate code for function calls
@@ -228,20 +1202,51 @@ Value *CallExprAST::codegen() {
 
     // Look up the name in the global module table
     Function *CalleeF = getFunction(Callee);
+    if (!CalleeF && isVectorBuiltin(Callee))
+        return EmitVectorBuiltin(Callee, Args);
     if (!CalleeF)
         return ErrorV("Unknown function referenced");
 
+    // The prototype says which arguments are arrays, functions that only exist
+    // in the stdlib take numbers.
+    auto PI = FunctionProtos.find(Callee);
+    const PrototypeAST *Proto = PI != FunctionProtos.end() ? PI->second.get() : nullptr;
+
     // If argument mismatch error
-    if (CalleeF->arg_size() != Args.size())
+    if ((Proto ? Proto->getArgs().size() : CalleeF->arg_size()) != Args.size())
         return ErrorV("Incorrect # arguments passed");
 
+    // Array arguments are noalias, so the same array can't be passed twice,
+    // even through different variables.
+    std::set<const Value *> ArrayArgs;
     std::vector<Value *> ArgsV;
     for (unsigned i = 0, e = Args.size(); i != e; ++i) {
-        ArgsV.push_back(Args[i]->codegen());
-        if (!ArgsV.back())
+        Value *ArgV = Args[i]->codegen();
+        if (!ArgV)
             return nullptr;
+
+        if (!Proto || !Proto->isArrayArg(i)) {
+            if (!ExpectNumber(ArgV))
+                return nullptr;
+            ArgsV.push_back(ArgV);
+            continue;
+        }
+
+        if (!isArray(ArgV))
+            return ErrorV("expected an array argument");
+        if (auto *Var = dyn_cast<VariableExprAST>(Args[i].get()))
+            if (!ArrayArgs.insert(getArrayOrigin(NamedValues[Var->getName()])).second)
+                return ErrorV("the same array can't be passed twice");
+        ArgsV.push_back(Builder.CreateExtractValue(ArgV, 0, "data"));
+        ArgsV.push_back(Builder.CreateExtractValue(ArgV, 1, "len"));
     }
-    return Builder.CreateCall(CalleeF, ArgsV, "calltmp");
+
+    // Functions defined in earlier modules are declarations too, they're told
+    // apart from externs by name.
+    if (CalleeF->isDeclaration() && !DefinedNames.count(Callee))
+        if (Value *V = EmitMathIntrinsic(Callee, ArgsV))
+            return V;
+    return EmitCall(CalleeF, ArgsV, "calltmp");
 }
 
 // Generate code for function declarations (prototypes)
@@ -255,30 +1260,156 @@ Function *PrototypeAST::codegen() {
       ReturnType = Type::getInt32Ty(getGlobalContext());
 
     // Make the function type: double(double, double) etc.
-    std::vector<Type*> Doubles(Args.size(),
-            Type::getDoubleTy(getGlobalContext()));
+    // Arrays are passed as double *data, i64 length.
+    std::vector<Type*> ArgTypes;
+    for (unsigned i = 0, e = Args.size(); i != e; ++i) {
+        if (isArrayArg(i)) {
+            ArgTypes.push_back(Type::getDoublePtrTy(getGlobalContext()));
+            ArgTypes.push_back(Type::getInt64Ty(getGlobalContext()));
+        } else {
+            ArgTypes.push_back(Type::getDoubleTy(getGlobalContext()));
+        }
+    }
 
     // false specifies this is not a vargs function
-    FunctionType *FT = FunctionType::get(ReturnType, Doubles, false);
+    FunctionType *FT = FunctionType::get(ReturnType, ArgTypes, false);
     // ExternalLinkage means function may be defined outside the current module
     // or that it is callable by functions outside the module.
     Function *F = Function::Create(FT, Function::ExternalLinkage, Name, TheModule.get());
 
     // Set names for all arguments.
-    unsigned Idx = 0;
-    for (auto &Arg : F->args())
-        Arg.setName(Args[Idx++]);
+    auto AI = F->arg_begin();
+    for (unsigned i = 0, e = Args.size(); i != e; ++i) {
+        Argument *Arg = &*AI++;
+        Arg->setName(Args[i]);
+        if (!isArrayArg(i))
+            continue;
+
+        // Arrays never overlap, and their data is aligned.
+        AttrBuilder B;
+        B.addAttribute(Attribute::NoAlias).addAlignmentAttr(ArrayAlign);
+        Arg->addAttr(AttributeSet::get(getGlobalContext(), Arg->getArgNo() + 1, B));
+        (AI++)->setName(Args[i] + ".len");
+    }
 
     return F;
 }
 
+// In interactive mode each top level expression is compiled into a module of
+// its own, see HandleTopLevelExpression().
+static bool InteractiveMode = false;
+
+// With -stream-dir the module is written out and replaced every -stream-batch
+// definitions, see FlushStreamModule().
+static bool isStreaming() {
+    return !StreamDir.empty();
+}
+
+// Operators can't be named from C, so nothing outside the module can call them.
+// In whole-program mode the same goes for every definition but main. In
+// interactive and streaming modes later modules call into earlier ones, so
+// nothing is internal.
+static bool hasInternalLinkage(const PrototypeAST &P) {
+    if (InteractiveMode || isStreaming())
+        return false;
+    return P.isUnaryOp() || P.isBinaryOp() || (WholeProgram && P.getName() != "main");
+}
+
+// The fast-math flags of -ffp-model, or of a 'def fast' function, for every
+// IRBuilder emitting floating point operations.
+static FastMathFlags getFastMathFlags(bool FastFunction) {
+    FastMathFlags FMF;
+    if (FPModel == FastFPModel || FastFunction)
+        FMF.setUnsafeAlgebra();
+    return FMF;
+}
+
+// The CPU and features of -mcpu and -mattr. With -mcpu=native the features
+// start from the host's, which covers what the OS supports, not just what the
+// CPU name implies. Set when the Context is created.
+static std::string CPUName;
+static std::vector<std::string> CPUFeatures;
+
+static void InitializeTargetCPU() {
+    SubtargetFeatures Features;
+    CPUName = TargetCPU;
+    if (TargetCPU == "native") {
+        CPUName = sys::getHostCPUName().str();
+        StringMap<bool> HostFeatures;
+        if (sys::getHostCPUFeatures(HostFeatures))
+            for (auto &F : HostFeatures)
+                Features.AddFeature(F.first(), F.second);
+    }
+    for (auto &Attr : TargetAttrs)
+        Features.AddFeature(Attr);
+    CPUFeatures = Features.getFeatures();
+}
+
+// The target and -ffp-model attributes, which the backend reads for each
+// function. Every function yorkie generates gets them, so they agree when
+// inlined into each other. The CPU is only recorded if -mcpu is given, and
+// the features if -mcpu or -mattr is: then clang generates the same code
+// from the printed IR as the JIT, otherwise code for the generic CPU.
+// The features replace the target machine's, so code for the JIT records
+// all of them, the host's included, not just the -mattr ones.
+// FastFunction is set for 'def fast' functions and the helpers generated
+// for their loops.
+static void addTargetAttributes(Function *F, bool FastFunction) {
+    if (TargetCPU.getNumOccurrences()) {
+        F->addFnAttr("target-cpu", CPUName);
+        if (!CPUFeatures.empty())
+            F->addFnAttr("target-features", join(CPUFeatures.begin(), CPUFeatures.end(), ","));
+    } else if (CompilingForJIT && !TargetAttrs.empty()) {
+        F->addFnAttr("target-features", join(CPUFeatures.begin(), CPUFeatures.end(), ","));
+    } else if (!TargetAttrs.empty()) {
+        F->addFnAttr("target-features", join(TargetAttrs.begin(), TargetAttrs.end(), ","));
+    }
+
+    const char *Fast = FPModel == FastFPModel || FastFunction ? "true" : "false";
+    F->addFnAttr("unsafe-fp-math", Fast);
+    F->addFnAttr("no-infs-fp-math", Fast);
+    F->addFnAttr("no-nans-fp-math", Fast);
+}
+
+// The JIT's target options for -ffp-model. Fusing multiplies and adds is up to
+// clang when the IR is printed instead.
+static TargetOptions getTargetOptions() {
+    TargetOptions Options;
+    Options.AllowFPOpFusion = FPModel == StrictFPModel ? FPOpFusion::Strict : FPOpFusion::Fast;
+    Options.UnsafeFPMath = Options.NoInfsFPMath = Options.NoNaNsFPMath = FPModel == FastFPModel;
+    return Options;
+}
+
+// Internal functions use fastcc. Calls emitted before the definition (through a
+// forward declaration or recursion) are updated to match.
+static void setCallingConv(Function *F, CallingConv::ID CC) {
+    F->setCallingConv(CC);
+    for (auto *U : F->users())
+        if (auto *Call = dyn_cast<CallInst>(U))
+            Call->setCallingConv(CC);
+}
+
+// Mark operators and small leaf functions for inlining. Operators are lowered
+// to a call per use, so the small ones are always inlined.
+static void addInliningAttributes(Function *F, const FunctionAST &FnAST) {
+    const PrototypeAST &P = FnAST.getProto();
+    if (P.getName() == "main")
+        return;
+
+    bool Candidate = TheInliner->isCandidate(FnAST);
+    if (P.isUnaryOp() || P.isBinaryOp())
+        F->addFnAttr(Candidate ? Attribute::AlwaysInline : Attribute::InlineHint);
+    else if (Candidate)
+        F->addFnAttr(Attribute::InlineHint);
+}
+
 // Generate code for function bodies.
 Function *FunctionAST::codegen() {
 
-    // Transfer ownership of the prototype to the FunctionProtos map, but keep a
-    // reference to it for use below.
+    // Copy the prototype into the FunctionProtos map, the definition keeps its
+    // own for the AST passes.
     auto &P = *Proto;
-    FunctionProtos[Proto->getName()] = std::move(Proto);
+    FunctionProtos[P.getName()] = llvm::make_unique<PrototypeAST>(P);
     Function *TheFunction = getFunction(P.getName());
     if (!TheFunction)
         return nullptr;
@@ -288,26 +1419,28 @@ Function *FunctionAST::codegen() {
         Parser::BinopPrecedence[P.getOperatorName()] = P.getBinaryPrecedence();
 
     // Want to make sure that the function doesn't already have a body before we generate one.
-    if (!TheFunction->empty())
+    if (!TheFunction->empty() || StreamedNames.count(P.getName()))
         return (Function*)ErrorV("Function cannot be redefined.");
 
     // Create a new basic block to start insertion into.
     BasicBlock *BB = BasicBlock::Create(getGlobalContext(), "entry", TheFunction);
     Builder.SetInsertPoint(BB);
+    Builder.setFastMathFlags(getFastMathFlags(P.isFastMath()));
 
     // Create a subprogram DIE for this function.
-    DIFile *Unit = DBuilder->createFile(KSDbgInfo.TheCU->getFilename(),
-            KSDbgInfo.TheCU->getDirectory());
-
-    DIScope *FContext = Unit;
+    DIFile *Unit = KSDbgInfo.TheFile;
     unsigned LineNo = P.getLine();
-    unsigned ScopeLine = LineNo;
-    // DISubprogram contains a reference to all of our metadata for the function.
-    DISubprogram *SP = DBuilder->createFunction(
-            FContext, P.getName(), StringRef(), Unit, LineNo,
-            CreateFunctionType(TheFunction->arg_size(), Unit), false /* internal linkage */,
-            true /* definition */, ScopeLine, DINode::FlagPrototyped, false);
-    TheFunction->setSubprogram(SP);
+    DISubprogram *SP = nullptr;
+    if (KSDbgInfo.TheCU) {
+        DIScope *FContext = Unit;
+        unsigned ScopeLine = LineNo;
+        // DISubprogram contains a reference to all of our metadata for the function.
+        SP = DBuilder->createFunction(
+                FContext, P.getName(), StringRef(), Unit, LineNo,
+                CreateFunctionType(P.getArgs().size()), hasInternalLinkage(P),
+                true /* definition */, ScopeLine, DINode::FlagPrototyped, false);
+        TheFunction->setSubprogram(SP);
+    }
 
     // Push the current scope
     KSDbgInfo.LexicalBlocks.push_back(SP);
@@ -317,28 +1450,54 @@ Function *FunctionAST::codegen() {
     // will run past them when breaking on a function.
     KSDbgInfo.emitLocation(nullptr);
 
+    // Count the function entry.
+    KSProfile.beginFunction(P.getName());
+    std::string EntryKey = KSProfile.emitCounter();
+    KSProfiler.emitEnter(TheFunction);
+
+    // Find the variables the body assigns to, only those need stack slots.
+    std::vector<std::string> Assigned;
+    for (auto &E : *Body)
+        E->collectAssignments(Assigned);
+    AssignedNames = std::set<std::string>(Assigned.begin(), Assigned.end());
+
     // Record the function arguments in the NamedValues map.
     // Add the function arguments to the NamedValues map, so they are accessible to the
     // `VariableExprAST` nodes
     NamedValues.clear();
-    unsigned ArgIdx = 0;
-    for (auto &Arg : TheFunction->args()) {
-        // Create an alloca for this variable.
-        AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, Arg.getName());
-
-        // Create a debug descriptor for the variable.
-        DILocalVariable *D = DBuilder->createParameterVariable(
-                SP, Arg.getName(), ++ArgIdx, Unit, LineNo, KSDbgInfo.getDoubleTy(), true);
-
-        DBuilder->insertDeclare(Alloca, D, DBuilder->createExpression(),
-                DebugLoc::get(LineNo, 0, SP),
-                Builder.GetInsertBlock());
-
-        // Store the initial value into the alloca.
-        Builder.CreateStore(&Arg, Alloca);
+    ArrayOrigins.clear();
+    auto AI = TheFunction->arg_begin();
+    for (unsigned ArgIdx = 0, e = P.getArgs().size(); ArgIdx != e; ++ArgIdx) {
+        const std::string &ArgName = P.getArgs()[ArgIdx];
+
+        // Array arguments come in as their data and length.
+        if (P.isArrayArg(ArgIdx)) {
+            Value *Data = &*AI++;
+            Value *Length = &*AI++;
+            NamedValues[ArgName] = BindVariable(TheFunction, ArgName, MakeArray(Data, Length));
+            continue;
+        }
+        Argument &Arg = *AI++;
+        Value *Binding = BindVariable(TheFunction, ArgName, &Arg);
+
+        // Create a debug descriptor for the variable, it lives in the stack
+        // slot or is the argument itself.
+        if (DebugInfoLevel == FullDebugInfo) {
+            DILocalVariable *D = DBuilder->createParameterVariable(
+                    SP, ArgName, ArgIdx + 1, Unit, LineNo, KSDbgInfo.getDoubleTy(), true);
+
+            if (isa<AllocaInst>(Binding))
+                DBuilder->insertDeclare(Binding, D, DBuilder->createExpression(),
+                        DebugLoc::get(LineNo, 0, SP),
+                        Builder.GetInsertBlock());
+            else
+                DBuilder->insertDbgValueIntrinsic(Binding, 0, D, DBuilder->createExpression(),
+                        DebugLoc::get(LineNo, 0, SP),
+                        Builder.GetInsertBlock());
+        }
 
         // Add arguments to variable symbol table
-        NamedValues[Arg.getName()] = Alloca;
+        NamedValues[ArgName] = Binding;
     }
 
     // Codegen each body expression
@@ -354,6 +1513,10 @@ Function *FunctionAST::codegen() {
         }
     }
 
+    // Functions return numbers, arrays can't outlive the var that allocates them.
+    if (RetVal)
+        RetVal = ExpectNumber(RetVal);
+
     // If no error, emit the ret instruction, which completes the function.
     if (GenerationSuccess && RetVal != nullptr) {
         // Special case "main"
@@ -363,6 +1526,7 @@ Function *FunctionAST::codegen() {
         }
 
         // Finish off the function.
+        KSProfiler.emitExit();
         Builder.CreateRet(RetVal);
 
         // Pop off the lexical block for the function.
@@ -371,6 +1535,14 @@ Function *FunctionAST::codegen() {
         // Validate the generated code, checking for consistency. Function is provided by LLVM.
         verifyFunction(*TheFunction);
 
+        if (hasInternalLinkage(P)) {
+            TheFunction->setLinkage(Function::InternalLinkage);
+            setCallingConv(TheFunction, CallingConv::Fast);
+        }
+        addInliningAttributes(TheFunction, *this);
+        addTargetAttributes(TheFunction, P.isFastMath());
+        KSProfile.annotateFunction(TheFunction, EntryKey);
+
         return TheFunction;
     }
 
@@ -395,7 +1567,7 @@ Value *IfExprAST::codegen() {
     // Emit debug location
     KSDbgInfo.emitLocation(this);
 
-    Value *CondV = Cond->codegen();
+    Value *CondV = ExpectNumber(Cond->codegen());
     if (!CondV)
         return nullptr;
 
@@ -412,12 +1584,13 @@ Value *IfExprAST::codegen() {
     BasicBlock *MergeBB = BasicBlock::Create(getGlobalContext(), "ifcont");
 
     // Conditional branch
-    Builder.CreateCondBr(CondV, ThenBB, ElseBB);
+    BranchInst *CondBr = Builder.CreateCondBr(CondV, ThenBB, ElseBB);
 
     // Emit then value.
     Builder.SetInsertPoint(ThenBB);
+    std::string ThenKey = KSProfile.emitCounter();
 
-    Value *ThenV = Then->codegen();
+    Value *ThenV = ExpectNumber(Then->codegen());
     if (!ThenV)
         return nullptr;
 
@@ -431,8 +1604,10 @@ Value *IfExprAST::codegen() {
     // Emit else block.
     TheFunction->getBasicBlockList().push_back(ElseBB);
     Builder.SetInsertPoint(ElseBB);
+    std::string ElseKey = KSProfile.emitCounter();
+    KSProfile.setBranchWeights(CondBr, KSProfile.getCount(ThenKey), KSProfile.getCount(ElseKey));
 
-    Value *ElseV = Else->codegen();
+    Value *ElseV = ExpectNumber(Else->codegen());
     if (!ElseV)
         return nullptr;
 
@@ -471,34 +1646,53 @@ Value *IfExprAST::codegen() {
 //   br endcond, loop, endloop
 // outloop:
 Value *ForExprAST::codegen() {
+    if (Parallel)
+        return codegenParallel();
+    if (ExprAST *Limit = getCountedLimit())
+        return codegenCounted(*Limit);
+
     Function *TheFunction = Builder.GetInsertBlock()->getParent();
 
-    // Create an alloc for the variable in the entry block.
-    AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, VarName);
+    // Create an alloc for the variable in the entry block, if it's assigned.
+    AllocaInst *Alloca = nullptr;
+    if (AssignedNames.count(VarName))
+        Alloca = CreateEntryBlockAlloca(TheFunction, VarName);
 
     // Emit debug location
     KSDbgInfo.emitLocation(this);
 
     // Emit the start code first, without 'variable in scope.
-    Value *StartVal = Start->codegen();
+    Value *StartVal = ExpectNumber(Start->codegen());
     if (!StartVal)
         return nullptr;
 
     // Store the value into the alloca
-    Builder.CreateStore(StartVal, Alloca);
+    if (Alloca)
+        Builder.CreateStore(StartVal, Alloca);
 
     // Make the new basic block for the loop header, inserting after current block.
+    BasicBlock *PreheaderBB = Builder.GetInsertBlock();
     BasicBlock *LoopBB = BasicBlock::Create(getGlobalContext(), "loop", TheFunction);
 
     // Insert an explicit fall through from the current block to the LoopBB
     Builder.CreateBr(LoopBB);
 
-    // Start insertion in LoopBB.
+    // Start insertion in LoopBB. Otherwise the variable is a phi of the start
+    // value and the stepped one.
     Builder.SetInsertPoint(LoopBB);
+    PHINode *Variable = nullptr;
+    if (!Alloca) {
+        Variable = Builder.CreatePHI(Type::getDoubleTy(getGlobalContext()), 2, VarName.c_str());
+        Variable->addIncoming(StartVal, PreheaderBB);
+    }
+    std::string LoopKey = KSProfile.emitCounter();
 
     // If the variable shadows an existing variable, we have to restore it, so save it now.
-    AllocaInst *OldVal = NamedValues[VarName];
-    NamedValues[VarName] = Alloca;
+    Value *OldVal = NamedValues[VarName];
+    if (Alloca)
+        NamedValues[VarName] = Alloca;
+    else
+        NamedValues[VarName] = Variable;
 
     // Emit the body of the loop. This, like any other expr, can change the current BB
     // Note that we ignore the value computed by the body, but don't allow an error.
@@ -508,7 +1702,7 @@ Value *ForExprAST::codegen() {
     // Emit the step value.
     Value *StepVal = nullptr;
     if (Step) {
-        StepVal = Step->codegen();
+        StepVal = ExpectNumber(Step->codegen());
         if (!StepVal)
             return nullptr;
     } else {
@@ -517,15 +1711,18 @@ Value *ForExprAST::codegen() {
     }
 
     // Compute the end condition
-    Value *EndCond = End->codegen();
+    Value *EndCond = ExpectNumber(End->codegen());
     if (!EndCond)
         return nullptr;
 
     // Reload, increment and restore the alloca. This handles the case where
     // the body of the loop mutates the variable.
-    Value *CurVar = Builder.CreateLoad(Alloca, VarName.c_str());
+    Value *CurVar = Alloca ? Builder.CreateLoad(Alloca, VarName.c_str()) : Variable;
     Value *NextVar = Builder.CreateFAdd(CurVar, StepVal, "nextvar");
-    Builder.CreateStore(NextVar, Alloca);
+    if (Alloca)
+        Builder.CreateStore(NextVar, Alloca);
+    else
+        Variable->addIncoming(NextVar, Builder.GetInsertBlock());
 
     // Convert condition to a bool by comparing equal to 0.0
     EndCond = Builder.CreateFCmpONE(EndCond,
@@ -535,11 +1732,16 @@ Value *ForExprAST::codegen() {
     BasicBlock *AfterBB = BasicBlock::Create(getGlobalContext(), "afterloop", TheFunction);
 
     // Insert the conditional branch into the end of LoopEndBB
-    Builder.CreateCondBr(EndCond, LoopBB, AfterBB);
+    BranchInst *LoopBr = Builder.CreateCondBr(EndCond, LoopBB, AfterBB);
 
     // And new code with be inserted in AfterBB.
     Builder.SetInsertPoint(AfterBB);
 
+    // Every run of the body but the last takes the back edge.
+    std::string ExitKey = KSProfile.emitCounter();
+    uint64_t LoopCount = KSProfile.getCount(LoopKey), ExitCount = KSProfile.getCount(ExitKey);
+    KSProfile.setBranchWeights(LoopBr, LoopCount - std::min(LoopCount, ExitCount), ExitCount);
+
     // Restore the unshadowed variable
     if (OldVal) {
         NamedValues[VarName] = OldVal;
@@ -551,26 +1753,475 @@ Value *ForExprAST::codegen() {
     return Constant::getNullValue(Type::getDoubleTy(getGlobalContext()));
 }
 
-// Generate code for unary expressions
-Value *UnaryExprAST::codegen() {
-    Value *OperandV = Operand->codegen();
-    if (!OperandV)
+// A loop is counted if its variable starts at an integer, goes up by a
+// positive integer step and is only compared with a limit that can't change
+// in the loop:
+//   for i = 0, i < len(a) in ... end
+// The number of iterations is then known before the loop starts, so the loop
+// runs on an integer counter instead, which LLVM can vectorize. The loop
+// variable only takes integer values, so it is the same either way.
+ExprAST *ForExprAST::getCountedLimit() const {
+    const double MaxExact = 1ull << 52;
+
+    auto *StartE = dyn_cast<NumberExprAST>(Start.get());
+    if (!StartE || StartE->getVal() != std::floor(StartE->getVal()) ||
+            std::fabs(StartE->getVal()) >= MaxExact)
         return nullptr;
+    if (Step) {
+        auto *StepE = dyn_cast<NumberExprAST>(Step.get());
+        if (!StepE || StepE->getVal() != std::floor(StepE->getVal()) ||
+                StepE->getVal() < 1 || StepE->getVal() >= MaxExact)
+            return nullptr;
+    }
 
-    Function *F = getFunction(std::string("unary") + Opcode);
-    if (!F)
-        return ErrorV("Unknown unary operator");
-
-    // Emit debug location
-    KSDbgInfo.emitLocation(this);
+    auto *Cond = dyn_cast<BinaryExprAST>(End.get());
+    if (!Cond || Cond->getOp() != '<')
+        return nullptr;
+    auto *CondVar = dyn_cast<VariableExprAST>(Cond->getLHS());
+    if (!CondVar || CondVar->getName() != VarName)
+        return nullptr;
 
-    // Return function call
-    return Builder.CreateCall(F, OperandV, "unop");
+    std::vector<std::string> Names;
+    Body->collectAssignments(Names);
+    std::set<std::string> Assigned(Names.begin(), Names.end());
+    if (Assigned.count(VarName))
+        return nullptr;
+    Assigned.insert(VarName);
+    return Cond->getRHS()->isInvariant(Assigned) ? Cond->getRHS() : nullptr;
 }
 
-// Code generation for var/in expressions
-Value *VarExprAST::codegen() {
-    std::vector<AllocaInst *> OldBindings;
+// Output counted loops as:
+//   ...
+//   limit = limitexpr
+//   n = trip count
+//   goto loop
+// loop:
+//   counter = phi [0, loopheader], [nextcounter, loopend]
+//   variable = start + counter * step
+//   ...
+//   bodyexpr
+//   ...
+// loopend:
+//   nextcounter = counter + 1
+//   br nextcounter < n, loop, endloop
+// outloop:
+Value *ForExprAST::codegenCounted(ExprAST &Limit) {
+    LLVMContext &C = getGlobalContext();
+    Type *DoubleTy = Type::getDoubleTy(C);
+    Type *Int64Ty = Type::getInt64Ty(C);
+    Function *TheFunction = Builder.GetInsertBlock()->getParent();
+
+    // Emit debug location
+    KSDbgInfo.emitLocation(this);
+
+    double StartVal = cast<NumberExprAST>(Start.get())->getVal();
+    double StepVal = Step ? cast<NumberExprAST>(Step.get())->getVal() : 1.0;
+
+    // The limit is the same in every iteration, so evaluate it once.
+    Value *LimitVal = ExpectNumber(Limit.codegen());
+    if (!LimitVal)
+        return nullptr;
+
+    // The body runs once, then again for every value of the variable below the
+    // limit: 1 + max(ceil((ceil(limit) - start) / step), 0) times, which is
+    // exact for integers below 2^52. Beyond that (or for a NaN limit, which
+    // never stops the loop) run "forever".
+    Function *Ceil = Intrinsic::getDeclaration(TheModule.get(), Intrinsic::ceil, DoubleTy);
+    Value *Count = Builder.CreateFSub(Builder.CreateCall(Ceil, LimitVal, "limit"),
+            ConstantFP::get(C, APFloat(StartVal)), "span");
+    if (StepVal != 1.0)
+        Count = Builder.CreateCall(Ceil,
+                Builder.CreateFDiv(Count, ConstantFP::get(C, APFloat(StepVal))), "span");
+    Value *Zero = ConstantFP::get(C, APFloat(0.0));
+    Value *Bounded = Builder.CreateFCmpOLT(Count, ConstantFP::get(C, APFloat(double(1ull << 52))));
+    Count = Builder.CreateSelect(Builder.CreateFCmpOGT(Count, Zero), Count, Zero);
+    Count = Builder.CreateFPToSI(Builder.CreateSelect(Bounded, Count, Zero), Int64Ty);
+    Value *TripCount = Builder.CreateSelect(Bounded,
+            Builder.CreateAdd(Count, ConstantInt::get(Int64Ty, 1)),
+            ConstantInt::get(Int64Ty, 1ull << 62), "tripcount");
+
+    // Make the new basic block for the loop header, inserting after current block.
+    BasicBlock *PreheaderBB = Builder.GetInsertBlock();
+    BasicBlock *LoopBB = BasicBlock::Create(C, "loop", TheFunction);
+    Builder.CreateBr(LoopBB);
+    Builder.SetInsertPoint(LoopBB);
+
+    PHINode *Counter = Builder.CreatePHI(Int64Ty, 2, "counter");
+    Counter->addIncoming(ConstantInt::get(Int64Ty, 0), PreheaderBB);
+    std::string LoopKey = KSProfile.emitCounter();
+
+    // Compute the variable from the counter.
+    Value *IntVar = Counter;
+    if (StepVal != 1.0)
+        IntVar = Builder.CreateNSWMul(IntVar, ConstantInt::get(Int64Ty, (int64_t)StepVal));
+    if (StartVal != 0.0)
+        IntVar = Builder.CreateNSWAdd(IntVar, ConstantInt::get(Int64Ty, (int64_t)StartVal));
+    Value *Binding = BindVariable(TheFunction, VarName, Builder.CreateSIToFP(IntVar, DoubleTy));
+
+    // If the variable shadows an existing variable, we have to restore it, so save it now.
+    Value *OldVal = NamedValues[VarName];
+    NamedValues[VarName] = Binding;
+
+    // Emit the body of the loop, its value is ignored.
+    LoopIndices[Binding] = IntVar;
+    Value *BodyVal = Body->codegen();
+    LoopIndices.erase(Binding);
+    if (!BodyVal)
+        return nullptr;
+
+    Value *NextCounter = Builder.CreateNSWAdd(Counter, ConstantInt::get(Int64Ty, 1), "nextcounter");
+    Counter->addIncoming(NextCounter, Builder.GetInsertBlock());
+    Value *EndCond = Builder.CreateICmpSLT(NextCounter, TripCount, "loopcond");
+
+    // Create the "after loop" block and insert it
+    BasicBlock *AfterBB = BasicBlock::Create(C, "afterloop", TheFunction);
+    BranchInst *LoopBr = Builder.CreateCondBr(EndCond, LoopBB, AfterBB);
+    Builder.SetInsertPoint(AfterBB);
+
+    // Every run of the body but the last takes the back edge.
+    std::string ExitKey = KSProfile.emitCounter();
+    uint64_t LoopCount = KSProfile.getCount(LoopKey), ExitCount = KSProfile.getCount(ExitKey);
+    KSProfile.setBranchWeights(LoopBr, LoopCount - std::min(LoopCount, ExitCount), ExitCount);
+
+    // Restore the unshadowed variable
+    if (OldVal) {
+        NamedValues[VarName] = OldVal;
+    } else {
+        NamedValues.erase(VarName);
+    }
+
+    // for expr always returns 0.0
+    return Constant::getNullValue(DoubleTy);
+}
+
+// ================================================================
+// Parallel Loops (parfor)
+// ================================================================
+
+// A parfor loop is outlined into three internal functions, and run by
+// __yorkie_parfor in lib/parallel.cpp:
+//   body(env, i)           the loop body for one value of the loop variable
+//   chunk(env, begin, end) runs iterations [begin, end) and reduces their values
+//   combine(a, b)          the reduction operator, to combine the chunks
+// env holds the start and step of the loop followed by the variables in scope
+// at the loop, every iteration gets its own copy of them so the iterations are
+// independent. Arrays take two slots, holding the bits of their data pointer
+// and length, and are shared by all iterations. Vectors take a slot per lane.
+
+static void StoreToEnv(Value *Env, unsigned Slot, Value *V) {
+    Type *DoubleTy = Type::getDoubleTy(getGlobalContext());
+    Type *Int64Ty = Type::getInt64Ty(getGlobalContext());
+    if (isVector(V)) {
+        Value *Ptr = Builder.CreateBitCast(Builder.CreateConstGEP1_32(Env, Slot), V->getType()->getPointerTo());
+        Builder.CreateAlignedStore(V, Ptr, 8);
+        return;
+    }
+    if (!isArray(V)) {
+        Builder.CreateStore(V, Builder.CreateConstGEP1_32(Env, Slot));
+        return;
+    }
+
+    Value *Data = Builder.CreatePtrToInt(Builder.CreateExtractValue(V, 0), Int64Ty);
+    Builder.CreateStore(Builder.CreateBitCast(Data, DoubleTy), Builder.CreateConstGEP1_32(Env, Slot));
+    Value *Length = Builder.CreateExtractValue(V, 1);
+    Builder.CreateStore(Builder.CreateBitCast(Length, DoubleTy), Builder.CreateConstGEP1_32(Env, Slot + 1));
+}
+
+static Value *LoadFromEnv(Value *Env, unsigned Slot, Type *Ty, const Twine &Name) {
+    if (Ty->isVectorTy()) {
+        Value *Ptr = Builder.CreateBitCast(Builder.CreateConstGEP1_32(Env, Slot), Ty->getPointerTo());
+        return Builder.CreateAlignedLoad(Ptr, 8, Name);
+    }
+    if (Ty != getArrayTy())
+        return Builder.CreateLoad(Builder.CreateConstGEP1_32(Env, Slot), Name);
+
+    Type *Int64Ty = Type::getInt64Ty(getGlobalContext());
+    Value *Data = Builder.CreateBitCast(Builder.CreateLoad(Builder.CreateConstGEP1_32(Env, Slot)), Int64Ty);
+    Value *Length = Builder.CreateBitCast(Builder.CreateLoad(Builder.CreateConstGEP1_32(Env, Slot + 1)), Int64Ty);
+    return MakeArray(Builder.CreateIntToPtr(Data, Type::getDoublePtrTy(getGlobalContext())), Length);
+}
+
+static unsigned getEnvSlots(const Value *Variable) {
+    Type *Ty = getVariableType(Variable);
+    if (Ty->isVectorTy())
+        return Ty->getVectorNumElements();
+    return Ty == getArrayTy() ? 2 : 1;
+}
+
+// EmitReduction - Combine two iteration values with the loop's reduction operator.
+static Value *EmitReduction(IRBuilder<> &B, char Op, Value *L, Value *R) {
+    if (Op == '+')
+        return B.CreateFAdd(L, R, "addtmp");
+    if (Op == '*')
+        return B.CreateFMul(L, R, "multmp");
+
+    Function *F = getFunction(std::string("binary") + Op);
+    CallInst *Call = B.CreateCall(F, { L, R }, "reduce");
+    Call->setCallingConv(F->getCallingConv());
+    return Call;
+}
+
+// Gives the generated helper F a subprogram at Line, so that code can be
+// inlined into it with its debug locations intact. Returns null without debug info.
+static DISubprogram *CreateHelperSubprogram(Function *F, unsigned Line) {
+    if (!KSDbgInfo.TheCU)
+        return nullptr;
+    DIFile *Unit = KSDbgInfo.TheFile;
+    DISubprogram *SP = DBuilder->createFunction(
+            Unit, F->getName(), StringRef(), Unit, Line,
+            CreateFunctionType(F->arg_size()), F->hasLocalLinkage(),
+            true /* definition */, Line, DINode::FlagPrototyped, false);
+    F->setSubprogram(SP);
+    return SP;
+}
+
+// Generate the outlined body, double body(double *Env, double I). Variables
+// are loaded from Env in the order of Captures.
+static Function *GenerateParallelBody(ForExprAST &Loop, const Twine &Prefix, const std::string &VarName,
+        ExprAST &Body, const std::vector<std::pair<std::string, Value *>> &Captures) {
+    LLVMContext &C = getGlobalContext();
+    Type *DoubleTy = Type::getDoubleTy(C);
+    FunctionType *FT = FunctionType::get(DoubleTy, { DoubleTy->getPointerTo(), DoubleTy }, false);
+    Function *BodyF = Function::Create(FT, Function::InternalLinkage,
+            Prefix + ".body", TheModule.get());
+    BodyF->addFnAttr(Attribute::AlwaysInline);
+    addTargetAttributes(BodyF, Builder.getFastMathFlags().unsafeAlgebra());
+
+    auto SavedIP = Builder.saveIP();
+    std::map<std::string, Value*> SavedValues = NamedValues;
+    NamedValues.clear();
+
+    DISubprogram *SP = CreateHelperSubprogram(BodyF, Loop.getLine());
+    KSDbgInfo.LexicalBlocks.push_back(SP);
+    KSDbgInfo.emitLocation(nullptr);
+
+    Builder.SetInsertPoint(BasicBlock::Create(C, "entry", BodyF));
+    auto AI = BodyF->arg_begin();
+    Value *Env = &*AI++;
+    Value *IndVar = &*AI;
+    Env->setName("env");
+    IndVar->setName(VarName);
+
+    unsigned Slot = 2;
+    for (auto &Capture : Captures) {
+        const std::string &Name = Capture.first;
+        Type *Ty = getVariableType(Capture.second);
+        NamedValues[Name] = BindVariable(BodyF, Name, LoadFromEnv(Env, Slot, Ty, Name));
+        if (Ty == getArrayTy())
+            ArrayOrigins[NamedValues[Name]] = getArrayOrigin(Capture.second);
+        Slot += getEnvSlots(Capture.second);
+    }
+    NamedValues[VarName] = BindVariable(BodyF, VarName, IndVar);
+
+    KSDbgInfo.emitLocation(&Body);
+    Value *BodyVal = ExpectNumber(Body.codegen());
+    if (BodyVal) {
+        Builder.CreateRet(BodyVal);
+        verifyFunction(*BodyF);
+    } else {
+        BodyF->eraseFromParent();
+        BodyF = nullptr;
+    }
+
+    KSDbgInfo.LexicalBlocks.pop_back();
+    NamedValues = SavedValues;
+    Builder.restoreIP(SavedIP);
+    return BodyF;
+}
+
+// Generate double chunk(double *Env, i64 Begin, i64 End), which reduces the
+// iterations [Begin, End). The runtime never calls it with an empty range.
+static Function *GenerateParallelChunk(ForExprAST &Loop, const Twine &Prefix, Function *BodyF,
+        char ReduceOp) {
+    LLVMContext &C = getGlobalContext();
+    Type *DoubleTy = Type::getDoubleTy(C);
+    Type *Int64Ty = Type::getInt64Ty(C);
+    FunctionType *FT = FunctionType::get(DoubleTy,
+            { DoubleTy->getPointerTo(), Int64Ty, Int64Ty }, false);
+    Function *ChunkF = Function::Create(FT, Function::InternalLinkage,
+            Prefix + ".chunk", TheModule.get());
+    addTargetAttributes(ChunkF, Builder.getFastMathFlags().unsafeAlgebra());
+
+    auto AI = ChunkF->arg_begin();
+    Value *Env = &*AI++;
+    Value *Begin = &*AI++;
+    Value *End = &*AI;
+    Env->setName("env");
+    Begin->setName("begin");
+    End->setName("end");
+
+    BasicBlock *EntryBB = BasicBlock::Create(C, "entry", ChunkF);
+    BasicBlock *LoopBB = BasicBlock::Create(C, "loop", ChunkF);
+    BasicBlock *ExitBB = BasicBlock::Create(C, "exit", ChunkF);
+    IRBuilder<> B(EntryBB);
+    B.setFastMathFlags(Builder.getFastMathFlags());
+    B.SetCurrentDebugLocation(DebugLoc::get(Loop.getLine(), Loop.getCol(),
+            CreateHelperSubprogram(ChunkF, Loop.getLine())));
+
+    // The loop variable is Start + K * Step for iteration K.
+    Value *StartVal = B.CreateLoad(B.CreateConstGEP1_32(Env, 0), "start");
+    Value *StepVal = B.CreateLoad(B.CreateConstGEP1_32(Env, 1), "step");
+    auto RunBody = [&](Value *K) {
+        Value *I = B.CreateFAdd(StartVal,
+                B.CreateFMul(B.CreateSIToFP(K, DoubleTy), StepVal, "offset"), "i");
+        return B.CreateCall(BodyF, { Env, I }, "iter");
+    };
+
+    Value *First = RunBody(Begin);
+    Value *Next = B.CreateAdd(Begin, ConstantInt::get(Int64Ty, 1), "next");
+    B.CreateCondBr(B.CreateICmpSLT(Next, End, "more"), LoopBB, ExitBB);
+
+    B.SetInsertPoint(LoopBB);
+    PHINode *K = B.CreatePHI(Int64Ty, 2, "k");
+    PHINode *Acc = B.CreatePHI(DoubleTy, 2, "acc");
+    Value *NextAcc = EmitReduction(B, ReduceOp, Acc, RunBody(K));
+    Value *NextK = B.CreateAdd(K, ConstantInt::get(Int64Ty, 1), "nextk");
+    B.CreateCondBr(B.CreateICmpSLT(NextK, End, "more"), LoopBB, ExitBB);
+    K->addIncoming(Next, EntryBB);
+    K->addIncoming(NextK, LoopBB);
+    Acc->addIncoming(First, EntryBB);
+    Acc->addIncoming(NextAcc, LoopBB);
+
+    B.SetInsertPoint(ExitBB);
+    PHINode *Result = B.CreatePHI(DoubleTy, 2, "result");
+    Result->addIncoming(First, EntryBB);
+    Result->addIncoming(NextAcc, LoopBB);
+    B.CreateRet(Result);
+
+    verifyFunction(*ChunkF);
+    return ChunkF;
+}
+
+// Generate double combine(double, double), the reduction operator as a
+// function the runtime can call.
+static Function *GenerateParallelCombine(ForExprAST &Loop, const Twine &Prefix, char ReduceOp) {
+    LLVMContext &C = getGlobalContext();
+    Type *DoubleTy = Type::getDoubleTy(C);
+    FunctionType *FT = FunctionType::get(DoubleTy, { DoubleTy, DoubleTy }, false);
+    Function *CombineF = Function::Create(FT, Function::InternalLinkage,
+            Prefix + ".combine", TheModule.get());
+    addTargetAttributes(CombineF, Builder.getFastMathFlags().unsafeAlgebra());
+
+    IRBuilder<> B(BasicBlock::Create(C, "entry", CombineF));
+    B.setFastMathFlags(Builder.getFastMathFlags());
+    B.SetCurrentDebugLocation(DebugLoc::get(Loop.getLine(), Loop.getCol(),
+            CreateHelperSubprogram(CombineF, Loop.getLine())));
+    auto AI = CombineF->arg_begin();
+    Value *L = &*AI++;
+    Value *R = &*AI;
+    B.CreateRet(EmitReduction(B, ReduceOp, L, R));
+
+    verifyFunction(*CombineF);
+    return CombineF;
+}
+
+// Generate code for parfor loops
+//   ...
+//   env = { start, step, captured variables... }
+//   n = max(ceil((limit - start) / step), 0)
+//   result = __yorkie_parfor(chunk, combine, env, n, identity)
+Value *ForExprAST::codegenParallel() {
+    LLVMContext &C = getGlobalContext();
+    Type *DoubleTy = Type::getDoubleTy(C);
+    Type *Int64Ty = Type::getInt64Ty(C);
+    Function *TheFunction = Builder.GetInsertBlock()->getParent();
+
+    bool KnownOp = ReduceOp == '+' || ReduceOp == '*' ||
+        (!BinaryExprAST::isBuiltin(ReduceOp) && getFunction(std::string("binary") + ReduceOp));
+    if (!KnownOp)
+        return ErrorV("Unknown reduction operator");
+
+    // The -profile runtime and the -profile-generate counters are plain
+    // globals, the worker threads would corrupt them.
+    if (ProfilerMode != NoProfiler || KSProfile.Generate)
+        return ErrorV("parfor can't be used with -profile or -profile-generate");
+
+    // Emit debug location
+    KSDbgInfo.emitLocation(this);
+
+    // The loop header is evaluated once, before the loop variable is in scope.
+    Value *StartVal = ExpectNumber(Start->codegen());
+    if (!StartVal)
+        return nullptr;
+    Value *Limit = ExpectNumber(End->codegen());
+    if (!Limit)
+        return nullptr;
+    Value *StepVal = ConstantFP::get(C, APFloat(1.0));
+    if (Step) {
+        StepVal = ExpectNumber(Step->codegen());
+        if (!StepVal)
+            return nullptr;
+    }
+
+    // Every variable in scope is passed to the body, except the loop variable.
+    std::vector<std::pair<std::string, Value *>> Captures;
+    unsigned NumSlots = 2;
+    for (auto &NV : NamedValues) {
+        if (NV.second && NV.first != VarName) {
+            Captures.push_back(NV);
+            NumSlots += getEnvSlots(NV.second);
+        }
+    }
+
+    std::string Prefix = (TheFunction->getName() + ".parfor").str();
+    Function *BodyF = GenerateParallelBody(*this, Prefix, VarName, *Body, Captures);
+    KSDbgInfo.emitLocation(this);
+    if (!BodyF)
+        return nullptr;
+    Function *ChunkF = GenerateParallelChunk(*this, Prefix, BodyF, ReduceOp);
+    Function *CombineF = GenerateParallelCombine(*this, Prefix, ReduceOp);
+
+    // Fill in the environment.
+    IRBuilder<> TmpB(&TheFunction->getEntryBlock(), TheFunction->getEntryBlock().begin());
+    Value *Env = TmpB.CreateAlloca(DoubleTy,
+            ConstantInt::get(Type::getInt32Ty(C), NumSlots), "parfor.env");
+    StoreToEnv(Env, 0, StartVal);
+    StoreToEnv(Env, 1, StepVal);
+    unsigned Slot = 2;
+    for (auto &Capture : Captures) {
+        StoreToEnv(Env, Slot, LoadVariable(Capture.second, Capture.first));
+        Slot += getEnvSlots(Capture.second);
+    }
+
+    // Compute the trip count, a NaN or non-positive count runs no iterations.
+    Function *Ceil = Intrinsic::getDeclaration(TheModule.get(), Intrinsic::ceil, DoubleTy);
+    Value *Count = Builder.CreateCall(Ceil,
+            Builder.CreateFDiv(Builder.CreateFSub(Limit, StartVal, "span"), StepVal, "count"), "count");
+    Value *MaxCount = ConstantFP::get(C, APFloat(double(1ull << 62)));
+    Count = Builder.CreateSelect(Builder.CreateFCmpOLT(Count, MaxCount), Count, MaxCount, "count");
+    Value *N = Builder.CreateSelect(
+            Builder.CreateFCmpOGT(Count, ConstantFP::get(C, APFloat(0.0))),
+            Builder.CreateFPToSI(Count, Int64Ty), ConstantInt::get(Int64Ty, 0), "n");
+
+    // An empty loop gives the operator's identity.
+    Value *Identity = ConstantFP::get(C, APFloat(getReduceIdentity(ReduceOp)));
+    Constant *Runtime = TheModule->getOrInsertFunction("__yorkie_parfor",
+            FunctionType::get(DoubleTy, { ChunkF->getType(), CombineF->getType(),
+                    DoubleTy->getPointerTo(), Int64Ty, DoubleTy }, false));
+    return Builder.CreateCall(Runtime, { ChunkF, CombineF, Env, N, Identity }, "parfor");
+}
+
+// Generate code for unary expressions
+Value *UnaryExprAST::codegen() {
+    Value *OperandV = ExpectNumber(Operand->codegen());
+    if (!OperandV)
+        return nullptr;
+
+    Function *F = getFunction(std::string("unary") + Opcode);
+    if (!F)
+        return ErrorV("Unknown unary operator");
+
+    // Emit debug location
+    KSDbgInfo.emitLocation(this);
+
+    // Return function call
+    return EmitCall(F, OperandV, "unop");
+}
+
+// Code generation for var/in expressions
+Value *VarExprAST::codegen() {
+    std::vector<Value *> OldBindings;
+    std::vector<Value *> Allocated;
 
     Function *TheFunction = Builder.GetInsertBlock()->getParent();
 
@@ -592,25 +2243,43 @@ Value *VarExprAST::codegen() {
             InitVal = ConstantFP::get(getGlobalContext(), APFloat(0.0));
         }
 
-        AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, VarName);
-        Builder.CreateStore(InitVal, Alloca);
+        // Arrays declared here ("var a[n]") are freed at the end, other array
+        // variables just refer to an existing array.
+        if (Init && isa<ArrayAllocExprAST>(Init))
+            Allocated.push_back(InitVal);
+
+        Value *Binding = BindVariable(TheFunction, VarName, InitVal);
+
+        // An array variable initialized from another refers to the same array.
+        if (auto *InitVar = dyn_cast_or_null<VariableExprAST>(Init))
+            if (isArray(InitVal))
+                ArrayOrigins[Binding] = getArrayOrigin(NamedValues[InitVar->getName()]);
 
         // Remember to old variable binding so that we can restore the binding when
         // we unrecurse.
         OldBindings.push_back(NamedValues[VarName]);
 
         // Remember this binding
-        NamedValues[VarName] = Alloca;
+        NamedValues[VarName] = Binding;
     }
 
     // Emit debug location
     KSDbgInfo.emitLocation(this);
 
-    // Codegen the body, now that all vars are in scope
-    Value *BodyVal = Body->codegen();
+    // Codegen the body, now that all vars are in scope. Arrays can't outlive
+    // their variables.
+    Value *BodyVal = ExpectNumberOrVector(Body->codegen());
     if (!BodyVal)
         return nullptr;
 
+    // Free the arrays declared here.
+    if (!Allocated.empty()) {
+        Constant *Free = TheModule->getOrInsertFunction("__yorkie_array_free",
+                Type::getVoidTy(getGlobalContext()), Type::getDoublePtrTy(getGlobalContext()), nullptr);
+        for (Value *Array : Allocated)
+            Builder.CreateCall(Free, Builder.CreateExtractValue(Array, 0, "data"));
+    }
+
     // Pop all our variables from scope.
     for (unsigned i = 0, e = VarNames.size(); i != e; ++i) {
         NamedValues[VarNames[i].first] = OldBindings[i];
@@ -620,6 +2289,141 @@ Value *VarExprAST::codegen() {
     return BodyVal;
 }
 
+// Generate code for array declarations, a zeroed array of the given length.
+// Negative and NaN lengths give an empty array.
+Value *ArrayAllocExprAST::codegen() {
+    KSDbgInfo.emitLocation(this);
+
+    Value *LengthV = ExpectNumber(Length->codegen());
+    if (!LengthV)
+        return nullptr;
+
+    Type *Int64Ty = Type::getInt64Ty(getGlobalContext());
+    Value *Positive = Builder.CreateFCmpOGT(LengthV, ConstantFP::get(getGlobalContext(), APFloat(0.0)));
+    Value *N = Builder.CreateSelect(Positive, Builder.CreateFPToSI(LengthV, Int64Ty),
+            ConstantInt::get(Int64Ty, 0), "len");
+
+    // The data is fresh memory, like malloc's.
+    Constant *Alloc = TheModule->getOrInsertFunction("__yorkie_array_alloc",
+            Type::getDoublePtrTy(getGlobalContext()), Int64Ty, nullptr);
+    if (Function *AllocF = dyn_cast<Function>(Alloc))
+        AllocF->setDoesNotAlias(0);
+    return MakeArray(Builder.CreateCall(Alloc, N, "data"), N);
+}
+
+// Generate the address of an array element.
+Value *IndexExprAST::codegenAddress() {
+    Value *ArrayV = Array->codegen();
+    if (!ArrayV)
+        return nullptr;
+    return EmitElementAddress(ArrayV, *Index);
+}
+
+// Generate code for array elements
+Value *IndexExprAST::codegen() {
+    KSDbgInfo.emitLocation(this);
+
+    Value *Element = codegenAddress();
+    if (!Element)
+        return nullptr;
+    return Builder.CreateLoad(Element, "elt");
+}
+
+// Generate code for array lengths, the length of a vector is its width.
+Value *LengthExprAST::codegen() {
+    KSDbgInfo.emitLocation(this);
+
+    Value *ArrayV = Array->codegen();
+    if (!ArrayV)
+        return nullptr;
+    if (isVector(ArrayV))
+        return ConstantFP::get(getGlobalContext(), APFloat(double(ArrayV->getType()->getVectorNumElements())));
+    if (!isArray(ArrayV))
+        return ErrorV("expected an array");
+
+    Value *N = Builder.CreateExtractValue(ArrayV, 1, "len");
+    return Builder.CreateSIToFP(N, Type::getDoubleTy(getGlobalContext()), "len");
+}
+
+// ================================================================
+// Batch Evaluation (-batch)
+// ================================================================
+
+// For every function named by -batch an external
+//   void <name>_batch(const double *const *Cols, double *Out, int64_t N)
+// is generated, computing Out[i] = <name>(Cols[0][i], Cols[1][i], ...) for every
+// i below N. The function is inlined into the loop, which the loop vectorizer
+// can then handle at -O2 and above. The columns must not overlap Out.
+static bool isBatchFunction(const std::string &Name) {
+    return std::find(BatchFunctions.begin(), BatchFunctions.end(), Name) != BatchFunctions.end();
+}
+
+// The -batch functions a wrapper was generated for, in any module: with
+// -stream-dir most are in batches written out already.
+static std::set<std::string> BatchWrappers;
+
+static Function *GenerateBatchWrapper(Function *F, const PrototypeAST &P) {
+    if (P.hasArrayArgs() || !F->getReturnType()->isDoubleTy())
+        return (Function*)ErrorV("-batch functions must take and return numbers");
+
+    LLVMContext &C = getGlobalContext();
+    Type *DoublePtrTy = Type::getDoublePtrTy(C);
+    Type *Int64Ty = Type::getInt64Ty(C);
+    FunctionType *FT = FunctionType::get(Type::getVoidTy(C),
+            { DoublePtrTy->getPointerTo(), DoublePtrTy, Int64Ty }, false);
+    Function *BatchF = Function::Create(FT, Function::ExternalLinkage,
+            P.getName() + "_batch", TheModule.get());
+    BatchF->setDoesNotAlias(1);
+    BatchF->setDoesNotCapture(1);
+    BatchF->setOnlyReadsMemory(1);
+    BatchF->setDoesNotAlias(2);
+    BatchF->setDoesNotCapture(2);
+    addTargetAttributes(BatchF, P.isFastMath());
+
+    auto AI = BatchF->arg_begin();
+    Value *Cols = &*AI++;
+    Value *Out = &*AI++;
+    Value *N = &*AI;
+    Cols->setName("cols");
+    Out->setName("out");
+    N->setName("n");
+
+    BasicBlock *EntryBB = BasicBlock::Create(C, "entry", BatchF);
+    BasicBlock *LoopBB = BasicBlock::Create(C, "loop", BatchF);
+    BasicBlock *ExitBB = BasicBlock::Create(C, "exit", BatchF);
+    IRBuilder<> B(EntryBB);
+    B.SetCurrentDebugLocation(DebugLoc::get(P.getLine(), 0,
+            CreateHelperSubprogram(BatchF, P.getLine())));
+
+    // Load the column pointers once, before the loop.
+    const std::vector<std::string> &ArgNames = P.getArgs();
+    std::vector<Value *> Columns;
+    for (unsigned i = 0, e = ArgNames.size(); i != e; ++i)
+        Columns.push_back(B.CreateLoad(B.CreateConstGEP1_32(Cols, i), ArgNames[i]));
+    B.CreateCondBr(B.CreateICmpSGT(N, ConstantInt::get(Int64Ty, 0), "any"), LoopBB, ExitBB);
+
+    B.SetInsertPoint(LoopBB);
+    PHINode *I = B.CreatePHI(Int64Ty, 2, "i");
+    std::vector<Value *> Args;
+    for (unsigned i = 0, e = Columns.size(); i != e; ++i)
+        Args.push_back(B.CreateLoad(B.CreateInBoundsGEP(Columns[i], I), ArgNames[i]));
+    CallInst *Call = B.CreateCall(F, Args, "result");
+    Call->setCallingConv(F->getCallingConv());
+    Call->addAttribute(AttributeSet::FunctionIndex, Attribute::AlwaysInline);
+    B.CreateStore(Call, B.CreateInBoundsGEP(Out, I));
+
+    Value *NextI = B.CreateNSWAdd(I, ConstantInt::get(Int64Ty, 1), "nexti");
+    B.CreateCondBr(B.CreateICmpSLT(NextI, N, "more"), LoopBB, ExitBB);
+    I->addIncoming(ConstantInt::get(Int64Ty, 0), EntryBB);
+    I->addIncoming(NextI, LoopBB);
+
+    B.SetInsertPoint(ExitBB);
+    B.CreateRetVoid();
+
+    verifyFunction(*BatchF);
+    BatchWrappers.insert(P.getName());
+    return BatchF;
+}
 
 // ================================================================
 // Optimizer
@@ -632,70 +2436,335 @@ void InitializeModule(void) {
     TheModule->setDataLayout(TheJIT->getTargetMachine().createDataLayout());
 }
 
+// Runs the standard -O<n> pipeline over the module. At -O0 only the
+// alwaysinline functions are inlined, small calls were already inlined in the AST.
+static void OptimizeModule() {
+    TargetMachine &TM = getCodeTarget();
+    legacy::PassManager MPM;
+    TheFPM = llvm::make_unique<legacy::FunctionPassManager>(TheModule.get());
+    MPM.add(createTargetTransformInfoWrapperPass(TM.getTargetIRAnalysis()));
+    TheFPM->add(createTargetTransformInfoWrapperPass(TM.getTargetIRAnalysis()));
+
+    PassManagerBuilder PMB;
+    PMB.OptLevel = std::min(OptLevel.getValue(), 3u);
+    PMB.LibraryInfo = CreateLibraryInfo(*TheModule);
+    if (PMB.OptLevel > 0)
+        PMB.Inliner = createFunctionInliningPass(PMB.OptLevel, 0);
+    else
+        PMB.Inliner = createAlwaysInlinerPass();
+    PMB.populateFunctionPassManager(*TheFPM);
+    PMB.populateModulePassManager(MPM);
+
+    TheFPM->doInitialization();
+    for (auto &F : *TheModule)
+        TheFPM->run(F);
+    TheFPM->doFinalization();
+    MPM.run(*TheModule);
+}
+
 
 // ================================================================
 // Top-Level parsing and JIT Driver
 // ================================================================
 
-static void HandleDefinition() {
-    if (auto FnAST = Parser::ParseDefinition(lexer)) {
-        if (!FnAST->codegen()) {
-            fprintf(stderr, "Error reading function definition:");
-        }
-    } else {
-        // Skip token for error recovery.
-        lexer.getNextToken();
+// In whole-program mode definitions and top level expressions are only parsed
+// by the driver, and generated once the whole input has been read.
+static std::vector<std::unique_ptr<FunctionAST>> PendingDefs;
+
+// Counts the AST nodes of a definition for the time report.
+static void CountASTNodes(const FunctionAST &FnAST) {
+    if (!Report.isEnabled())
+        return;
+    uint64_t Nodes = 1;
+    for (auto &E : FnAST.getBody())
+        Nodes += E->getSize();
+    Report.addCounter("ast-nodes", Nodes);
+}
+
+// Counts the IR instructions in the module for the time report.
+static uint64_t CountInstructions(const Module &M) {
+    uint64_t Count = 0;
+    for (auto &F : M)
+        for (auto &BB : F)
+            Count += BB.size();
+    return Count;
+}
+
+// Definitions generated into the current module with -stream-dir.
+static unsigned StreamedDefinitions = 0;
+
+// Runs the AST passes over a definition and generates code for it.
+static bool GenerateDefinition(std::unique_ptr<FunctionAST> FnAST) {
+    {
+        Stats::TimeRegion Region(Report, "ast-passes");
+        // At -O0 nothing else inlines, so inline small calls in the AST. Not
+        // with -profile, inlined functions would be missing from the report.
+        if (OptLevel == 0 && ProfilerMode == NoProfiler)
+            TheInliner->inlineCalls(*FnAST);
+        ConstEval->fold(*FnAST);
     }
+
+    Stats::TimeRegion Region(Report, "codegen");
+    Function *F = FnAST->codegen();
+    if (!F)
+        return false;
+    Report.addCounter("functions", 1);
+
+    if (isBatchFunction(FnAST->getProto().getName()) && !GenerateBatchWrapper(F, FnAST->getProto()))
+        return false;
+
+    // Keep the definition around so later calls to it can be inlined
+    // and evaluated at compile time too.
+    FunctionDefs[FnAST->getProto().getName()] = std::move(FnAST);
+    ++StreamedDefinitions;
+    return true;
 }
 
-static void HandleExtern() {
-    if (auto ProtoAST = Parser::ParseExtern(lexer)) {
-        if (!ProtoAST->codegen())
-            fprintf(stderr, "Error reading extern");
-        else
-            FunctionProtos[ProtoAST->getName()] = std::move(ProtoAST);
-    } else {
-        // Skip token for error recovery.
-        lexer.getNextToken();
+// Generates every pending definition reachable from main, in source order.
+// Reachability comes from the call graph of the definitions' ASTs, anything
+// unreachable is never generated.
+static void GenerateWholeProgram() {
+    std::map<std::string, std::vector<const FunctionAST *>> DefsByName;
+    for (auto &FnAST : PendingDefs)
+        DefsByName[FnAST->getProto().getName()].push_back(FnAST.get());
+
+    // The -batch functions are called from outside too.
+    std::set<std::string> Reachable;
+    std::vector<std::string> Worklist(1, "main");
+    Worklist.insert(Worklist.end(), BatchFunctions.begin(), BatchFunctions.end());
+    while (!Worklist.empty()) {
+        std::string Name = Worklist.back();
+        Worklist.pop_back();
+        if (!Reachable.insert(Name).second)
+            continue;
+
+        std::vector<std::string> Callees;
+        for (auto *FnAST : DefsByName[Name])
+            for (auto &E : FnAST->getBody())
+                E->collectCalls(Callees);
+        Worklist.insert(Worklist.end(), Callees.begin(), Callees.end());
     }
+
+    for (auto &FnAST : PendingDefs) {
+        std::string Name = FnAST->getProto().getName();
+        if (Reachable.count(Name) && !GenerateDefinition(std::move(FnAST)))
+            fprintf(stderr, "Error generating code for %s", Name.c_str());
+    }
+    PendingDefs.clear();
 }
 
-static void HandleTopLevelExpression() {
-    // Evaluate a top-level expression into an anonymous function.
-    if (auto FnAST = Parser::ParseTopLevelExpr(lexer)) {
-        if (!FnAST->codegen())
-            fprintf(stderr, "Error generating code for top level expression");
-    } else {
-        // Skip token for error recovery.
-        lexer.getNextToken();
+static void HandleDefinition(std::unique_ptr<FunctionAST> FnAST) {
+    CountASTNodes(*FnAST);
+    DefinedNames.insert(FnAST->getProto().getName());
+    if (WholeProgram)
+        PendingDefs.push_back(std::move(FnAST));
+    else if (!GenerateDefinition(std::move(FnAST)))
+        fprintf(stderr, "Error reading function definition:");
+}
+
+static void HandleExtern(std::unique_ptr<PrototypeAST> ProtoAST) {
+    Report.addCounter("ast-nodes", 1);
+    Stats::TimeRegion Region(Report, "codegen");
+    if (!ProtoAST->codegen())
+        fprintf(stderr, "Error reading extern");
+    else
+        FunctionProtos[ProtoAST->getName()] = std::move(ProtoAST);
+}
+
+// Receives the value of each top level expression in interactive mode.
+static std::function<void(double)> PrintResult;
+
+static void StartModule();
+static orc::KaleidoscopeJIT::ModuleHandleT SubmitModule();
+static void FlushStreamModule();
+
+// Whether the current module defines anything, and so has to be JIT compiled
+// before code in another module can call it.
+static bool HasDefinitions(const Module &M) {
+    for (auto &F : M)
+        if (!F.isDeclaration())
+            return true;
+    return false;
+}
+
+// Interactive mode: the expression gets a module of its own, which is JIT
+// compiled, run and removed again. The definitions before it are submitted
+// first in a module that stays, so the work per expression only depends on the
+// expression itself, not on how much was entered before it.
+static void EvaluateTopLevelExpression(std::unique_ptr<FunctionAST> FnAST) {
+    if (HasDefinitions(*TheModule))
+        SubmitModule();
+
+    std::string Name = FnAST->getProto().getName();
+    if (!GenerateDefinition(std::move(FnAST))) {
+        fprintf(stderr, "Error generating code for top level expression");
+        FunctionProtos.erase(Name);
+        FunctionDefs.erase(Name);
+        return;
+    }
+
+    auto H = SubmitModule();
+    {
+        Stats::TimeRegion Region(Report, "jit");
+        if (auto Sym = TheJIT->findSymbol(Name)) {
+            double (*FP)() = (double (*)())(intptr_t)Sym.getAddress();
+            PrintResult(FP());
+        }
     }
+    TheJIT->removeModule(H);
+
+    // The next expression reuses the name.
+    FunctionProtos.erase(Name);
+    FunctionDefs.erase(Name);
 }
 
-// Driver invokes all of the parsing pieces with a top-level dispatch loop.
+static void HandleTopLevelExpression(std::unique_ptr<FunctionAST> FnAST) {
+    CountASTNodes(*FnAST);
+    if (InteractiveMode)
+        EvaluateTopLevelExpression(std::move(FnAST));
+    else if (WholeProgram)
+        PendingDefs.push_back(std::move(FnAST));
+    else if (!GenerateDefinition(std::move(FnAST)))
+        fprintf(stderr, "Error generating code for top level expression");
+}
+
+// A parsed top level item, waiting for code generation.
+struct TopLevelItem {
+    enum ItemKind { EndOfInput, Definition, Extern, Expression };
+    ItemKind Kind = EndOfInput;
+    std::unique_ptr<FunctionAST> FnAST;     // Definition or Expression
+    std::unique_ptr<PrototypeAST> ProtoAST; // Extern
+};
+
+// Parses the next top level item, skipping items with syntax errors. Returns
+// false at the end of the input.
 // Ignore top level semicolons.
 // - Reason for this is so the parser knows whether that is the end of what you will type
 // at the command line.
 // - E.g. allows you to type 4+5; and the parser will know you are done.
 // top ::= definition | external | expression | ';'
-static void MainLoop() {
+static bool ParseTopLevelItem(TopLevelItem &Item) {
     while (1) {
         switch(lexer.getCurTok()) {
         case Lexer::tok_eof:
-            return;
+            return false;
         case ';': // ignore top-level semicolons.
             lexer.getNextToken();
-            break;
+            continue;
         case Lexer::tok_def:
-            HandleDefinition();
+            Item.Kind = TopLevelItem::Definition;
+            Item.FnAST = Parser::ParseDefinition(lexer);
             break;
         case Lexer::tok_extern:
-            HandleExtern();
+            Item.Kind = TopLevelItem::Extern;
+            Item.ProtoAST = Parser::ParseExtern(lexer);
             break;
         default:
-            HandleTopLevelExpression();
+            // Evaluate a top-level expression into an anonymous function.
+            Item.Kind = TopLevelItem::Expression;
+            Item.FnAST = Parser::ParseTopLevelExpr(lexer, InteractiveMode ? "__anon_expr" : "main");
             break;
         }
+
+        if (Item.FnAST || Item.ProtoAST)
+            break;
+        // Skip token for error recovery.
+        lexer.getNextToken();
+    }
+
+    // Install the operator precedence now, later input may use it before
+    // the definition is generated.
+    if (Item.Kind == TopLevelItem::Definition) {
+        auto &P = Item.FnAST->getProto();
+        if (P.isBinaryOp())
+            Parser::BinopPrecedence[P.getOperatorName()] = P.getBinaryPrecedence();
     }
+    return true;
+}
+
+static void GenerateTopLevelItem(TopLevelItem Item) {
+    switch (Item.Kind) {
+    case TopLevelItem::Definition:
+        HandleDefinition(std::move(Item.FnAST));
+        break;
+    case TopLevelItem::Extern:
+        HandleExtern(std::move(Item.ProtoAST));
+        break;
+    case TopLevelItem::Expression:
+        HandleTopLevelExpression(std::move(Item.FnAST));
+        break;
+    case TopLevelItem::EndOfInput:
+        break;
+    }
+
+    if (isStreaming() && StreamedDefinitions >= StreamBatch)
+        FlushStreamModule();
+}
+
+// Driver invokes all of the parsing pieces with a top-level dispatch loop.
+static void MainLoop() {
+    while (1) {
+        TopLevelItem Item;
+        {
+            Stats::TimeRegion Region(Report, "parse");
+            if (!ParseTopLevelItem(Item))
+                return;
+        }
+        GenerateTopLevelItem(std::move(Item));
+    }
+}
+
+// Items the parser can be ahead of code generation with -pipeline.
+static const size_t PipelineDepth = 256;
+
+// Binary operator definitions change how the input after them is parsed.
+static bool isBinaryOpDefinition(const TopLevelItem &Item) {
+    return Item.Kind == TopLevelItem::Definition && Item.FnAST->getProto().isBinaryOp();
+}
+
+// The same loop with the lexer and parser on a thread of their own, handing
+// items to code generation (here) through a bounded queue. Parsing the next
+// definitions overlaps with generating code for the previous ones. The parser
+// thread doesn't touch the time report, its parse time is added at the end.
+// An operator whose definition fails to generate loses its precedence again,
+// so after an operator definition the parser waits for it to be generated,
+// as in the serial loop. Only code generation touches the precedences while
+// it waits. Operator definitions are rare, the rest still overlaps.
+static void PipelinedMainLoop() {
+    Pipeline::SPSCQueue<TopLevelItem> Queue(PipelineDepth);
+    uint64_t ParseNanos = 0, ParseCount = 0;
+    std::atomic<bool> OperatorGenerated(false);
+
+    std::thread ParseThread([&] {
+        while (1) {
+            TopLevelItem Item;
+            auto Start = std::chrono::steady_clock::now();
+            bool More = ParseTopLevelItem(Item);
+            ParseNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - Start).count();
+            ++ParseCount;
+            bool Operator = isBinaryOpDefinition(Item);
+            Queue.push(std::move(Item));
+            if (!More)
+                return;
+            while (Operator && !OperatorGenerated.exchange(false, std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+    });
+
+    while (1) {
+        TopLevelItem Item = Queue.pop();
+        if (Item.Kind == TopLevelItem::EndOfInput)
+            break;
+        bool Operator = isBinaryOpDefinition(Item);
+        GenerateTopLevelItem(std::move(Item));
+        if (Operator)
+            OperatorGenerated.store(true, std::memory_order_release);
+    }
+    ParseThread.join();
+
+    llvm::StringRef ParsePath[] = { "frontend", "parse" };
+    Report.addPhaseTime(ParsePath, ParseNanos, ParseCount);
 }
 
 // ================================================================
@@ -729,96 +2798,466 @@ static std::unique_ptr<Module> ParseInputIR(std::string InputFile) {
     return M;
 }
 
-// ================================================================
-// Main Driver code.
-// ================================================================
+// The source file named in the debug info, set by the Context.
+static std::string SourceFilename;
 
-// Command line options
-cl::OptionCategory
-CompilerCategory("Compiler Options", "Options for controlling the compilation process.");
-static cl::opt<std::string>
-InputFilename("input-file", cl::desc("File to compile (defaults to stdin)"),
-              cl::init("-"), cl::value_desc("filename"), cl::cat(CompilerCategory));
-static cl::alias
-InputFileAlias("i", cl::desc("Alias for -input-file"), cl::aliasopt(InputFilename));
+// Opens a new module, with its own debug info compile unit.
+static void StartModule() {
+    InitializeModule();
+    KSDbgInfo.TheCU = nullptr;
+    KSDbgInfo.TheFile = nullptr;
+    KSDbgInfo.DblTy = nullptr;
+    DBuilder.reset();
+    if (DebugInfoLevel == NoDebugInfo)
+        return;
+
+    // Add the current debug info version into the module
+    TheModule->addModuleFlag(Module::Warning, "Debug Info Version",
+            DEBUG_METADATA_VERSION);
 
+    // Darwin only supports dwarf2.
+    if (Triple(sys::getProcessTriple()).isOSDarwin())
+        TheModule->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 2);
+
+    // Construct the DIBuilder, we do this here because we need the module.
+    DBuilder = llvm::make_unique<DIBuilder>(*TheModule);
 
-static void handleCommandLineOptions() {
-    // Open the file to compile.
-    ErrorOr<std::unique_ptr<MemoryBuffer>> FileOrErr =
-    MemoryBuffer::getFileOrSTDIN(InputFilename);
-    if (std::error_code EC = FileOrErr.getError()) {
-        errs() << "Could not open input file '" << InputFilename
-        << "': " << EC.message() << '\n';
-        exit(2);
+    // Create the compile unit for the module, relative paths are resolved
+    // against the directory yorkie ran in. Every function shares its file.
+    SmallString<128> Dir;
+    if (sys::fs::current_path(Dir))
+        Dir = ".";
+    KSDbgInfo.TheCU = DBuilder->createCompileUnit(dwarf::DW_LANG_C, SourceFilename, Dir,
+            "Yorkie Compiler", OptLevel > 0, "", 0, StringRef(),
+            DebugInfoLevel == LineTablesOnly ? DIBuilder::LineTablesOnly : DIBuilder::FullDebug);
+    KSDbgInfo.TheFile = DBuilder->createFile(KSDbgInfo.TheCU->getFilename(),
+            KSDbgInfo.TheCU->getDirectory());
+}
+
+// Interactive mode: JIT compiles the current module and opens the next one.
+// The parfor runtime is added as a module of its own, once, the first time a
+// module needs it.
+static bool LinkedParallel = false;
+
+static orc::KaleidoscopeJIT::ModuleHandleT SubmitModule() {
+    Function *ParFor = TheModule->getFunction("__yorkie_parfor");
+    if (ParFor && ParFor->isDeclaration() && !LinkedParallel) {
+        Stats::TimeRegion Region(Report, "link-parallel");
+        if (auto M = ParseInputIR(RuntimeDir + "/parallel.ll")) {
+            M->setDataLayout(TheJIT->getTargetMachine().createDataLayout());
+            TheJIT->addModule(std::move(M));
+            LinkedParallel = true;
+        } else {
+            fprintf(stderr, "Error linking modules");
+        }
     }
-    std::unique_ptr<MemoryBuffer> &File = FileOrErr.get();
 
-    // Initialize the lexer with the source
-    lexer = Lexer::Lexer(File->getBuffer().str());
+    if (DBuilder) {
+        Stats::TimeRegion Region(Report, "debug-info");
+        DBuilder->finalize();
+    }
+    {
+        Stats::TimeRegion Region(Report, "optimize");
+        OptimizeModule();
+    }
+    KSProfiler.emitFunctionTable(*TheModule, false);
+
+    Stats::TimeRegion Region(Report, "jit");
+    auto H = TheJIT->addModule(std::move(TheModule));
+    KSProfiler.registerJITModule();
+    StartModule();
+    return H;
 }
 
+// Links the parfor runtime into the current module if it's the first to need it.
+static void LinkParallelRuntime() {
+    Function *ParFor = TheModule->getFunction("__yorkie_parfor");
+    if (!ParFor || !ParFor->isDeclaration() || LinkedParallel)
+        return;
 
-int main(int argc, char **argv) {
-    llvm::cl::HideUnrelatedOptions( CompilerCategory );
-    llvm::cl::ParseCommandLineOptions(argc,argv);
-    handleCommandLineOptions();
+    Stats::TimeRegion Region(Report, "link-parallel");
+    auto M = ParseInputIR(RuntimeDir + "/parallel.ll");
+    if (!M || llvm::Linker::linkModules(*TheModule, std::move(M)))
+        fprintf(stderr, "Error linking modules");
+    LinkedParallel = true;
+}
 
+// Streaming mode: optimizes the current module, writes it to -stream-dir and
+// opens the next one. The ASTs of its definitions go with it, only their
+// prototypes stay for calls from later modules, so memory doesn't grow with
+// the input. Each module is compiled on its own, then they're linked.
+static unsigned StreamedModules = 0;
+
+static void FlushStreamModule() {
+    StreamedDefinitions = 0;
+    if (!HasDefinitions(*TheModule))
+        return;
+
+    LinkParallelRuntime();
+    if (DBuilder) {
+        Stats::TimeRegion Region(Report, "debug-info");
+        DBuilder->finalize();
+    }
+    if (Report.isEnabled())
+        Report.addCounter("ir-instructions", CountInstructions(*TheModule));
+    {
+        Stats::TimeRegion Region(Report, "optimize");
+        OptimizeModule();
+    }
+    if (Report.isEnabled())
+        Report.addCounter("ir-instructions-optimized", CountInstructions(*TheModule));
+    KSProfiler.emitFunctionTable(*TheModule, true);
+
+    {
+        Stats::TimeRegion Region(Report, "print-ir");
+        std::string Path = StreamDir + "/yorkie-" + std::to_string(StreamedModules++) + ".ll";
+        std::error_code EC;
+        raw_fd_ostream OS(Path, EC, sys::fs::F_Text);
+        if (EC)
+            Error(("could not write '" + Path + "': " + EC.message()).c_str());
+        else
+            TheModule->print(OS, nullptr);
+    }
+
+    // Internal helpers are per module, the other definitions are linked.
+    for (auto &F : *TheModule)
+        if (!F.isDeclaration() && !F.hasLocalLinkage())
+            StreamedNames.insert(F.getName().str());
+    FunctionDefs.clear();
+    StartModule();
+}
+
+// ================================================================
+// Library Interface (Yorkie.h)
+// ================================================================
+
+// The compiler state above is global, so there is one Context at a time.
+static bool HaveContext = false;
+
+// LLVM's option parser exits by itself on options it can't parse, only the
+// checks of the values below return false.
+bool Yorkie::parseOptions(int Argc, const char *const *Argv, const char *Overview) {
+    cl::HideUnrelatedOptions(CompilerCategory);
+    cl::ParseCommandLineOptions(Argc, Argv, Overview);
 
+    if (VectorWidth == 1 || (VectorWidth & (VectorWidth - 1))) {
+        errs() << "-vector-width must be a power of two, at least 2\n";
+        return false;
+    }
+    if (!StreamDir.empty() && (WholeProgram || !ProfileGenerate.empty() || StreamBatch == 0)) {
+        errs() << "-stream-dir needs -stream-batch of at least 1, "
+                  "and can't be used with -whole-program or -profile-generate\n";
+        return false;
+    }
+    return true;
+}
+
+Yorkie::Context::Context(StringRef Filename, CodeTarget Target) {
+    // The compiler's state is global, a second Context would share it.
+    if (HaveContext)
+        report_fatal_error("only one Yorkie::Context can exist at a time");
+    HaveContext = true;
+    SourceFilename = Filename;
+    CompilingForJIT = Target == CodeTarget::JIT;
+    Report.setEnabled(TimeReportOpt || !TimeReportJSON.empty());
+
+    Report.startPhase("init");
     InitializeNativeTarget();
     InitializeNativeTargetAsmPrinter();
     InitializeNativeTargetAsmParser();
 
     // Install standard binary operators
     // 1 is lowest precendence
+    Parser::BinopPrecedence.clear();
     Parser::BinopPrecedence['='] = 2;
+    Parser::BinopPrecedence['|'] = 5;
+    Parser::BinopPrecedence['&'] = 6;
     Parser::BinopPrecedence['<'] = 10;
+    Parser::BinopPrecedence['>'] = 10;
+    Parser::BinopPrecedence[Lexer::tok_le] = 10;
+    Parser::BinopPrecedence[Lexer::tok_ge] = 10;
+    Parser::BinopPrecedence[Lexer::tok_eq] = 10;
+    Parser::BinopPrecedence[Lexer::tok_ne] = 10;
     Parser::BinopPrecedence['+'] = 20;
     Parser::BinopPrecedence['-'] = 30;
     Parser::BinopPrecedence['*'] = 40; // Highest
+    Parser::BinopPrecedence['/'] = 40;
+    Parser::BinopPrecedence['%'] = 40;
 
-    // Prime the first token.
-    lexer.getNextToken();
+    // Floating point operations follow -ffp-model, and 'def fast' (see
+    // FunctionAST::codegen).
+    Builder.setFastMathFlags(getFastMathFlags(false));
 
     // Initialize the JIT
-    TheJIT = llvm::make_unique<KaleidoscopeJIT>();
+    InitializeTargetCPU();
+    TheJIT = llvm::make_unique<KaleidoscopeJIT>(getTargetOptions(), CPUName, CPUFeatures);
+    if (PerfMap) {
+        PerfMapWriter = llvm::make_unique<Profiling::PerfMapListener>();
+        TheJIT->addEventListener(PerfMapWriter.get());
+    }
+
+    // Set up profile instrumentation or read the profile
+    KSProfile.Generate = !ProfileGenerate.empty();
+    if (!ProfileUse.empty() && !KSProfile.readProfile(ProfileUse)) {
+        errs() << "Could not read profile '" << ProfileUse << "'\n";
+        Valid = false;
+    }
+
+    if (isStreaming()) {
+        if (std::error_code EC = sys::fs::create_directories(StreamDir)) {
+            errs() << "Could not create '" << StreamDir << "': " << EC.message() << '\n';
+            Valid = false;
+        }
+    }
+
+    // Initialize the AST passes
+    ConstEval = llvm::make_unique<Eval::Interpreter>(FunctionDefs, ConstEvalBudget);
+    TheInliner = llvm::make_unique<Inline::Inliner>(FunctionDefs, InlineThreshold);
 
     // Setup the module
-    InitializeModule();
+    StartModule();
+    Report.stopPhase();
 
     // Link in the stdlib
-    auto M = ParseInputIR("lib/stdlib.ll");
-    bool LinkErr = llvm::Linker::linkModules(*TheModule, std::move(M));
+    Report.startPhase("link-stdlib");
+    auto M = ParseInputIR(RuntimeDir + "/stdlib.ll");
+    bool LinkErr = !M || llvm::Linker::linkModules(*TheModule, std::move(M));
     if (LinkErr) {
         fprintf(stderr, "Error linking modules");
     }
+    Report.stopPhase();
+}
 
-    // Add the current debug info version into the module
-    TheModule->addModuleFlag(Module::Warning, "Debug Info Version",
-            DEBUG_METADATA_VERSION);
+// Resets the compiler state for the next Context.
+Yorkie::Context::~Context() {
+    TheFPM.reset();
+    DBuilder.reset();
+    TheModule.reset();
+    TheJIT.reset();
+    GenericTM.reset();
+    PerfMapWriter.reset();
+    ConstEval.reset();
+    TheInliner.reset();
 
-    // Darwin only supports dwarf2.
-    if (Triple(sys::getProcessTriple()).isOSDarwin())
-        TheModule->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 2);
+    NamedValues.clear();
+    AssignedNames.clear();
+    LoopIndices.clear();
+    ArrayOrigins.clear();
+    FunctionProtos.clear();
+    FunctionDefs.clear();
+    DefinedNames.clear();
+    StreamedNames.clear();
+    BatchWrappers.clear();
+    PendingDefs.clear();
+    LexicalBlocks.clear();
+    FnScopeMap.clear();
+    KSDbgInfo = DebugInfo();
+    SourceFilename.clear();
+    InteractiveMode = false;
+    CompilingForJIT = false;
+    TargetWidth = 0;
+    LinkedParallel = false;
+    StreamedDefinitions = 0;
+    StreamedModules = 0;
+    PrintResult = nullptr;
+    KSProfile = ProfileInfo();
+    KSProfiler = ProfilerHooks();
+    Report = Stats::TimeReport();
+    HaveContext = false;
+}
 
-    // Construct the DIBuilder, we do this here because we need the module.
-    DBuilder = llvm::make_unique<DIBuilder>(*TheModule);
+// Compiles the input of the lexer.
+static void RunFrontend() {
+    lexer.setTimeLexing(Report.isEnabled());
 
-    // Create the compile unit for the module.
-    // Currently down as fib.yk as a filename since we're redirecting stdin
-    // but we'd like actual source locations.
-    // TODO: If this isn't building from STDIN, we should use the filename here to enable source debugging.
-    KSDbgInfo.TheCU = DBuilder->createCompileUnit(dwarf::DW_LANG_C, "fib.yk", ".",
-            "Yorkie Compiler", 0, "", 0);
+    // Prime the first token.
+    lexer.getNextToken();
 
     // Run the main "interpreter loop" now.
-    MainLoop();
+    {
+        Stats::TimeRegion Region(Report, "frontend");
+        if (Pipelined)
+            PipelinedMainLoop();
+        else
+            MainLoop();
+    }
+
+    // Lexing happens on demand while parsing, so it's reported as part of it.
+    llvm::StringRef LexPath[] = { "frontend", "parse", "lex" };
+    Report.addPhaseTime(LexPath, lexer.getLexNanos(), lexer.getTokenCount());
+    Report.addCounter("tokens", lexer.getTokenCount());
+}
+
+bool Yorkie::Context::compile(StringRef Source) {
+    // Why the Context isn't valid was reported when it was created.
+    if (!Valid)
+        return false;
+    if (Finalized) {
+        Error("can't compile into a finalized module");
+        return false;
+    }
+    unsigned Errors = getErrorCount();
+
+    {
+        Stats::TimeRegion Region(Report, "read-input");
+        lexer = Lexer::Lexer(Source.str());
+    }
+    RunFrontend();
+    return getErrorCount() == Errors;
+}
+
+// Reading the input is part of lexing here.
+bool Yorkie::Context::compileStream(std::function<bool(std::string &)> Read) {
+    if (!Valid)
+        return false;
+    if (Finalized) {
+        Error("can't compile into a finalized module");
+        return false;
+    }
+    unsigned Errors = getErrorCount();
+
+    lexer = Lexer::Lexer(std::move(Read));
+    RunFrontend();
+    return getErrorCount() == Errors;
+}
+
+void Yorkie::Context::runInteractive(std::function<bool(std::string &)> Read,
+                                     std::function<void(double)> Print) {
+    if (!Valid)
+        return;
+    if (Finalized) {
+        Error("can't compile into a finalized module");
+        return;
+    }
+    if (WholeProgram || isStreaming()) {
+        Error("-whole-program and -stream-dir can't be used interactively");
+        return;
+    }
+    Finalized = true;
+    JITCompiled = true;
+    InteractiveMode = true;
+    CompilingForJIT = true;
+    PrintResult = std::move(Print);
+
+    lexer = Lexer::Lexer(std::move(Read));
+    lexer.setTimeLexing(Report.isEnabled());
+    lexer.getNextToken();
+    {
+        Stats::TimeRegion Region(Report, "frontend");
+        MainLoop();
+    }
+
+    // Definitions after the last expression, for getFunctionAddress().
+    if (HasDefinitions(*TheModule))
+        SubmitModule();
+
+    llvm::StringRef LexPath[] = { "frontend", "parse", "lex" };
+    Report.addPhaseTime(LexPath, lexer.getLexNanos(), lexer.getTokenCount());
+    Report.addCounter("tokens", lexer.getTokenCount());
+}
+
+bool Yorkie::Context::finalize() {
+    if (!Valid)
+        return false;
+    if (Finalized)
+        return true;
+    Finalized = true;
+    unsigned Errors = getErrorCount();
+
+    if (WholeProgram) {
+        Stats::TimeRegion Region(Report, "frontend");
+        GenerateWholeProgram();
+    }
+
+    for (auto &Name : BatchFunctions)
+        if (!BatchWrappers.count(Name))
+            errs() << "-batch: no definition of '" << Name << "'\n";
+
+    if (isStreaming()) {
+        FlushStreamModule();
+        return getErrorCount() == Errors;
+    }
+
+    // Link in the parfor runtime if a loop needs it.
+    LinkParallelRuntime();
+
+    // Register the profile counters with the runtime.
+    KSProfile.finalize(ProfileGenerate);
 
     // Finalize the debug info.
-    DBuilder->finalize();
+    if (DBuilder) {
+        Stats::TimeRegion Region(Report, "debug-info");
+        DBuilder->finalize();
+    }
 
-    // Print out all of the generated code
-    TheModule->dump();
+    // Run the optimizer
+    if (Report.isEnabled())
+        Report.setCounter("ir-instructions", CountInstructions(*TheModule));
+    {
+        Stats::TimeRegion Region(Report, "optimize");
+        OptimizeModule();
+    }
+    if (Report.isEnabled())
+        Report.setCounter("ir-instructions-optimized", CountInstructions(*TheModule));
+    KSProfiler.emitFunctionTable(*TheModule, false);
+
+    return getErrorCount() == Errors;
+}
 
+void Yorkie::Context::printIR(raw_ostream &OS) {
+    if (!Valid)
+        return;
+    finalize();
+    if (isStreaming())
+        return;
+    if (JITCompiled) {
+        Error("the module was JIT compiled, it can't be printed");
+        return;
+    }
+
+    Stats::TimeRegion Region(Report, "print-ir");
+    TheModule->print(OS, nullptr);
+}
+
+uint64_t Yorkie::Context::getFunctionAddress(StringRef Name) {
+    if (!Valid)
+        return 0;
+    finalize();
+    if (isStreaming()) {
+        Error("the module was written to -stream-dir, it can't be JIT compiled");
+        return 0;
+    }
+    if (!JITCompiled) {
+        Stats::TimeRegion Region(Report, "jit");
+        TheJIT->addModule(std::move(TheModule));
+        KSProfiler.registerJITModule();
+        JITCompiled = true;
+    }
+
+    if (auto Sym = TheJIT->findSymbol(Name))
+        return Sym.getAddress();
     return 0;
 }
+
+// Prints the -time-report table and/or writes its JSON form.
+void Yorkie::Context::printTimeReport() {
+    if (!Report.isEnabled())
+        return;
+
+    // Memory mapped for JIT compiled code, if any was.
+    if (size_t Mapped = TheJIT->getMemoryPool().getMappedBytes())
+        Report.addCounter("jit-memory-kb", Mapped / 1024);
+
+    if (TimeReportOpt)
+        Report.print(errs());
+
+    if (!TimeReportJSON.empty()) {
+        std::error_code EC;
+        raw_fd_ostream OS(TimeReportJSON, EC, sys::fs::F_Text);
+        if (EC) {
+            errs() << "Could not open '" << TimeReportJSON << "': " << EC.message() << '\n';
+            return;
+        }
+        Report.printJSON(OS);
+    }
+}
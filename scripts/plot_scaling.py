@@ -0,0 +1,52 @@
+#!/usr/bin/env python
+"""Plots compile time and peak memory against program size.
+
+Usage: scripts/plot_scaling.py bench.json [scaling.png]
+
+bench.json is the output of `make bench` (or of yorkie_bench with
+--benchmark_out), only the BM_CompileScaling results are used. Without
+matplotlib the numbers are printed as a table.
+"""
+
+import json
+import sys
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+
+    with open(sys.argv[1]) as f:
+        results = json.load(f)["benchmarks"]
+
+    rows = []
+    for r in results:
+        if r["name"].startswith("BM_CompileScaling/"):
+            rows.append((int(r["functions"]), r["real_time"], r["peak_rss_kb"] / 1024.0))
+    rows.sort()
+
+    print("%12s %14s %14s" % ("functions", "time (ms)", "peak RSS (MB)"))
+    for functions, time_ms, rss_mb in rows:
+        print("%12d %14.1f %14.1f" % (functions, time_ms, rss_mb))
+
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        return
+
+    sizes = [r[0] for r in rows]
+    fig, (time_ax, rss_ax) = plt.subplots(1, 2, figsize=(12, 5))
+    time_ax.loglog(sizes, [r[1] for r in rows], "o-")
+    time_ax.set_xlabel("functions")
+    time_ax.set_ylabel("compile time (ms)")
+    rss_ax.loglog(sizes, [r[2] for r in rows], "o-")
+    rss_ax.set_xlabel("functions")
+    rss_ax.set_ylabel("peak RSS (MB)")
+    fig.tight_layout()
+    fig.savefig(sys.argv[2] if len(sys.argv) > 2 else "scaling.png")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,95 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "Yorkie.h"
+
+// Arrays are passed to JIT compiled functions as a data pointer and a length,
+// so the tests call them on buffers of their own and check what was written.
+// The data of an array argument must be aligned to 64 bytes.
+class array_test : public ::testing::Test {
+protected:
+    std::unique_ptr<Yorkie::Context> Ctx;
+
+    void SetUp() override { Ctx.reset(new Yorkie::Context("<test>", Yorkie::CodeTarget::JIT)); }
+    void TearDown() override { Ctx.reset(); }
+
+    double jit(const std::string &Name, double A) {
+        auto *F = Ctx->getFunction<double(double)>(Name);
+        EXPECT_TRUE(F != nullptr) << Name;
+        return F ? F(A) : 0;
+    }
+
+    double jit(const std::string &Name, double A, double B) {
+        auto *F = Ctx->getFunction<double(double, double)>(Name);
+        EXPECT_TRUE(F != nullptr) << Name;
+        return F ? F(A, B) : 0;
+    }
+};
+
+static const char *SumSource =
+    "def sum(a[]) var s = 0 in (for i = 0, i < len(a) - 1 in s = s + a[i] end) + s end end\n";
+
+TEST_F(array_test, arguments_are_passed_by_reference) {
+    ASSERT_TRUE(Ctx->compile("def scale(a[] k) for i = 0, i < len(a) - 1 in a[i] = a[i] * k end end\n"));
+
+    auto *Scale = Ctx->getFunction<double(double *, int64_t, double)>("scale");
+    ASSERT_TRUE(Scale != nullptr);
+    alignas(64) double Data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    EXPECT_EQ(0.0, Scale(Data, 7, 3));
+
+    // Only the first len(a) elements are touched.
+    for (int i = 0; i < 7; ++i)
+        EXPECT_EQ(3.0 * (i + 1), Data[i]) << i;
+    EXPECT_EQ(8.0, Data[7]);
+}
+
+TEST_F(array_test, allocated_arrays_are_zeroed) {
+    ASSERT_TRUE(Ctx->compile(std::string(SumSource) +
+                             "def zeros(n) var a[n] in sum(a) + len(a) end end\n"
+                             "def iota(n) var a[n] in (for i = 0, i < n - 1 in a[i] = i end) + sum(a) end end\n"));
+
+    EXPECT_EQ(1.0, jit("zeros", 1));
+    EXPECT_EQ(1000.0, jit("zeros", 1000));
+    EXPECT_EQ(45.0, jit("iota", 10));
+}
+
+TEST_F(array_test, callees_write_to_the_callers_array) {
+    ASSERT_TRUE(Ctx->compile("def put(a[] i v) a[i] = v end\n"
+                             "def roundtrip(i v) var a[4] in put(a, i, v) * 0 + a[i] end end\n"
+                             "def shared(v) var a[2] in (var b = a in b[1] = v end) * 0 + a[1] end end\n"));
+
+    EXPECT_EQ(5.0, jit("roundtrip", 2, 5));
+    EXPECT_EQ(-1.5, jit("roundtrip", 0, -1.5));
+
+    // A variable bound to an array shares its data.
+    EXPECT_EQ(7.0, jit("shared", 7));
+}
+
+TEST_F(array_test, distinct_arrays_can_be_passed_together) {
+    ASSERT_TRUE(Ctx->compile("def copy(d[] s[]) for i = 0, i < len(d) - 1 in d[i] = s[i] * 2 end end\n"
+                             "def twice(v) var a[4], b[4] in (a[3] = v) * 0 + copy(b, a) + b[3] end end\n"));
+
+    EXPECT_EQ(10.0, jit("twice", 5));
+
+    auto *Copy = Ctx->getFunction<double(double *, int64_t, const double *, int64_t)>("copy");
+    ASSERT_TRUE(Copy != nullptr);
+    alignas(64) double Src[4] = { 1, 2, 3, 4 };
+    alignas(64) double Dst[4] = {};
+    Copy(Dst, 4, Src, 4);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_EQ(2 * Src[i], Dst[i]) << i;
+}
+
+TEST_F(array_test, the_same_array_cant_be_passed_twice) {
+    ASSERT_TRUE(Ctx->compile("def copy(d[] s[]) for i = 0, i < len(d) - 1 in d[i] = s[i] end end\n"));
+
+    // Array arguments are noalias, directly or through another variable.
+    EXPECT_FALSE(Ctx->compile("def same(n) var a[n] in copy(a, a) end end\n"));
+    EXPECT_FALSE(Ctx->compile("def alias(n) var a[n] in var b = a in copy(a, b) end end end\n"));
+    EXPECT_FALSE(Ctx->compile("def arg(a[]) copy(a, a) end\n"));
+
+    // Numbers and arrays don't mix.
+    EXPECT_FALSE(Ctx->compile("def num(x) copy(x, x) end\n"));
+    EXPECT_FALSE(Ctx->compile("def ret(n) var a[n] in a end end\n"));
+}
@@ -0,0 +1,160 @@
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "AST.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Yorkie.h"
+
+// The interpreter folds calls at compile time, so it has to give the same
+// result as the code codegen emits. Each test compiles its definitions with a
+// Context and JIT compiles them, parses them again for the interpreter, then
+// runs the same calls both ways.
+class evaluator_test : public ::testing::Test {
+protected:
+    std::unique_ptr<Yorkie::Context> Ctx;
+    FunctionDefMap Definitions;
+
+    void SetUp() override { Ctx.reset(new Yorkie::Context("<test>", Yorkie::CodeTarget::JIT)); }
+    void TearDown() override {
+        Definitions.clear();
+        Ctx.reset();
+    }
+
+    void compile(const std::string &Source) {
+        ASSERT_TRUE(Ctx->compile(Source));
+
+        // The Context installed the operator precedences the parser needs.
+        Lexer::Lexer L(Source);
+        L.getNextToken();
+        while (L.getCurTok() == Lexer::tok_def) {
+            std::unique_ptr<FunctionAST> F = Parser::ParseDefinition(L);
+            ASSERT_TRUE(F != nullptr);
+            std::string Name = F->getProto().getName();
+            Definitions[Name] = std::move(F);
+        }
+        ASSERT_EQ(Lexer::tok_eof, L.getCurTok());
+    }
+
+    double jit(const std::string &Name, double A) {
+        auto *F = Ctx->getFunction<double(double)>(Name);
+        EXPECT_TRUE(F != nullptr) << Name;
+        return F ? F(A) : 0;
+    }
+
+    double jit(const std::string &Name, double A, double B) {
+        auto *F = Ctx->getFunction<double(double, double)>(Name);
+        EXPECT_TRUE(F != nullptr) << Name;
+        return F ? F(A, B) : 0;
+    }
+
+    // Evaluates Name(Args) with the interpreter, None if it ran out of steps.
+    llvm::Optional<double> evaluate(const std::string &Name, std::vector<double> Args,
+                                    uint64_t Budget = 1000000) {
+        std::vector<std::unique_ptr<ExprAST>> ArgExprs;
+        for (double A : Args)
+            ArgExprs.push_back(llvm::make_unique<NumberExprAST>(Lexer::SourceLocation{1, 0}, A));
+        CallExprAST Call(Lexer::SourceLocation{1, 0}, Name, std::move(ArgExprs));
+        return Eval::Interpreter(Definitions, Budget).evaluateConstant(Call);
+    }
+
+    // Compares the two, NaN being equal to NaN.
+    void expectSame(const std::string &Name, std::vector<double> Args) {
+        double JITVal = Args.size() == 1 ? jit(Name, Args[0]) : jit(Name, Args[0], Args[1]);
+        llvm::Optional<double> EvalVal = evaluate(Name, Args);
+        ASSERT_TRUE(EvalVal.hasValue()) << Name;
+        if (std::isnan(JITVal))
+            EXPECT_TRUE(std::isnan(*EvalVal)) << Name << " returned " << *EvalVal;
+        else
+            EXPECT_EQ(JITVal, *EvalVal) << Name;
+    }
+};
+
+static const double NaN = std::numeric_limits<double>::quiet_NaN();
+static const double Inf = std::numeric_limits<double>::infinity();
+
+TEST_F(evaluator_test, comparisons) {
+    compile("def lt(a b) a < b end\n"
+            "def gt(a b) a > b end\n"
+            "def le(a b) a <= b end\n"
+            "def ge(a b) a >= b end\n"
+            "def eq(a b) a == b end\n"
+            "def ne(a b) a != b end\n");
+
+    const double Values[] = { -1, 0, 1, -0.0, Inf, NaN };
+    for (const char *Name : { "lt", "gt", "le", "ge", "eq", "ne" })
+        for (double A : Values)
+            for (double B : Values)
+                expectSame(Name, { A, B });
+
+    // Comparisons are unordered (true with a NaN), except '=='.
+    EXPECT_EQ(1.0, jit("lt", NaN, 1));
+    EXPECT_EQ(1.0, jit("ge", 1, NaN));
+    EXPECT_EQ(0.0, jit("eq", NaN, NaN));
+    EXPECT_EQ(1.0, jit("ne", NaN, NaN));
+}
+
+TEST_F(evaluator_test, logical_and_remainder) {
+    compile("def and(a b) a & b end\n"
+            "def or(a b) a | b end\n"
+            "def rem(a b) a % b end\n");
+
+    const double Values[] = { 0, 1, -2.5, 7, NaN };
+    for (const char *Name : { "and", "or", "rem" })
+        for (double A : Values)
+            for (double B : Values)
+                expectSame(Name, { A, B });
+
+    // A NaN operand is false.
+    EXPECT_EQ(0.0, jit("and", NaN, 1));
+    EXPECT_EQ(1.0, jit("or", NaN, 1));
+}
+
+TEST_F(evaluator_test, if_conditions) {
+    compile("def pick(c) if c then 1 else 2 end end\n"
+            "def pickle(a b) if a <= b then a else b end end\n");
+
+    for (double C : { 0.0, -0.0, 1.0, -3.0, Inf, NaN })
+        expectSame("pick", { C });
+    for (double A : { 0.0, 1.0, NaN })
+        for (double B : { 0.0, 1.0, NaN })
+            expectSame("pickle", { A, B });
+
+    // Only a condition that compares ordered and not equal to 0 is true.
+    EXPECT_EQ(2.0, jit("pick", NaN));
+    EXPECT_EQ(2.0, jit("pick", -0.0));
+}
+
+TEST_F(evaluator_test, for_loops) {
+    compile("def count(n) var c = 0 in (for i = 0, i < n in c = c + 1 end) + c end end\n"
+            "def sum(n s) var t = 0 in (for i = 0, i < n, s in t = t + i end) + t end end\n"
+            "def down(n) var c = 0 in (for i = n, i > 0, 0 - 1 in c = c + i end) + c end end\n");
+
+    for (double N : { -5.0, 0.0, 0.5, 1.0, 3.0, 10.0 }) {
+        expectSame("count", { N });
+        expectSame("down", { N });
+    }
+    for (double N : { 0.0, 1.0, 4.0 })
+        for (double S : { 0.5, 1.0, 3.0 })
+            expectSame("sum", { N, S });
+
+    // The body runs once before the end condition is checked.
+    EXPECT_EQ(1.0, jit("count", 0));
+    EXPECT_EQ(1.0, jit("count", -5));
+    EXPECT_EQ(4.0, jit("count", 3));
+}
+
+TEST_F(evaluator_test, step_budget) {
+    compile("def count(n) var c = 0 in (for i = 0, i < n in c = c + 1 end) + c end end\n");
+
+    EXPECT_EQ(100001.0, jit("count", 100000));
+    EXPECT_FALSE(evaluate("count", { 100000 }, 1000).hasValue());
+    EXPECT_EQ(100001.0, evaluate("count", { 100000 }, 10000000).getValue());
+
+    // A budget of 0 disables the interpreter.
+    EXPECT_FALSE(evaluate("count", { 1 }, 0).hasValue());
+}
@@ -0,0 +1,84 @@
+#include "gtest/gtest.h"
+#include "llvm/Support/Process.h"
+#include "JITMemoryManager.h"
+
+// The pool maps slabs of 16 pages, runs are handed out first fit from the
+// lowest address, so the tests can predict where each one lands.
+class jit_memory_manager_test : public ::testing::Test {
+protected:
+    JIT::MemoryPool Pool;
+    size_t Page;
+
+    jit_memory_manager_test() : Pool(16 * llvm::sys::Process::getPageSize()),
+                                Page(llvm::sys::Process::getPageSize()) {}
+};
+
+TEST_F(jit_memory_manager_test, released_runs_coalesce) {
+    llvm::sys::MemoryBlock A = Pool.allocatePages(Page);
+    llvm::sys::MemoryBlock B = Pool.allocatePages(Page);
+    llvm::sys::MemoryBlock C = Pool.allocatePages(Page);
+    ASSERT_EQ((uint8_t *)A.base() + Page, B.base());
+    ASSERT_EQ((uint8_t *)B.base() + Page, C.base());
+    size_t Mapped = Pool.getMappedBytes();
+
+    // B has no free neighbour, A and C each merge with it, C with the rest of
+    // the slab.
+    Pool.releasePages(B);
+    Pool.releasePages(A);
+    Pool.releasePages(C);
+
+    // The whole slab is one free run again.
+    llvm::sys::MemoryBlock Slab = Pool.allocatePages(16 * Page);
+    EXPECT_EQ(A.base(), Slab.base());
+    EXPECT_EQ(Mapped, Pool.getMappedBytes());
+}
+
+TEST_F(jit_memory_manager_test, pages_are_rounded_up) {
+    llvm::sys::MemoryBlock A = Pool.allocatePages(1);
+    llvm::sys::MemoryBlock B = Pool.allocatePages(Page + 1);
+    EXPECT_EQ(Page, A.size());
+    EXPECT_EQ(2 * Page, B.size());
+    EXPECT_EQ((uint8_t *)A.base() + Page, B.base());
+}
+
+TEST_F(jit_memory_manager_test, data_shares_runs) {
+    uint8_t *X = Pool.allocateData(8, 8);
+    uint8_t *Y = Pool.allocateData(24, 16);
+    ASSERT_TRUE(X && Y);
+    EXPECT_EQ(X + 16, Y);
+    EXPECT_EQ(0u, (uintptr_t)Y % 16);
+}
+
+TEST_F(jit_memory_manager_test, data_run_is_released_when_unused) {
+    // X starts the first run, Big doesn't fit in it and starts a second one.
+    uint8_t *X = Pool.allocateData(8, 8);
+    uint8_t *Big = Pool.allocateData(2 * Page, 8);
+    ASSERT_TRUE(X && Big);
+    ASSERT_EQ(X + Page, Big);
+
+    // The first run is no longer current, it goes with the last data in it.
+    Pool.releaseData(X);
+    EXPECT_EQ(X, Pool.allocatePages(Page).base());
+}
+
+TEST_F(jit_memory_manager_test, current_data_run_is_kept) {
+    uint8_t *X = Pool.allocateData(8, 8);
+    ASSERT_TRUE(X);
+
+    // Nothing in the current run is used anymore, but more data can go there.
+    Pool.releaseData(X);
+    EXPECT_NE(X, Pool.allocatePages(Page).base());
+    EXPECT_EQ(X + 8, Pool.allocateData(8, 8));
+}
+
+TEST_F(jit_memory_manager_test, unused_data_run_is_released_when_replaced) {
+    uint8_t *X = Pool.allocateData(8, 8);
+    ASSERT_TRUE(X);
+    Pool.releaseData(X);
+
+    // Starting a new run releases the unused current one.
+    uint8_t *Big = Pool.allocateData(2 * Page, 8);
+    ASSERT_TRUE(Big);
+    EXPECT_NE(X, Big);
+    EXPECT_EQ(X, Pool.allocatePages(Page).base());
+}
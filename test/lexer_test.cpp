@@ -0,0 +1,39 @@
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "Lexer.h"
+
+// Lexes all of Source.
+static std::vector<int> lex(const std::string &Source) {
+    Lexer::Lexer L(Source);
+    std::vector<int> Tokens;
+    for (int Tok = L.gettok(); Tok != Lexer::tok_eof; Tok = L.gettok())
+        Tokens.push_back(Tok);
+    return Tokens;
+}
+
+TEST(lexer_test, two_character_comparisons) {
+    std::vector<int> Expected = {
+        Lexer::tok_identifier, Lexer::tok_le, Lexer::tok_identifier, Lexer::tok_eq,
+        Lexer::tok_identifier, Lexer::tok_ne, Lexer::tok_identifier, Lexer::tok_ge,
+        Lexer::tok_identifier
+    };
+    EXPECT_EQ(Expected, lex("a <= b == c != d >= e"));
+    EXPECT_EQ(Expected, lex("a<=b==c!=d>=e"));
+}
+
+TEST(lexer_test, single_character_operators) {
+    std::vector<int> Expected = {
+        Lexer::tok_identifier, '<', Lexer::tok_identifier, '=', Lexer::tok_identifier,
+        '>', Lexer::tok_number, '!', Lexer::tok_identifier
+    };
+    EXPECT_EQ(Expected, lex("a < b = c > 1 !d"));
+}
+
+// Only a '=' right after the operator makes a two character token.
+TEST(lexer_test, split_comparisons) {
+    std::vector<int> Expected = { Lexer::tok_identifier, '<', '=', Lexer::tok_identifier };
+    EXPECT_EQ(Expected, lex("a < = b"));
+    Expected = { Lexer::tok_identifier, '=', '=', Lexer::tok_identifier };
+    EXPECT_EQ(Expected, lex("a = = b"));
+}
@@ -0,0 +1,93 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "Yorkie.h"
+
+// Runs interactive sessions the way yorkie -repl does, feeding the input a
+// line at a time and collecting the values of the top level expressions.
+class repl_test : public ::testing::Test {
+protected:
+    std::unique_ptr<Yorkie::Context> Ctx;
+
+    void SetUp() override { Ctx.reset(new Yorkie::Context("<test>", Yorkie::CodeTarget::JIT)); }
+    void TearDown() override { Ctx.reset(); }
+
+    std::vector<double> run(const std::vector<std::string> &Lines) {
+        std::vector<double> Values;
+        size_t Next = 0;
+        Ctx->runInteractive(
+            [&](std::string &Buffer) {
+                if (Next == Lines.size())
+                    return false;
+                Buffer += Lines[Next++];
+                Buffer += '\n';
+                return true;
+            },
+            [&](double Value) { Values.push_back(Value); });
+        return Values;
+    }
+};
+
+TEST_F(repl_test, expressions_run_as_they_are_entered) {
+    std::vector<double> Values = run({ "1 + 2;",
+                                       "def sq(x) x * x end",
+                                       "sq(4);",
+                                       "def quad(x) sq(sq(x)) end",
+                                       "quad(2) + sq(3);" });
+    EXPECT_EQ((std::vector<double>{ 3, 16, 25 }), Values);
+}
+
+TEST_F(repl_test, every_expression_gets_a_module_of_its_own) {
+    // Each expression is removed once it has run, the next one reuses its name.
+    std::vector<std::string> Lines = { "def inc(x) x + 1 end" };
+    for (int i = 0; i < 100; ++i)
+        Lines.push_back("inc(" + std::to_string(i) + ");");
+    std::vector<double> Values = run(Lines);
+
+    ASSERT_EQ(100u, Values.size());
+    for (int i = 0; i < 100; ++i)
+        EXPECT_EQ(i + 1.0, Values[i]);
+}
+
+TEST_F(repl_test, definitions_stay_after_the_session) {
+    EXPECT_EQ((std::vector<double>{ 2 }), run({ "def twice(x) x * 2 end",
+                                                "twice(1);",
+                                                "def thrice(x) x * 3 end" }));
+
+    // Including those after the last expression.
+    auto *Twice = Ctx->getFunction<double(double)>("twice");
+    auto *Thrice = Ctx->getFunction<double(double)>("thrice");
+    ASSERT_TRUE(Twice && Thrice);
+    EXPECT_EQ(10.0, Twice(5));
+    EXPECT_EQ(15.0, Thrice(5));
+}
+
+TEST_F(repl_test, operators_and_externs_carry_over) {
+    std::vector<double> Values = run({ "def binary^ 50 (a b) a * 10 + b end",
+                                       "1 ^ 2;",
+                                       "def unary!(v) if v then 0 else 1 end end",
+                                       "!0 + !3;",
+                                       "extern cos(x)",
+                                       "cos(0);" });
+    EXPECT_EQ((std::vector<double>{ 12, 1, 1 }), Values);
+}
+
+TEST_F(repl_test, earlier_definitions_replace_math_functions) {
+    // sqrt is only declared in the module of the expression, it's still the
+    // function defined in the earlier line.
+    std::vector<double> Values = run({ "extern floor(x)",
+                                       "floor(2.5);",
+                                       "def sqrt(x) x + 1 end",
+                                       "sqrt(4);" });
+    EXPECT_EQ((std::vector<double>{ 2, 5 }), Values);
+}
+
+TEST_F(repl_test, errors_dont_end_the_session) {
+    std::vector<double> Values = run({ "undefined(1);",
+                                       "def bad(x) y end",
+                                       "1 +;",
+                                       "def good(x) x - 1 end",
+                                       "good(3);" });
+    EXPECT_EQ((std::vector<double>{ 2 }), Values);
+}
@@ -0,0 +1,101 @@
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Yorkie.h"
+
+// Only variables assigned with '=' get a stack slot, the others are bound to
+// their SSA value. The tests look at the -O0 IR of a function for its allocas,
+// and check that the values are the same either way.
+class ssa_test : public ::testing::Test {
+protected:
+    std::unique_ptr<Yorkie::Context> Ctx;
+
+    void TearDown() override { Ctx.reset(); }
+
+    // The -O0 IR of the function Name in Source.
+    std::string getFunctionIR(const std::string &Source, const std::string &Name) {
+        Ctx.reset();
+        Ctx.reset(new Yorkie::Context("<test>"));
+        EXPECT_TRUE(Ctx->compile(Source));
+        std::string IR;
+        llvm::raw_string_ostream OS(IR);
+        Ctx->printIR(OS);
+        OS.flush();
+
+        size_t Begin = IR.find("define double @" + Name + "(");
+        if (Begin == std::string::npos)
+            return "";
+        return IR.substr(Begin, IR.find("\n}\n", Begin) - Begin);
+    }
+
+    static unsigned countAllocas(const std::string &IR) {
+        unsigned Count = 0;
+        for (size_t Pos = IR.find(" alloca "); Pos != std::string::npos; Pos = IR.find(" alloca ", Pos + 1))
+            ++Count;
+        return Count;
+    }
+
+    double jit(const std::string &Source, const std::string &Name, double A) {
+        Ctx.reset();
+        Ctx.reset(new Yorkie::Context("<test>", Yorkie::CodeTarget::JIT));
+        EXPECT_TRUE(Ctx->compile(Source));
+        auto *F = Ctx->getFunction<double(double)>(Name);
+        EXPECT_TRUE(F != nullptr) << Name;
+        return F ? F(A) : 0;
+    }
+};
+
+static const char *LetSource = "def poly(x) var y = x * x, z = y + 1 in y * z + x end end\n";
+static const char *LoopSource =
+    "def tri(n) var s = 0 in (for i = 0.5, i < n in s = s + i end) + s end end\n";
+static const char *NestedSource =
+    "def grid(n) var c = 0 in (for i = 0.5, i < n in (for j = 0.5, j < i in c = c + 1 end) end) + c end end\n";
+static const char *ShadowSource =
+    "def shadow(x) var y = x in (var x = 10 in x = x + 1 end) + x + y end end\n";
+static const char *BranchSource =
+    "def pick(c) var r = if c then 3 else 4 end in r * 2 end end\n";
+
+TEST_F(ssa_test, unassigned_variables_have_no_slots) {
+    std::string Let = getFunctionIR(LetSource, "poly");
+    ASSERT_NE("", Let);
+    EXPECT_EQ(0u, countAllocas(Let)) << Let;
+
+    // Only the assigned sum has a slot, the loop variable is a phi.
+    std::string Loop = getFunctionIR(LoopSource, "tri");
+    ASSERT_NE("", Loop);
+    EXPECT_EQ(1u, countAllocas(Loop)) << Loop;
+    EXPECT_NE(std::string::npos, Loop.find("%s = alloca double")) << Loop;
+    EXPECT_NE(std::string::npos, Loop.find("%i = phi double")) << Loop;
+
+    std::string Branch = getFunctionIR(BranchSource, "pick");
+    ASSERT_NE("", Branch);
+    EXPECT_EQ(0u, countAllocas(Branch)) << Branch;
+}
+
+TEST_F(ssa_test, assigned_names_keep_their_slots) {
+    // An assignment in any scope gives every variable of the name a slot.
+    std::string Shadow = getFunctionIR(ShadowSource, "shadow");
+    ASSERT_NE("", Shadow);
+    EXPECT_EQ(2u, countAllocas(Shadow)) << Shadow;
+
+    std::string Arg = getFunctionIR("def bump(x) x = x + 1 end\n", "bump");
+    ASSERT_NE("", Arg);
+    EXPECT_EQ(1u, countAllocas(Arg)) << Arg;
+}
+
+TEST_F(ssa_test, values_are_unchanged) {
+    EXPECT_EQ(4.0 * 5 + 2, jit(LetSource, "poly", 2));
+
+    // The body runs once before the end condition is checked.
+    EXPECT_EQ(0.5 + 1.5 + 2.5 + 3.5, jit(LoopSource, "tri", 3));
+    EXPECT_EQ(0.5, jit(LoopSource, "tri", 0));
+
+    // The inner loop runs 1, 2 then 3 times.
+    EXPECT_EQ(6.0, jit(NestedSource, "grid", 2));
+
+    EXPECT_EQ(11.0 + 1 + 1, jit(ShadowSource, "shadow", 1));
+    EXPECT_EQ(6.0, jit(BranchSource, "pick", 1));
+    EXPECT_EQ(8.0, jit(BranchSource, "pick", 0));
+    EXPECT_EQ(3.0, jit("def bump(x) x = x + 1 end\n", "bump", 2));
+}
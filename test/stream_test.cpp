@@ -0,0 +1,199 @@
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SourceMgr.h"
+#include "KaleidoscopeJIT.h"
+#include "Yorkie.h"
+
+// The options of a process can only be given once and stay set, so each test
+// gives them in a child process of its own (a gtest death test), which exits
+// with 0 if its checks passed. Modules written to -stream-dir are JIT compiled
+// one by one, as clang would link them, and their functions called.
+class stream_test : public ::testing::Test {
+protected:
+    std::string Dir;
+
+    void SetUp() override {
+        llvm::SmallString<128> Path;
+        ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("yorkie-stream", Path));
+        Dir = Path.str().str();
+    }
+
+    void TearDown() override {
+        std::error_code EC;
+        std::vector<std::string> Files;
+        for (llvm::sys::fs::directory_iterator I(Dir, EC), E; I != E && !EC; I.increment(EC))
+            Files.push_back(I->path());
+        for (auto &File : Files)
+            llvm::sys::fs::remove(File);
+        llvm::sys::fs::remove(Dir);
+    }
+
+    std::string getModulePath(unsigned N) const {
+        return Dir + "/yorkie-" + std::to_string(N) + ".ll";
+    }
+
+    // Adds the modules written to Dir to JIT, returns how many there were.
+    unsigned loadModules(llvm::orc::KaleidoscopeJIT &JIT) {
+        unsigned N = 0;
+        for (; llvm::sys::fs::exists(getModulePath(N)); ++N) {
+            llvm::SMDiagnostic Err;
+            auto M = llvm::parseIRFile(getModulePath(N), Err, llvm::getGlobalContext());
+            EXPECT_TRUE(M != nullptr) << getModulePath(N);
+            if (!M)
+                continue;
+            M->setDataLayout(JIT.getTargetMachine().createDataLayout());
+            JIT.addModule(std::move(M));
+        }
+        return N;
+    }
+};
+
+// Sets the options, runs Checks and exits with their result. Runs in the child.
+static void runWithOptions(std::vector<std::string> Options, std::function<void()> Checks) {
+    std::vector<const char *> Argv = { "yorkie_test" };
+    for (auto &Option : Options)
+        Argv.push_back(Option.c_str());
+    if (!Yorkie::parseOptions(Argv.size(), Argv.data()))
+        exit(2);
+    Checks();
+    exit(::testing::Test::HasFailure() ? 1 : 0);
+}
+
+static const char *ChainSource =
+    "def f1(x) x + 1 end\n"
+    "def f2(x) f1(x) * 2 end\n"
+    "def f3(x) f2(x) + f1(x) end\n"
+    "def f4(x) f3(x) - f2(x) end\n"
+    "def f5(x) f4(f1(x)) end\n";
+
+TEST_F(stream_test, batches_call_each_other) {
+    auto Checks = [&] {
+        {
+            Yorkie::Context Ctx("<test>");
+            ASSERT_TRUE(Ctx.isValid());
+            ASSERT_TRUE(Ctx.compile(ChainSource));
+            ASSERT_TRUE(Ctx.finalize());
+        }
+
+        // Two definitions per module, the last one holds f5.
+        llvm::orc::KaleidoscopeJIT JIT;
+        EXPECT_EQ(3u, loadModules(JIT));
+        auto F3 = JIT.findSymbol("f3"), F5 = JIT.findSymbol("f5");
+        ASSERT_TRUE(F3 && F5);
+        EXPECT_EQ(6.0, ((double (*)(double))(intptr_t)F3.getAddress())(1));
+        EXPECT_EQ(3.0, ((double (*)(double))(intptr_t)F5.getAddress())(1));
+    };
+    EXPECT_EXIT(runWithOptions({ "-stream-dir=" + Dir, "-stream-batch=2" }, Checks),
+                ::testing::ExitedWithCode(0), "");
+}
+
+TEST_F(stream_test, input_is_read_in_chunks) {
+    auto Checks = [&] {
+        {
+            // Chunks end in the middle of tokens.
+            Yorkie::Context Ctx("<test>");
+            std::string Source = ChainSource;
+            size_t Next = 0;
+            ASSERT_TRUE(Ctx.compileStream([&](std::string &Buffer) {
+                if (Next >= Source.size())
+                    return false;
+                Buffer += Source.substr(Next, 7);
+                Next += 7;
+                return true;
+            }));
+            ASSERT_TRUE(Ctx.finalize());
+        }
+
+        llvm::orc::KaleidoscopeJIT JIT;
+        EXPECT_EQ(5u, loadModules(JIT));
+        auto F5 = JIT.findSymbol("f5");
+        ASSERT_TRUE(F5);
+        EXPECT_EQ(4.0, ((double (*)(double))(intptr_t)F5.getAddress())(2));
+    };
+    EXPECT_EXIT(runWithOptions({ "-stream-dir=" + Dir, "-stream-batch=1" }, Checks),
+                ::testing::ExitedWithCode(0), "");
+}
+
+TEST_F(stream_test, definitions_cant_be_repeated_in_later_batches) {
+    auto Checks = [&] {
+        {
+            Yorkie::Context Ctx("<test>");
+            ASSERT_TRUE(Ctx.compile("def f(x) x end\n"
+                                    "def g(x) f(x) * 2 end\n"
+                                    "g(1);\n"));
+
+            // f and main are in modules written out already.
+            EXPECT_FALSE(Ctx.compile("def f(x) x + 1 end\n"));
+            EXPECT_FALSE(Ctx.compile("def h(x) x end\n"
+                                     "2;\n"));
+            ASSERT_TRUE(Ctx.finalize());
+        }
+
+        // The first definitions are the ones linked.
+        llvm::orc::KaleidoscopeJIT JIT;
+        loadModules(JIT);
+        auto G = JIT.findSymbol("g"), H = JIT.findSymbol("h");
+        ASSERT_TRUE(G && H);
+        EXPECT_EQ(10.0, ((double (*)(double))(intptr_t)G.getAddress())(5));
+        EXPECT_EQ(5.0, ((double (*)(double))(intptr_t)H.getAddress())(5));
+    };
+    EXPECT_EXIT(runWithOptions({ "-stream-dir=" + Dir, "-stream-batch=1" }, Checks),
+                ::testing::ExitedWithCode(0), "");
+}
+
+typedef void BatchFn(const double *const *Cols, double *Out, int64_t N);
+
+TEST_F(stream_test, batch_wrappers_evaluate_every_row) {
+    auto Checks = [] {
+        Yorkie::Context Ctx("<test>", Yorkie::CodeTarget::JIT);
+        ASSERT_TRUE(Ctx.compile("def poly(x y) x * x + y end\n"));
+        auto *PolyBatch = Ctx.getFunction<BatchFn>("poly_batch");
+        ASSERT_TRUE(PolyBatch != nullptr);
+
+        std::vector<double> X, Y, Out(100, -1);
+        for (int i = 0; i < 100; ++i) {
+            X.push_back(i * 0.5);
+            Y.push_back(100 - i);
+        }
+        const double *Cols[] = { X.data(), Y.data() };
+        PolyBatch(Cols, Out.data(), 99);
+        for (int i = 0; i < 99; ++i)
+            EXPECT_EQ(X[i] * X[i] + Y[i], Out[i]) << i;
+        EXPECT_EQ(-1.0, Out[99]);
+    };
+    EXPECT_EXIT(runWithOptions({ "-batch=poly" }, Checks), ::testing::ExitedWithCode(0), "");
+}
+
+TEST_F(stream_test, batch_wrappers_are_streamed_with_their_function) {
+    auto Checks = [&] {
+        {
+            Yorkie::Context Ctx("<test>");
+            ASSERT_TRUE(Ctx.compile("def poly(x y) x * y end\n"
+                                    "def other(x) x end\n"));
+            ASSERT_TRUE(Ctx.finalize());
+        }
+
+        llvm::orc::KaleidoscopeJIT JIT;
+        EXPECT_EQ(2u, loadModules(JIT));
+        auto PolyBatch = JIT.findSymbol("poly_batch");
+        ASSERT_TRUE(PolyBatch);
+
+        double X[] = { 1, 2, 3 }, Y[] = { 4, 5, 6 }, Out[3];
+        const double *Cols[] = { X, Y };
+        ((BatchFn *)(intptr_t)PolyBatch.getAddress())(Cols, Out, 3);
+        for (int i = 0; i < 3; ++i)
+            EXPECT_EQ(X[i] * Y[i], Out[i]) << i;
+    };
+    EXPECT_EXIT(runWithOptions({ "-stream-dir=" + Dir, "-stream-batch=1", "-batch=poly" }, Checks),
+                ::testing::ExitedWithCode(0), "");
+}
@@ -0,0 +1,142 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "Yorkie.h"
+
+// Functions only take and return numbers, so each test reduces the vectors it
+// builds to a number, or goes through an array, and checks the lanes that way.
+class vector_test : public ::testing::Test {
+protected:
+    std::unique_ptr<Yorkie::Context> Ctx;
+
+    void SetUp() override { Ctx.reset(new Yorkie::Context("<test>", Yorkie::CodeTarget::JIT)); }
+    void TearDown() override { Ctx.reset(); }
+
+    double jit(const std::string &Name, double A) {
+        auto *F = Ctx->getFunction<double(double)>(Name);
+        EXPECT_TRUE(F != nullptr) << Name;
+        return F ? F(A) : 0;
+    }
+
+    double jit(const std::string &Name, double A, double B) {
+        auto *F = Ctx->getFunction<double(double, double)>(Name);
+        EXPECT_TRUE(F != nullptr) << Name;
+        return F ? F(A, B) : 0;
+    }
+
+    // The lanes of vec(x) in a new Context compiled for Target.
+    double getVecWidth(Yorkie::CodeTarget Target) {
+        Ctx.reset();
+        Ctx.reset(new Yorkie::Context("<test>", Target));
+        EXPECT_TRUE(Ctx->compile("def width(x) len(vec(x)) end\n"));
+        return jit("width", 0);
+    }
+};
+
+TEST_F(vector_test, operators_work_lane_by_lane) {
+    ASSERT_TRUE(Ctx->compile("def dot4(x y) hadd(vec4(x, 1, 2, 3) * vec4(y, 4, 5, 6)) end\n"
+                             "def diff(x) hmul(vec2(x, 10) - vec2(1, 4)) end\n"
+                             "def quot(x) hadd(vec4(x, 2, 3, 4) / vec4(2, 2, 3, 4)) end\n"
+                             "def below(x) hadd(vec4(0, 1, 2, 3) < x) end\n"
+                             "def scaled(x) hadd(vec4(1, 2, 3, 4) * x) end\n"));
+
+    EXPECT_EQ(2 * 3 + 4 + 10 + 18, jit("dot4", 2, 3));
+    EXPECT_EQ((5 - 1) * 6, jit("diff", 5));
+    EXPECT_EQ(4 + 3, jit("quot", 8));
+
+    // Comparisons give 1.0 or 0.0 in every lane.
+    EXPECT_EQ(0.0, jit("below", 0));
+    EXPECT_EQ(2.0, jit("below", 1.5));
+    EXPECT_EQ(4.0, jit("below", 10));
+
+    // A number used with a vector is used in every lane.
+    EXPECT_EQ(30.0, jit("scaled", 3));
+}
+
+TEST_F(vector_test, lanes_and_shuffles) {
+    ASSERT_TRUE(Ctx->compile("def set2(x) var v = setlane(vec4(0, 1, 2, 3), 2, x) in "
+                             "lane(v, 0) + lane(v, 1) * 10 + lane(v, 2) * 100 + lane(v, 3) * 1000 end end\n"
+                             "def rev(x) lane(shuffle(vec4(x, 1, 2, 3), 3, 2, 1, 0), 3) end\n"
+                             "def pick(x) var v = shuffle(vec2(x, 1), vec2(2, 3), 0, 3) in "
+                             "lane(v, 0) + lane(v, 1) * 10 end end\n"
+                             "def wide(x) len(shuffle(vec2(x, 1), 0, 1, 1, 0)) end\n"));
+
+    EXPECT_EQ(0 + 10 + 500 + 3000, jit("set2", 5));
+    EXPECT_EQ(7.0, jit("rev", 7));
+
+    // The lanes of the second vector are numbered after those of the first.
+    EXPECT_EQ(7 + 30, jit("pick", 7));
+    EXPECT_EQ(4.0, jit("wide", 0));
+}
+
+TEST_F(vector_test, horizontal_reductions) {
+    ASSERT_TRUE(Ctx->compile("def sum8(x) hadd(vec8(x, 1, 2, 3, 4, 5, 6, 7)) end\n"
+                             "def prod(x) hmul(vec4(x, 2, 3, 4)) end\n"
+                             "def least(x) hmin(vec4(3, x, 1, 2)) end\n"
+                             "def most(x) hmax(vec4(3, x, 1, 2)) end\n"));
+
+    EXPECT_EQ(10 + 28, jit("sum8", 10));
+    EXPECT_EQ(24 * 5, jit("prod", 5));
+    EXPECT_EQ(1.0, jit("least", 5));
+    EXPECT_EQ(-4.0, jit("least", -4));
+    EXPECT_EQ(5.0, jit("most", 5));
+    EXPECT_EQ(3.0, jit("most", -4));
+}
+
+TEST_F(vector_test, vec_has_the_host_width) {
+    double JITWidth = getVecWidth(Yorkie::CodeTarget::JIT);
+    double GenericWidth = getVecWidth(Yorkie::CodeTarget::PrintedIR);
+
+    // Widths are powers of two, at least 2. The host's CPU has at least the
+    // vector registers of the generic one.
+    for (double Width : { JITWidth, GenericWidth }) {
+        EXPECT_GE(Width, 2.0);
+        EXPECT_EQ(0, (int64_t)Width & ((int64_t)Width - 1)) << Width;
+    }
+    EXPECT_GE(JITWidth, GenericWidth);
+#if defined(__x86_64__)
+    EXPECT_EQ(2.0, GenericWidth);
+#endif
+
+    // vec(x) fills every lane.
+    Ctx.reset();
+    Ctx.reset(new Yorkie::Context("<test>", Yorkie::CodeTarget::JIT));
+    ASSERT_TRUE(Ctx->compile("def splat(x) hadd(vec(x)) end\n"));
+    EXPECT_EQ(3 * JITWidth, jit("splat", 3));
+}
+
+TEST_F(vector_test, loads_and_stores_go_through_arrays) {
+    ASSERT_TRUE(Ctx->compile("def double(a[] i) hadd(vstore(a, i, vload(a, i) * 2)) end\n"
+                             "def width(x) len(vec(x)) end\n"));
+
+    int64_t Width = (int64_t)jit("width", 0);
+    ASSERT_LE(Width, 8);
+    auto *Double = Ctx->getFunction<double(double *, int64_t, double)>("double");
+    ASSERT_TRUE(Double != nullptr);
+
+    // Lanes are loaded from and stored to a[i] onwards.
+    alignas(64) double Data[16];
+    for (int i = 0; i < 16; ++i)
+        Data[i] = i;
+    double Sum = 0;
+    for (int64_t i = 1; i <= Width; ++i)
+        Sum += 2 * i;
+    EXPECT_EQ(Sum, Double(Data, 16, 1));
+    for (int64_t i = 0; i < 16; ++i)
+        EXPECT_EQ(i >= 1 && i <= Width ? 2.0 * i : i, Data[i]) << i;
+}
+
+TEST_F(vector_test, vectors_stay_inside_functions) {
+    // Functions only return numbers, and vectors of different widths don't mix.
+    EXPECT_FALSE(Ctx->compile("def splat4(x) vec4(x) end\n"));
+    EXPECT_FALSE(Ctx->compile("def mixed(x) hadd(vec2(x) + vec4(x)) end\n"));
+    EXPECT_FALSE(Ctx->compile("def both(x) vec4(x) & 1 end\n"));
+    EXPECT_FALSE(Ctx->compile("def lanes(x) hadd(shuffle(vec4(x), 0, 1, 2)) end\n"));
+    EXPECT_FALSE(Ctx->compile("def index(x) hadd(shuffle(vec4(x), x, 1)) end\n"));
+
+    // A function of the same name is called instead of the builtin.
+    ASSERT_TRUE(Ctx->compile("def hadd(x) x + 1 end\n"
+                             "def call(x) hadd(x) end\n"));
+    EXPECT_EQ(3.0, jit("call", 2));
+}
@@ -0,0 +1,217 @@
+#include "ProgramGenerator.h"
+#include <sstream>
+#include <vector>
+
+namespace Gen {
+
+namespace {
+
+// Emits one program. Random choices come from a 64 bit LCG rather than
+// <random> distributions, whose output differs between standard libraries.
+class Generator {
+    const GeneratorOptions &Opts;
+    std::ostream &OS;
+    uint64_t State;
+    std::vector<unsigned> Arity;        // Parameters of each function emitted so far
+    std::vector<std::string> Scope;     // Variables visible in the current expression
+    std::string BinaryOps = "+-*<";     // Builtin and user defined binary operators
+    std::string UnaryOps;               // User defined unary operators
+    unsigned NextVar = 0;
+    unsigned LoopDepth = 0;
+
+    unsigned random(unsigned N) {
+        State = State * 6364136223846793005ull + 1442695040888963407ull;
+        return (unsigned)(State >> 33) % N;
+    }
+
+    void emitLeaf();
+    void emitExpr(unsigned Depth);
+    void emitCall(unsigned Depth);
+    void emitOperators();
+    void emitFunction(uint64_t Index);
+
+public:
+    Generator(const GeneratorOptions &Opts, std::ostream &OS)
+        : Opts(Opts), OS(OS), State(Opts.Seed * 2654435761ull + 1) {}
+
+    void run();
+};
+
+void Generator::emitLeaf() {
+    if (Scope.empty() || random(3) == 0)
+        OS << random(100);
+    else
+        OS << Scope[random(Scope.size())];
+}
+
+void Generator::emitCall(unsigned Depth) {
+    uint64_t Callee = 0;
+    switch (Opts.Shape) {
+    case LocalCalls: {
+        uint64_t Window = Arity.size() < 16 ? Arity.size() : 16;
+        Callee = Arity.size() - 1 - random(Window);
+        break;
+    }
+    case ChainCalls:
+        Callee = Arity.size() - 1;
+        break;
+    case RandomCalls:
+        // Two draws, random() only returns 31 bits.
+        Callee = (((uint64_t)random(1u << 31) << 31) | random(1u << 31)) % Arity.size();
+        break;
+    case StarCalls:
+        Callee = 0;
+        break;
+    }
+
+    OS << 'f' << Callee << '(';
+    for (unsigned i = 0; i != Arity[Callee]; ++i) {
+        if (i)
+            OS << ", ";
+        emitExpr(Depth + 1);
+    }
+    OS << ')';
+}
+
+void Generator::emitExpr(unsigned Depth) {
+    if (Depth >= Opts.MaxDepth) {
+        emitLeaf();
+        return;
+    }
+
+    switch (random(10)) {
+    case 0:
+        if (!UnaryOps.empty()) {
+            OS << UnaryOps[random(UnaryOps.size())] << '(';
+            emitExpr(Depth + 1);
+            OS << ')';
+            return;
+        }
+        // Fall through
+    case 1:
+        emitLeaf();
+        return;
+    case 2:
+    case 3:
+    case 4:
+        OS << '(';
+        emitExpr(Depth + 1);
+        OS << ' ' << BinaryOps[random(BinaryOps.size())] << ' ';
+        emitExpr(Depth + 1);
+        OS << ')';
+        return;
+    case 5:
+        OS << "if ";
+        emitExpr(Depth + 1);
+        OS << " then ";
+        emitExpr(Depth + 1);
+        OS << " else ";
+        emitExpr(Depth + 1);
+        OS << " end";
+        return;
+    case 6: {
+        if (LoopDepth >= Opts.MaxLoopDepth) {
+            emitLeaf();
+            return;
+        }
+        std::string Var = "i" + std::to_string(NextVar++);
+        OS << "for " << Var << " = 0, " << Var << " < " << random(8) + 1 << ", 1 in ";
+        Scope.push_back(Var);
+        ++LoopDepth;
+        emitExpr(Depth + 1);
+        --LoopDepth;
+        Scope.pop_back();
+        OS << " end";
+        return;
+    }
+    case 7: {
+        std::string Var = "v" + std::to_string(NextVar++);
+        OS << "var " << Var << " = ";
+        emitExpr(Depth + 1);
+        OS << " in ";
+        Scope.push_back(Var);
+        emitExpr(Depth + 1);
+        Scope.pop_back();
+        OS << " end";
+        return;
+    }
+    default:
+        if (Arity.empty())
+            emitLeaf();
+        else
+            emitCall(Depth);
+        return;
+    }
+}
+
+// Operators alternate between binary and unary. Their bodies only use
+// builtin operators, so they are leaves the inliner can take.
+void Generator::emitOperators() {
+    static const char Binary[] = { '^', '@', '$', ':' };
+    static const char Unary[] = { '!', '~', '?' };
+    for (unsigned i = 0; i != Opts.NumOperators && i != 7; ++i) {
+        if (i % 2 == 0) {
+            char Op = Binary[i / 2];
+            OS << "def binary" << Op << ' ' << random(40) + 5 << " (LHS RHS)\n"
+               << "    if LHS < RHS then RHS - LHS else LHS * " << random(9) + 1 << " end\n"
+               << "end\n\n";
+            BinaryOps += Op;
+        } else {
+            char Op = Unary[i / 2];
+            OS << "def unary" << Op << "(v)\n"
+               << "    if v < " << random(50) << " then 0 - v else v end\n"
+               << "end\n\n";
+            UnaryOps += Op;
+        }
+    }
+}
+
+void Generator::emitFunction(uint64_t Index) {
+    unsigned NumArgs = random(Opts.MaxArgs) + 1;
+    OS << "def f" << Index << '(';
+    for (unsigned i = 0; i != NumArgs; ++i) {
+        std::string Arg = "a" + std::to_string(i);
+        OS << (i ? " " : "") << Arg;
+        Scope.push_back(Arg);
+    }
+    OS << ")\n";
+
+    unsigned NumExprs = random(Opts.MaxExprs) + 1;
+    for (unsigned i = 0; i != NumExprs; ++i) {
+        OS << "    ";
+        emitExpr(0);
+        OS << (i + 1 != NumExprs ? ";\n" : "\n");
+    }
+    OS << "end\n\n";
+
+    Scope.clear();
+    NextVar = 0;
+    Arity.push_back(NumArgs);
+}
+
+void Generator::run() {
+    emitOperators();
+    for (uint64_t i = 0; i != Opts.NumFunctions; ++i)
+        emitFunction(i);
+
+    if (Arity.empty())
+        return;
+    OS << 'f' << Arity.size() - 1 << '(';
+    for (unsigned i = 0; i != Arity.back(); ++i)
+        OS << (i ? ", " : "") << i + 1;
+    OS << ")\n";
+}
+
+}
+
+void generateProgram(const GeneratorOptions &Opts, std::ostream &OS) {
+    Generator(Opts, OS).run();
+}
+
+std::string generateProgram(const GeneratorOptions &Opts) {
+    std::ostringstream OS;
+    generateProgram(Opts, OS);
+    return OS.str();
+}
+
+} // Namespace
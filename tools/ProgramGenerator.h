@@ -0,0 +1,48 @@
+#ifndef YORKIE_PROGRAMGENERATOR_H
+#define YORKIE_PROGRAMGENERATOR_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+//===============================================
+// ProgramGenerator.h
+//
+// Generates synthetic yorkie programs, for compiler benchmarks.
+//
+// A program is NumOperators user defined operators, then NumFunctions
+// definitions f0, f1, ... and a single top level expression calling the last
+// one. Function bodies mix arithmetic, operators, if/else, for loops, var
+// bindings and calls to earlier functions, so every program is valid and its
+// call graph is acyclic. The same options always give the same program.
+//
+//===============================================
+
+namespace Gen {
+
+// Which earlier functions a function calls.
+enum CallGraphShape {
+    LocalCalls,     // One of the previous 16 functions
+    ChainCalls,     // Only the previous function
+    RandomCalls,    // Any earlier function
+    StarCalls,      // Only f0
+};
+
+struct GeneratorOptions {
+    uint64_t NumFunctions = 100;
+    unsigned Seed = 1;
+    unsigned MaxArgs = 3;       // Parameters per function
+    unsigned MaxExprs = 3;      // Body expressions per function
+    unsigned MaxDepth = 4;      // Nesting depth of each body expression
+    unsigned MaxLoopDepth = 2;  // Nesting depth of for loops
+    unsigned NumOperators = 0;  // User defined operators, at most 7
+    CallGraphShape Shape = LocalCalls;
+};
+
+// Writes the program to OS as it is generated.
+void generateProgram(const GeneratorOptions &Opts, std::ostream &OS);
+std::string generateProgram(const GeneratorOptions &Opts);
+
+}
+
+#endif /* end of include guard:  */
@@ -0,0 +1,76 @@
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include "ProgramGenerator.h"
+
+//===============================================
+// yorkie-gen
+//
+// Writes a synthetic yorkie program, for scaling tests:
+//   yorkie-gen -functions=100000 -call-graph=random -o big.yk
+//
+//===============================================
+
+using namespace llvm;
+
+cl::OptionCategory
+GeneratorCategory("Generator Options", "Options for controlling the generated program.");
+static cl::opt<std::string>
+OutputFilename("o", cl::desc("Output file (defaults to stdout)"), cl::init("-"),
+               cl::value_desc("filename"), cl::cat(GeneratorCategory));
+static cl::opt<uint64_t>
+NumFunctions("functions", cl::desc("Number of functions"), cl::init(100), cl::cat(GeneratorCategory));
+static cl::opt<unsigned>
+Seed("seed", cl::desc("Random seed"), cl::init(1), cl::cat(GeneratorCategory));
+static cl::opt<unsigned>
+MaxArgs("max-args", cl::desc("Max parameters per function"), cl::init(3), cl::cat(GeneratorCategory));
+static cl::opt<unsigned>
+MaxExprs("max-exprs", cl::desc("Max body expressions per function"), cl::init(3),
+         cl::cat(GeneratorCategory));
+static cl::opt<unsigned>
+MaxDepth("max-depth", cl::desc("Max nesting depth of an expression"), cl::init(4),
+         cl::cat(GeneratorCategory));
+static cl::opt<unsigned>
+MaxLoopDepth("max-loop-depth", cl::desc("Max nesting depth of for loops"), cl::init(2),
+             cl::cat(GeneratorCategory));
+static cl::opt<unsigned>
+NumOperators("operators", cl::desc("Number of user defined operators (0-7)"), cl::init(0),
+             cl::cat(GeneratorCategory));
+static cl::opt<Gen::CallGraphShape>
+Shape("call-graph", cl::desc("Which earlier functions a function calls:"),
+      cl::init(Gen::LocalCalls), cl::cat(GeneratorCategory),
+      cl::values(clEnumValN(Gen::LocalCalls, "local", "One of the previous 16 functions"),
+                 clEnumValN(Gen::ChainCalls, "chain", "Only the previous function"),
+                 clEnumValN(Gen::RandomCalls, "random", "Any earlier function"),
+                 clEnumValN(Gen::StarCalls, "star", "Only the first function"),
+                 clEnumValEnd));
+
+int main(int argc, char **argv) {
+    cl::HideUnrelatedOptions(GeneratorCategory);
+    cl::ParseCommandLineOptions(argc, argv, "yorkie program generator\n");
+
+    Gen::GeneratorOptions Opts;
+    Opts.NumFunctions = NumFunctions;
+    Opts.Seed = Seed;
+    Opts.MaxArgs = std::max(1u, (unsigned)MaxArgs);
+    Opts.MaxExprs = std::max(1u, (unsigned)MaxExprs);
+    Opts.MaxDepth = MaxDepth;
+    Opts.MaxLoopDepth = MaxLoopDepth;
+    Opts.NumOperators = NumOperators;
+    Opts.Shape = Shape;
+
+    if (OutputFilename == "-") {
+        Gen::generateProgram(Opts, std::cout);
+        return 0;
+    }
+
+    std::ofstream OS(OutputFilename, std::ios::trunc);
+    if (!OS) {
+        errs() << "Could not open output file '" << OutputFilename << "'\n";
+        return 1;
+    }
+    Gen::generateProgram(Opts, OS);
+    return OS.good() ? 0 : 1;
+}
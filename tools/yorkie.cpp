@@ -0,0 +1,99 @@
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Yorkie.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+using namespace llvm;
+
+//===============================================
+// yorkie.cpp
+//
+// The yorkie tool, a thin driver over libyorkie: compiles a source file (or
+// stdin) and prints the optimized module's IR to stderr, ready for
+// `clang -x ir -`. With -stream-dir the IR goes to files there instead, and
+// with -repl it evaluates the input line by line.
+//
+//===============================================
+
+static cl::opt<std::string>
+InputFilename("input-file", cl::desc("File to compile (defaults to stdin)"),
+              cl::init("-"), cl::value_desc("filename"), cl::cat(Yorkie::getOptionCategory()));
+static cl::alias
+InputFileAlias("i", cl::desc("Alias for -input-file"), cl::aliasopt(InputFilename));
+static cl::opt<bool>
+Repl("repl", cl::desc("Evaluate each top level expression as soon as it is read"),
+     cl::init(false), cl::cat(Yorkie::getOptionCategory()));
+
+// The file named in the debug info.
+static std::string SourceName() {
+    return InputFilename == "-" ? "<stdin>" : InputFilename.getValue();
+}
+
+// Opens the input file, or stdin.
+static FILE *OpenInput() {
+    if (InputFilename == "-")
+        return stdin;
+    FILE *In = fopen(InputFilename.c_str(), "r");
+    if (!In) {
+        errs() << "Could not open input file '" << InputFilename << "': "
+               << strerror(errno) << '\n';
+        exit(2);
+    }
+    return In;
+}
+
+// Reads the input a line at a time, prompting for each when it's a terminal.
+static int RunRepl() {
+    FILE *In = OpenInput();
+    bool Prompt = In == stdin && sys::Process::StandardInIsUserInput();
+
+    Yorkie::Context Ctx(SourceName(), Yorkie::CodeTarget::JIT);
+    if (!Ctx.isValid())
+        return 2;
+    Ctx.runInteractive(
+        [&](std::string &Line) {
+            if (Prompt)
+                fprintf(stderr, "ready> ");
+            char Buf[4096];
+            do {
+                if (!fgets(Buf, sizeof(Buf), In))
+                    return !Line.empty();
+                Line += Buf;
+            } while (Line.back() != '\n');
+            return true;
+        },
+        [](double Val) { fprintf(stderr, "Evaluated to %f\n", Val); });
+
+    if (In != stdin)
+        fclose(In);
+    Ctx.printTimeReport();
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (!Yorkie::parseOptions(argc, argv))
+        return 2;
+    if (Repl)
+        return RunRepl();
+
+    // The input is read a chunk at a time, it's never all in memory.
+    FILE *In = OpenInput();
+    Yorkie::Context Ctx(SourceName());
+    if (!Ctx.isValid())
+        return 2;
+    Ctx.compileStream([&](std::string &Chunk) {
+        char Buf[65536];
+        size_t Size = fread(Buf, 1, sizeof(Buf), In);
+        Chunk.append(Buf, Size);
+        return Size != 0;
+    });
+    if (In != stdin)
+        fclose(In);
+
+    Ctx.printIR(errs());
+    Ctx.printTimeReport();
+    return 0;
+}